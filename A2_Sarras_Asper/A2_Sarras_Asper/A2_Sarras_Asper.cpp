@@ -5,6 +5,22 @@
 
 #include "FrameResource.h"
 #include "Waves.h"
+#include "GpuWaves.h"
+#include "GpuForest.h"
+#include "ClusteredLights.h"
+#include "Terrain.h"
+#include "TransformHierarchy.h"
+#include "RenderItemStore.h"
+#include "SceneFile.h"
+#include "TextureStreamer.h"
+#include "ShaderCache.h"
+#include "ShaderPermutations.h"
+#include "PipelineCache.h"
+#include "Profiler.h"
+#include "Benchmark.h"
+#include "FileWatcher.h"
+
+#include <ppl.h>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -13,40 +29,54 @@ using namespace DirectX::PackedVector;
 #pragma comment(lib, "d3dcompiler.lib")
 #pragma comment(lib, "D3D12.lib")
 
-const int gNumFrameResources = 3;
-
-// Lightweight structure stores parameters to draw a shape.  This will
-// vary from app-to-app.
-struct RenderItem
+// How many frames the CPU may record ahead of the GPU.  Set with -frameresources.
+int gNumFrameResources = 3;
+
+// Size of each frame's transient upload heap; room for 4096 object cbuffers, less
+// what the terrain's tiles take.
+const UINT64 gFrameUploadByteSize = 1 << 20;
+
+// Size of each placed heap streamed textures are suballocated from.
+const UINT64 gTextureHeapByteSize = 64 << 20;
+
+// Point and spot lights the clustered path has room for each frame, and how the view
+// is split into clusters: 16x9 tiles of the screen by 24 depth slices.
+const UINT gMaxClusteredLights = 4096;
+const UINT gClusterCountX = 16;
+const UINT gClusterCountY = 9;
+const UINT gClusterCountZ = 24;
+const UINT gMaxLightsPerCluster = 64;
+
+// Levels of detail built for the round shapes, and the projected height in pixels
+// under which each level after the first takes over.
+const UINT gLodCount = 3;
+const float gLodScreenHeights[gLodCount - 1] = { 120.0f, 40.0f };
+
+// Render items that share the same geometry, material and PSO.  They are drawn
+// with a single DrawIndexedInstanced call, reading the World/TexTransform of each
+// item from the frame's instance buffer.
+struct InstanceBatch
 {
-	RenderItem() = default;
-
-    // World matrix of the shape that describes the object's local space
-    // relative to the world space, which defines the position, orientation,
-    // and scale of the object in the world.
-    XMFLOAT4X4 World = MathHelper::Identity4x4();
-
-	XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+	Material* Mat = nullptr;
+	MeshGeometry* Geo = nullptr;
 
-	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
-	// Because we have an object cbuffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify obect data we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
+	D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
-	UINT ObjCBIndex = -1;
+	// DrawIndexedInstanced parameters shared by every instance.
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	int BaseVertexLocation = 0;
 
-	Material* Mat = nullptr;
-	MeshGeometry* Geo = nullptr;
+	// Level of detail drawn; only items currently at this level are written.
+	UINT Lod = 0;
 
-    // Primitive topology.
-    D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	// Handles of the render items drawn by this batch.
+	std::vector<UINT> Ritems;
 
-    // DrawIndexedInstanced parameters.
-    UINT IndexCount = 0;
-    UINT StartIndexLocation = 0;
-    int BaseVertexLocation = 0;
+	// First element of this batch in the instance buffer, and the number of
+	// instances written there for the current frame.
+	UINT InstanceOffset = 0;
+	UINT InstanceCount = 0;
 };
 
 enum class RenderLayer : int
@@ -55,19 +85,170 @@ enum class RenderLayer : int
 	Transparent,
 	AlphaTested,
 	AlphaTestedTreeSprites,
+	GpuWaves,
+	CpuWaves,
+	Terrain,
+	Count
+};
+
+// Order the layers are drawn in each frame.  The water layers go last so they
+// blend over everything else.
+const RenderLayer gLayerDrawOrder[] =
+{
+	RenderLayer::Opaque,
+	RenderLayer::Terrain,
+	RenderLayer::AlphaTested,
+	RenderLayer::AlphaTestedTreeSprites,
+	RenderLayer::GpuWaves,
+	RenderLayer::CpuWaves,
+	RenderLayer::Transparent
+};
+
+// Tree sprites are expanded by the geometry shader, GPU waves read their grid
+// constants from the object cbuffer and CPU waves use two vertex streams, so none
+// of them can be drawn from the instance buffer.  The terrain instances its own tiles.
+inline bool LayerSupportsInstancing(RenderLayer layer)
+{
+	return layer != RenderLayer::AlphaTestedTreeSprites &&
+		layer != RenderLayer::GpuWaves &&
+		layer != RenderLayer::CpuWaves &&
+		layer != RenderLayer::Terrain;
+}
+
+// Layers drawn with blending, which have to be sorted back to front.
+inline bool LayerIsBlended(RenderLayer layer)
+{
+	return layer == RenderLayer::Transparent ||
+		layer == RenderLayer::GpuWaves ||
+		layer == RenderLayer::CpuWaves;
+}
+
+// Names of the layers in the profiler's output.
+const char* const gLayerNames[(int)RenderLayer::Count] =
+{
+	"opaque",
+	"transparent",
+	"alphaTested",
+	"treeSprites",
+	"gpuWaves",
+	"cpuWaves",
+	"terrain"
+};
+
+// Layer a scene file item named layer is drawn in, or RenderLayer::Count if scene
+// items may not go there.  The other layers have draw paths of their own that cannot
+// draw a plain castle mesh.
+inline RenderLayer FindSceneLayer(const char* layer)
+{
+	const RenderLayer sceneLayers[] = { RenderLayer::Opaque, RenderLayer::AlphaTested };
+	for(RenderLayer sceneLayer : sceneLayers)
+	{
+		if(strcmp(gLayerNames[(int)sceneLayer], layer) == 0)
+			return sceneLayer;
+	}
+
+	return RenderLayer::Count;
+}
+
+// GPU scopes timed by the profiler.  Each layer is timed too, in a scope of its own
+// after these.
+enum class GpuTiming : UINT
+{
+	Frame = 0,
+	WavesSimulation,
+	ForestCull,
+	LightCull,
+	FirstLayer,
+	Count = FirstLayer + (UINT)RenderLayer::Count
+};
+
+inline UINT LayerGpuTiming(RenderLayer layer)
+{
+	return (UINT)GpuTiming::FirstLayer + (UINT)layer;
+}
+
+// CPU scopes timed by the profiler.
+enum class CpuTiming : UINT
+{
+	Update = 0,
+	UpdateTransforms,
+	UpdateObjectCBs,
+	UpdateWaves,
+	DrawRenderItems,
+	DrawInstanceBatches,
 	Count
 };
 
+// Input assembler and root argument changes made while recording one layer.  Each
+// layer is recorded by at most one thread, so each gets its own counters.
+struct DrawStats
+{
+	UINT Draws = 0;
+	UINT StateChanges = 0;
+	UINT StateChangesSkipped = 0;
+};
+
+// A texture loaded through TextureStreamer and the heap slot its SRV is written to
+// once it is resident.
+struct StreamedTexture
+{
+	std::string Name;
+	std::wstring Filename;
+	UINT SrvHeapIndex = 0;
+	bool IsArray = false;
+
+	// Set once the texture is resident.
+	ID3D12Resource* Resource = nullptr;
+};
+
+// Command line options for how frames are queued and shown:
+//   -frameresources n   frames the CPU may record ahead of the GPU (1 to 8)
+//   -backbuffers n      swap chain buffers (2 to 4)
+//   -latency n          frames that may wait for the display before the CPU blocks
+//   -vsync              wait for vertical blank instead of presenting with tearing
+struct FramePacingSettings
+{
+	int FrameResourceCount = 3;
+	int BackBufferCount = 3;
+	UINT MaxFrameLatency = 2;
+	bool Vsync = false;
+};
+
+FramePacingSettings ParseFramePacingSettings(const std::string& cmdLine)
+{
+	FramePacingSettings settings;
+
+	std::istringstream args(cmdLine);
+	std::string token;
+	while(args >> token)
+	{
+		if(token == "-frameresources")
+			args >> settings.FrameResourceCount;
+		else if(token == "-backbuffers")
+			args >> settings.BackBufferCount;
+		else if(token == "-latency")
+			args >> settings.MaxFrameLatency;
+		else if(token == "-vsync")
+			settings.Vsync = true;
+	}
+
+	settings.FrameResourceCount = std::min<int>(std::max<int>(settings.FrameResourceCount, 1), 8);
+	return settings;
+}
+
 class TreeBillboardsApp : public D3DApp
 {
 public:
-    TreeBillboardsApp(HINSTANCE hInstance);
+    TreeBillboardsApp(HINSTANCE hInstance, const BenchmarkSettings& benchmark, const FramePacingSettings& framePacing);
     TreeBillboardsApp(const TreeBillboardsApp& rhs) = delete;
     TreeBillboardsApp& operator=(const TreeBillboardsApp& rhs) = delete;
     ~TreeBillboardsApp();
 
     virtual bool Initialize()override;
 
+	// Replaces Run when the benchmark is enabled.  Returns the process exit code.
+	int RunBenchmark();
+
 private:
     virtual void OnResize()override;
     virtual void Update(const GameTimer& gt)override;
@@ -80,30 +261,64 @@ private:
     void OnKeyboardInput(const GameTimer& gt);
 	void UpdateCamera(const GameTimer& gt);
 	void AnimateMaterials(const GameTimer& gt);
+	void UpdateTransforms(const GameTimer& gt);
+	void MarkRitemDirty(UINT ritem);
 	void UpdateObjectCBs(const GameTimer& gt);
-	void UpdateMaterialCBs(const GameTimer& gt);
+	ObjectConstants MakeObjectConstants(UINT slot)const;
+	void UpdateMaterialBuffer(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 	void UpdateWaves(const GameTimer& gt); 
+	void UpdateGpuWaves(const GameTimer& gt);
+	void UpdateInstanceData(const GameTimer& gt);
+	void UpdateClusteredLights(const GameTimer& gt);
+	void CullRenderItems(const GameTimer& gt);
+	UINT64 MakeSortKey(RenderLayer layer, UINT slot, float viewDepth)const;
+	void SelectLod(UINT slot, const BoundingBox& worldBounds);
+	void UpdateFrameStatsText();
+	void UpdateTextureStreaming();
+	void UpdateTextureResidency();
 
 	void LoadTextures();
+	void CreateTextureSrv(const Texture& tex, UINT heapIndex, bool isArray);
     void BuildRootSignature();
+	void BuildWavesRootSignature();
+	void BuildForestRootSignature();
+	void BuildLightCullRootSignature();
+	void BuildOverlayRootSignature();
 	void BuildDescriptorHeaps();
     void BuildShadersAndInputLayouts();
-    void BuildLandGeometry();
-	void BuildUnderLandGeometry();
+    void BuildShapeGeometry();
+	void CompileScene(const std::wstring& sourceFilename, const std::wstring& sceneFilename, UINT64 sourceStamp);
     void BuildWavesGeometry();
-	void BuildBoxGeometry();
-	void BuildPyramidGeometry();
-	void BuildCylinderGeometry();
-	void BuildConeGeometry();
-	void BuildWedgeGeometry();
-	void BuildDiamondGeometry();
+	void BuildGpuWavesGeometry();
 	void BuildTreeSpritesGeometry();
+	void BuildTerrainGeometry();
     void BuildPSOs();
     void BuildFrameResources();
     void BuildMaterials();
     void BuildRenderItems();
-    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+	void BuildTorches();
+	void BuildTransformHierarchy();
+	void BuildRenderItemLods();
+	void BuildInstanceBatches();
+	void BuildLayerCommandLists();
+	void SetFrameState(ID3D12GraphicsCommandList* cmdList);
+	void DrawLayer(ID3D12GraphicsCommandList* cmdList, RenderLayer layer);
+	void DrawForest(ID3D12GraphicsCommandList* cmdList, DrawStats& stats);
+	void DrawTerrain(ID3D12GraphicsCommandList* cmdList, bool bindless, DrawStats& stats);
+	void DrawProfilerOverlay(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* pso);
+	void EndFrameCommands(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* overlayPSO);
+	void CreateBackgroundPSO(const std::string& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+	void CollectBackgroundPSOs(bool wait);
+	void UpdateHotReload();
+	void StartShaderReload(bool sourcesChanged);
+	std::string GetLayerPSOName(RenderLayer layer)const;
+	ID3D12PipelineState* GetLayerPSO(RenderLayer layer);
+	bool LayerUsesBindless(RenderLayer layer)const;
+    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<UINT>& slots, bool bindless, DrawStats& stats);
+	void DrawInstanceBatches(ID3D12GraphicsCommandList* cmdList, const std::vector<InstanceBatch>& batches, bool bindless, DrawStats& stats);
+
+	bool WasKeyPressed(int vkeyCode);
 
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
 
@@ -119,27 +334,191 @@ private:
     UINT mCbvSrvDescriptorSize = 0;
 
     ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mWavesRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mForestRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mLightCullRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mOverlayRootSignature = nullptr;
+
+	// One command list per entry of gLayerDrawOrder, recorded in parallel.
+	// Press 'M' to switch between parallel and single list recording.
+	ComPtr<ID3D12GraphicsCommandList> mLayerCmdLists[_countof(gLayerDrawOrder)];
+	bool mMultithreadedRecording = true;
 
 	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
 
 	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
 	std::unordered_map<std::string, std::unique_ptr<Material>> mMaterials;
+	// Placed heaps the streamed textures live in.  Declared before mTextures so the
+	// heaps outlive the textures placed in them.
+	std::unique_ptr<TextureHeap> mTextureHeap;
+
 	std::unordered_map<std::string, std::unique_ptr<Texture>> mTextures;
+
+	// Textures stream in on worker threads and a copy queue.  Until its texture is
+	// resident a material samples the white placeholder instead.
+	std::unique_ptr<TextureStreamer> mTextureStreamer;
+	std::vector<StreamedTexture> mStreamedTextures;
+	UINT mPlaceholderSrvIndex = 0;
+	UINT mPlaceholderArraySrvIndex = 0;
+
+	// The streamed textures' slots plus the two placeholder slots, from the start of
+	// the SRV heap.  This is also the size of the bindless texture table.
+	UINT mTextureDescriptorCount = 0;
+
+	// Press 'T' to switch between binding each material's texture as its own table and
+	// binding every texture once per frame, indexed by MaterialData::DiffuseMapIndex.
+	bool mBindlessEnabled = true;
+
+	// Materials still bound to a placeholder, with the heap slot they wait for.
+	std::vector<std::pair<Material*, UINT>> mMaterialsAwaitingTextures;
+	// Compiled bytecode kept on disk between launches.
+	std::unique_ptr<ShaderCache> mShaderCache;
 	std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
+
+	// mShaders holds the variants for mPassPermutation, the lights and fog the main
+	// pass uses.  When UpdateMainPassCB changes it, the lit PSOs are rebuilt the way
+	// a hot reload rebuilds them.
+	std::unique_ptr<ShaderPermutations> mShaderPermutations;
+	ShaderPermutation mPassPermutation;
+	bool mPermutationChanged = false;
+	bool mFogEnabled = false;
 	std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
 
+	// PSOs the driver compiled in earlier runs, kept on disk.
+	std::unique_ptr<PipelineCache> mPipelineCache;
+
+	// PSOs the first frame does not draw with are created on worker threads and
+	// moved into mPSOs by CollectBackgroundPSOs.
+	struct BackgroundPSO
+	{
+		std::string Name;
+		ComPtr<ID3D12PipelineState> PSO;
+		std::exception_ptr Error;
+	};
+	concurrency::task_group mBackgroundPSOTasks;
+	std::mutex mBackgroundPSOMutex;
+	std::vector<BackgroundPSO> mBackgroundPSOs;
+	UINT mPendingBackgroundPSOs = 0;
+
+	// Hot reload.  Edits to the shaders and textures on disk are picked up by
+	// mFileWatcher.  Shaders are recompiled and the PSOs using them rebuilt on a worker,
+	// then swapped in by UpdateHotReload at the start of a frame.  Every shader and
+	// PSO description is kept for that.
+	struct ShaderReload
+	{
+		// Only the shaders whose bytecode changed, and the PSOs drawing with them.
+		std::unordered_map<std::string, ComPtr<ID3DBlob>> Shaders;
+		std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> PSOs;
+		std::unordered_map<std::string, D3D12_GRAPHICS_PIPELINE_STATE_DESC> GraphicsDescs;
+		std::unordered_map<std::string, D3D12_COMPUTE_PIPELINE_STATE_DESC> ComputeDescs;
+
+		// Set if a PSO failed to build, in which case nothing is swapped in.
+		std::wstring Error;
+	};
+	std::unique_ptr<FileWatcher> mFileWatcher;
+	std::vector<ShaderDesc> mShaderDescs;
+	std::unordered_map<std::string, D3D12_GRAPHICS_PIPELINE_STATE_DESC> mGraphicsPSODescs;
+	std::unordered_map<std::string, D3D12_COMPUTE_PIPELINE_STATE_DESC> mComputePSODescs;
+	concurrency::task_group mShaderReloadTasks;
+	std::mutex mShaderReloadMutex;
+	std::unique_ptr<ShaderReload> mFinishedShaderReload;
+	bool mShaderReloadRunning = false;
+	bool mShadersChanged = false;
+
+	// Replaced PSOs, kept until the fence value beside them has passed, since frames
+	// still in flight may draw with them.
+	std::vector<std::pair<UINT64, ComPtr<ID3D12PipelineState>>> mRetiredPSOs;
+
     std::vector<D3D12_INPUT_ELEMENT_DESC> mStdInputLayout;
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mTreeSpriteInputLayout;
+	std::vector<D3D12_INPUT_ELEMENT_DESC> mWavesInputLayout;
+
+	// Handles into mRitems.
+    UINT mWavesRitem = RenderItemStore::None;
+	UINT mTreeSpritesRitem = RenderItemStore::None;
+	UINT mTerrainRitem = RenderItemStore::None;
 
-    RenderItem* mWavesRitem = nullptr;
+	// All the render items, each in one layer, one per PSO, or in none for
+	// RenderLayer::Count.
+	std::unique_ptr<RenderItemStore> mRitems;
 
-	// List of all the render items.
-	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
+	// Handles of the items whose ObjectCB element some frame resource has not caught
+	// up with yet: exactly those with an ObjCBIndex and NumFramesDirty > 0.
+	std::vector<UINT> mDirtyRitems;
 
-	// Render items divided by PSO.
-	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
+	// World matrices of the render items.  The castle's items hang off mCastleNode,
+	// so moving that node moves the whole castle.
+	TransformHierarchy mTransforms;
+	UINT mCastleNode = TransformHierarchy::None;
+
+	// Render item handle of each transform node, or None for grouping nodes.
+	std::vector<UINT> mTransformRitems;
+
+	// Slots of the render items of each layer that passed frustum culling this frame.
+	std::vector<UINT> mVisibleRitems[(int)RenderLayer::Count];
+
+	// Press 'C' to toggle frustum culling.
+	bool mFrustumCullingEnabled = true;
+	UINT mVisibleRitemCount = 0;
+	UINT mCulledRitemCount = 0;
+
+	// Press 'O' to toggle sorting each layer by RenderItemStore::SortKeys.
+	bool mSortByKeyEnabled = true;
+
+	// Small per-geometry ids packed into the sort keys.
+	std::unordered_map<const MeshGeometry*, UINT> mGeoSortIds;
+
+	// Filled while recording the last frame, one entry per layer.
+	DrawStats mDrawStats[(int)RenderLayer::Count];
+
+	// Render items of each layer grouped for instanced drawing.
+	std::vector<InstanceBatch> mInstanceBatches[(int)RenderLayer::Count];
+	UINT mInstanceCount = 0;
+
+	// Press 'I' to switch between instanced batches and one draw per render item.
+	bool mInstancingEnabled = true;
+	bool mKeyWasDown[256] = {};
 
 	std::unique_ptr<Waves> mWaves;
+	std::unique_ptr<GpuWaves> mGpuWaves;
+
+	// GPU and CPU timings of every frame.  Press 'P' to show them as bars over the
+	// scene and in the window caption, and 'L' to start or stop logging them to
+	// Profile.csv.
+	std::unique_ptr<Profiler> mProfiler;
+	bool mShowProfilerOverlay = false;
+
+	// Set from the command line.  While enabled all input is ignored and the camera
+	// follows a scripted path.
+	BenchmarkSettings mBenchmark;
+
+	// Press 'F' to replace the hand placed tree sprites with a forest scattered,
+	// culled and drawn by the GPU through ExecuteIndirect.
+	std::unique_ptr<GpuForest> mGpuForest;
+	bool mGpuForestEnabled = false;
+
+	// Press 'N' for night: the ambient light dims and torches along the outer walls
+	// light up.  The torches are binned into clusters by mClusteredLights, so each
+	// pixel only evaluates the ones that reach it.  mTorches holds them in the
+	// castle's space, the point lights before the spot lights.
+	std::unique_ptr<ClusteredLights> mClusteredLights;
+	std::vector<Light> mTorches;
+	UINT mTorchPointLightCount = 0;
+	UINT mClusteredLightCount = 0;
+	bool mNightEnabled = false;
+
+	// Hills around the castle's lake, drawn as quadtree tiles picked every frame.
+	std::unique_ptr<Terrain> mTerrain;
+
+	// The castle, mapped from Scenes\Castle.scene until initialization is done.
+	std::unique_ptr<CompiledScene> mScene;
+
+	// Run the wave simulation in a compute shader and displace the water grid in the
+	// vertex shader.  When false, the CPU solver in Waves fills WavesVB every frame.
+	bool mUseGpuWaves = true;
+
+	// Press 'B' to toggle stepping the CPU waves on a background thread.
+	bool mBackgroundWaves = true;
 
     PassConstants mMainPassCB;
 
@@ -147,6 +526,12 @@ private:
 	XMFLOAT4X4 mView = MathHelper::Identity4x4();
 	XMFLOAT4X4 mProj = MathHelper::Identity4x4();
 
+	// Camera frustum in view space, rebuilt when the projection changes.
+	BoundingFrustum mCamFrustum;
+
+	// World space planes of mCamFrustum for the GPU forest's culling, facing outward.
+	XMFLOAT4 mWorldFrustumPlanes[6];
+
     float mTheta = 1.5f*XM_PI;
     float mPhi = XM_PIDIV2 - 0.1f;
     float mRadius = 75.0f;
@@ -162,28 +547,57 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
     _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 
+    BenchmarkSettings benchmark;
+
     try
     {
-        TreeBillboardsApp theApp(hInstance);
+        benchmark = ParseBenchmarkSettings(cmdLine);
+
+        FramePacingSettings framePacing = ParseFramePacingSettings(cmdLine);
+        gNumFrameResources = framePacing.FrameResourceCount;
+
+        TreeBillboardsApp theApp(hInstance, benchmark, framePacing);
         if(!theApp.Initialize())
             return 0;
 
-        return theApp.Run();
+        return benchmark.Enabled ? theApp.RunBenchmark() : theApp.Run();
     }
     catch(DxException& e)
     {
+        // Unattended runs must not block on a message box.
+        if(benchmark.Enabled)
+        {
+            OutputDebugString((e.ToString() + L"\n").c_str());
+            return 1;
+        }
+
         MessageBox(nullptr, e.ToString().c_str(), L"HR Failed", MB_OK);
         return 0;
     }
+    catch(std::exception& e)
+    {
+        OutputDebugStringA((std::string(e.what()) + "\n").c_str());
+        return 1;
+    }
 }
 
-TreeBillboardsApp::TreeBillboardsApp(HINSTANCE hInstance)
+TreeBillboardsApp::TreeBillboardsApp(HINSTANCE hInstance, const BenchmarkSettings& benchmark, const FramePacingSettings& framePacing)
     : D3DApp(hInstance)
 {
+	mBenchmark = benchmark;
+	mOffscreen = benchmark.Enabled && benchmark.Offscreen;
+
+	mSwapChainBufferCount = framePacing.BackBufferCount;
+	mMaxFrameLatency = framePacing.MaxFrameLatency;
+	mVsyncEnabled = framePacing.Vsync;
 }
 
 TreeBillboardsApp::~TreeBillboardsApp()
 {
+	// The workers use the device and the shader blobs.
+	mBackgroundPSOTasks.wait();
+	mShaderReloadTasks.wait();
+
     if(md3dDevice != nullptr)
         FlushCommandQueue();
 }
@@ -201,24 +615,77 @@ bool TreeBillboardsApp::Initialize()
     mCbvSrvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
     mWaves = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
+
+	// Same area as the CPU grid at four times the resolution per axis.
+	mGpuWaves = std::make_unique<GpuWaves>(md3dDevice.Get(), mCommandList.Get(),
+		512, 512, 0.25f, 0.03f, 4.0f, 0.2f);
+
+	// Covers the land around the castle grounds.
+	mGpuForest = std::make_unique<GpuForest>(md3dDevice.Get(), mCommandList.Get(),
+		32768, 38.0f, 26.0f, 0.1f, 2.0f, 5.0f);
+
+	mClusteredLights = std::make_unique<ClusteredLights>(md3dDevice.Get(),
+		gClusterCountX, gClusterCountY, gClusterCountZ, gMaxLightsPerCluster);
+
+	// A 4 km map with a height sample every 2 m.  Leaf tiles are 64 m across with
+	// a vertex every 2 m, and each level up doubles both.
+	const UINT terrainResolution = 2048;
+	const float terrainSize = 4096.0f;
+	const float terrainStep = terrainSize / terrainResolution;
+	std::vector<float> terrainHeights(terrainResolution*terrainResolution);
+	concurrency::parallel_for(UINT(0), terrainResolution, [&](UINT i)
+	{
+		float z = 0.5f*terrainSize - (i + 0.5f)*terrainStep;
+		for(UINT j = 0; j < terrainResolution; ++j)
+		{
+			float x = -0.5f*terrainSize + (j + 0.5f)*terrainStep;
+			terrainHeights[i*terrainResolution + j] = GetHillsHeight(x, z);
+		}
+	});
+
+	mTerrain = std::make_unique<Terrain>(md3dDevice.Get(), mCommandList.Get(),
+		terrainSize, terrainResolution, terrainHeights, 7, 33, 2.0f);
+
+	ComPtr<IDXGIAdapter3> adapter;
+	ThrowIfFailed(mdxgiFactory->EnumAdapterByLuid(md3dDevice->GetAdapterLuid(), IID_PPV_ARGS(&adapter)));
+
+	mTextureHeap = std::make_unique<TextureHeap>(md3dDevice.Get(), adapter.Get(), gTextureHeapByteSize);
+	mTextureStreamer = std::make_unique<TextureStreamer>(md3dDevice.Get(), mTextureHeap.get());
+
+	std::vector<std::string> gpuTimings = { "frame", "wavesSimulation", "forestCull", "lightCull" };
+	for(auto name : gLayerNames)
+		gpuTimings.push_back(name);
+
+	std::vector<std::string> cpuTimings = { "Update", "UpdateTransforms", "UpdateObjectCBs", "UpdateWaves", "DrawRenderItems", "DrawInstanceBatches" };
+
+	mProfiler = std::make_unique<Profiler>(md3dDevice.Get(), mCommandQueue.Get(), gNumFrameResources,
+		gpuTimings, cpuTimings);
+
+	mShaderCache = std::make_unique<ShaderCache>(L"ShaderCache");
+	mShaderPermutations = std::make_unique<ShaderPermutations>(mShaderCache.get());
+	mPipelineCache = std::make_unique<PipelineCache>(md3dDevice.Get(), L"ShaderCache\\Pipelines.bin");
  
 	LoadTextures();
     BuildRootSignature();
+	BuildWavesRootSignature();
+	BuildForestRootSignature();
+	BuildLightCullRootSignature();
+	BuildOverlayRootSignature();
 	BuildDescriptorHeaps();
     BuildShadersAndInputLayouts();
-    BuildLandGeometry();
-	BuildUnderLandGeometry();
+    BuildShapeGeometry();
     BuildWavesGeometry();
-	BuildBoxGeometry();
-	BuildPyramidGeometry();
-	BuildCylinderGeometry();
-	BuildConeGeometry();
-	BuildDiamondGeometry();
-	BuildWedgeGeometry();
+	BuildGpuWavesGeometry();
 	BuildTreeSpritesGeometry();
+	BuildTerrainGeometry();
 	BuildMaterials();
     BuildRenderItems();
+	BuildTorches();
+	BuildTransformHierarchy();
+	BuildRenderItemLods();
+	BuildInstanceBatches();
     BuildFrameResources();
+	BuildLayerCommandLists();
     BuildPSOs();
 
     // Execute the initialization commands.
@@ -229,6 +696,21 @@ bool TreeBillboardsApp::Initialize()
     // Wait until initialization is complete.
     FlushCommandQueue();
 
+	// The initialization copies are done, so the upload buffers can go.
+	mTextures["placeholderTex"]->UploadHeap = nullptr;
+	for(auto& geo : mGeometries)
+		geo.second->DisposeUploaders();
+	mTerrain->DisposeUploaders();
+	mScene = nullptr;
+
+	// Benchmark runs draw the same frames every time, so they never reload.
+	if(!mBenchmark.Enabled)
+	{
+		mFileWatcher = std::make_unique<FileWatcher>();
+		mFileWatcher->Watch(L"Shaders");
+		mFileWatcher->Watch(L"../../A2_Sarras_Asper/A2_Sarras_Asper/Textures");
+	}
+
     return true;
 }
  
@@ -239,6 +721,8 @@ void TreeBillboardsApp::OnResize()
     // The window resized, so update the aspect ratio and recompute the projection matrix.
     XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f*MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
     XMStoreFloat4x4(&mProj, P);
+
+	BoundingFrustum::CreateFromMatrix(mCamFrustum, P);
 }
 
 void TreeBillboardsApp::Update(const GameTimer& gt)
@@ -252,35 +736,79 @@ void TreeBillboardsApp::Update(const GameTimer& gt)
 
     // Has the GPU finished processing the commands of the current frame resource?
     // If not, wait until the GPU has completed commands up to this fence point.
-    if(mCurrFrameResource->Fence != 0 && mFence->GetCompletedValue() < mCurrFrameResource->Fence)
-    {
-        HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
-        ThrowIfFailed(mFence->SetEventOnCompletion(mCurrFrameResource->Fence, eventHandle));
-        WaitForSingleObject(eventHandle, INFINITE);
-        CloseHandle(eventHandle);
-    }
+    WaitForFence(mCurrFrameResource->Fence);
+
+	// The GPU is done with everything this frame resource allocated last time around.
+	mCurrFrameResource->FrameUpload->Reset();
 
+	// Includes the timings recorded with this frame resource last time.
+	mProfiler->BeginFrame(mCurrFrameResourceIndex);
+	Profiler::CpuScope updateScope(*mProfiler, (UINT)CpuTiming::Update);
+
+	UpdateTextureStreaming();
+	CollectBackgroundPSOs(false);
+	UpdateHotReload();
 	AnimateMaterials(gt);
+	UpdateTransforms(gt);
 	UpdateObjectCBs(gt);
-	UpdateMaterialCBs(gt);
+	UpdateMaterialBuffer(gt);
 	UpdateMainPassCB(gt);
-    UpdateWaves(gt);
+	UpdateClusteredLights(gt);
+	{
+		Profiler::CpuScope wavesScope(*mProfiler, (UINT)CpuTiming::UpdateWaves);
+		UpdateWaves(gt);
+	}
+	CullRenderItems(gt);
+	UpdateTextureResidency();
+	UpdateInstanceData(gt);
+	UpdateFrameStatsText();
 }
 
 void TreeBillboardsApp::Draw(const GameTimer& gt)
 {
     auto cmdListAlloc = mCurrFrameResource->CmdListAlloc;
 
+	// Look up every layer's PSO here, so the worker threads only read this table.
+	ID3D12PipelineState* layerPSOs[(int)RenderLayer::Count];
+	for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+		layerPSOs[layer] = GetLayerPSO((RenderLayer)layer);
+
+	// The overlay is left out until its background PSO is ready.
+	ID3D12PipelineState* overlayPSO = nullptr;
+	if(mShowProfilerOverlay && mPSOs.count("profilerOverlay"))
+		overlayPSO = mPSOs["profilerOverlay"].Get();
+
     // Reuse the memory associated with command recording.
     // We can only reset when the associated command lists have finished execution on the GPU.
     ThrowIfFailed(cmdListAlloc->Reset());
 
     // A command list can be reset after it has been added to the command queue via ExecuteCommandList.
     // Reusing the command list reuses memory.
-    ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
+    ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), layerPSOs[(int)gLayerDrawOrder[0]]));
+
+	for(auto& stats : mDrawStats)
+		stats = DrawStats();
 
-    mCommandList->RSSetViewports(1, &mScreenViewport);
-    mCommandList->RSSetScissorRects(1, &mScissorRect);
+	mProfiler->BeginGpuScope(mCommandList.Get(), (UINT)GpuTiming::Frame);
+
+	// Step the GPU wave simulation before any layer samples its displacement map.
+	mProfiler->BeginGpuScope(mCommandList.Get(), (UINT)GpuTiming::WavesSimulation);
+	if(mUseGpuWaves)
+		UpdateGpuWaves(gt);
+	mProfiler->EndGpuScope(mCommandList.Get(), (UINT)GpuTiming::WavesSimulation);
+
+	// Fill the forest's indirect arguments before the tree layer draws from them.
+	mProfiler->BeginGpuScope(mCommandList.Get(), (UINT)GpuTiming::ForestCull);
+	if(mGpuForestEnabled)
+		mGpuForest->Cull(mCommandList.Get(), mForestRootSignature.Get(), mPSOs["forestCull"].Get(), mWorldFrustumPlanes);
+	mProfiler->EndGpuScope(mCommandList.Get(), (UINT)GpuTiming::ForestCull);
+
+	// Bin the lights into clusters before any lit pixel reads them.
+	mProfiler->BeginGpuScope(mCommandList.Get(), (UINT)GpuTiming::LightCull);
+	mClusteredLights->Cull(mCommandList.Get(), mLightCullRootSignature.Get(), mPSOs["lightCull"].Get(),
+		mView, mProj, mMainPassCB.NearZ, mMainPassCB.FarZ,
+		mCurrFrameResource->LightBuffer->Resource()->GetGPUVirtualAddress(), mClusteredLightCount);
+	mProfiler->EndGpuScope(mCommandList.Get(), (UINT)GpuTiming::LightCull);
 
     // Indicate a state transition on the resource usage.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
@@ -290,42 +818,77 @@ void TreeBillboardsApp::Draw(const GameTimer& gt)
     mCommandList->ClearRenderTargetView(CurrentBackBufferView(), (float*)&mMainPassCB.FogColor, 0, nullptr);
     mCommandList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 
-    // Specify the buffers we are going to render to.
-    mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
+	const int layerCount = _countof(gLayerDrawOrder);
 
-	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
-	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+	if(mMultithreadedRecording)
+	{
+		// The main list only prepares the back buffer; each layer is recorded into
+		// its own command list on a worker thread.
+		ThrowIfFailed(mCommandList->Close());
 
-	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
+		concurrency::parallel_for(0, layerCount, [this, &layerPSOs, layerCount](int i)
+		{
+			RenderLayer layer = gLayerDrawOrder[i];
 
-	auto passCB = mCurrFrameResource->PassCB->Resource();
-	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
+			auto alloc = mCurrFrameResource->WorkerCmdListAllocs[i];
+			auto cmdList = mLayerCmdLists[i].Get();
 
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+			ThrowIfFailed(alloc->Reset());
+			ThrowIfFailed(cmdList->Reset(alloc.Get(), layerPSOs[(int)layer]));
 
-	mCommandList->SetPipelineState(mPSOs["alphaTested"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTested]);
+			// Command lists do not inherit state, so every list binds the frame state again.
+			SetFrameState(cmdList);
 
-	mCommandList->SetPipelineState(mPSOs["treeSprites"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites]);
+			mProfiler->BeginGpuScope(cmdList, LayerGpuTiming(layer));
+			DrawLayer(cmdList, layer);
+			mProfiler->EndGpuScope(cmdList, LayerGpuTiming(layer));
 
-	mCommandList->SetPipelineState(mPSOs["transparent"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Transparent]);
+			// The last list in submission order is finished below, once every worker
+			// is done with the frame's CPU timings.
+			if(i < layerCount - 1)
+				ThrowIfFailed(cmdList->Close());
+		});
 
-    // Indicate a state transition on the resource usage.
-	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+		EndFrameCommands(mLayerCmdLists[layerCount - 1].Get(), overlayPSO);
+		ThrowIfFailed(mLayerCmdLists[layerCount - 1]->Close());
 
-    // Done recording commands.
-    ThrowIfFailed(mCommandList->Close());
+		// Submit the prologue and all the layers together, in draw order.
+		ID3D12CommandList* cmdsLists[1 + layerCount] = { mCommandList.Get() };
+		for(int i = 0; i < layerCount; ++i)
+			cmdsLists[1 + i] = mLayerCmdLists[i].Get();
 
-    // Add the command list to the queue for execution.
-    ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
-    mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+		mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	}
+	else
+	{
+		SetFrameState(mCommandList.Get());
+
+		for(int i = 0; i < layerCount; ++i)
+		{
+			RenderLayer layer = gLayerDrawOrder[i];
+
+			// Empty layers are still timed, since every scope is resolved each frame.
+			mProfiler->BeginGpuScope(mCommandList.Get(), LayerGpuTiming(layer));
+			if(layerPSOs[(int)layer] != nullptr)
+			{
+				mCommandList->SetPipelineState(layerPSOs[(int)layer]);
+				DrawLayer(mCommandList.Get(), layer);
+			}
+			mProfiler->EndGpuScope(mCommandList.Get(), LayerGpuTiming(layer));
+		}
+
+		EndFrameCommands(mCommandList.Get(), overlayPSO);
+
+		// Done recording commands.
+		ThrowIfFailed(mCommandList->Close());
+
+		// Add the command list to the queue for execution.
+		ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
+		mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	}
 
     // Swap the back and front buffers
-    ThrowIfFailed(mSwapChain->Present(0, 0));
-	mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
+	PresentBackBuffer();
 
     // Advance the fence value to mark commands up to this fence point.
     mCurrFrameResource->Fence = ++mCurrentFence;
@@ -336,8 +899,340 @@ void TreeBillboardsApp::Draw(const GameTimer& gt)
     mCommandQueue->Signal(mFence.Get(), mCurrentFence);
 }
 
+void TreeBillboardsApp::EndFrameCommands(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* overlayPSO)
+{
+	if(overlayPSO != nullptr)
+		DrawProfilerOverlay(cmdList, overlayPSO);
+
+	mProfiler->EndGpuScope(cmdList, (UINT)GpuTiming::Frame);
+	mProfiler->EndFrame(cmdList);
+
+	// Indicate a state transition on the resource usage.
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
+		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+}
+
+void TreeBillboardsApp::DrawProfilerOverlay(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* pso)
+{
+	// One row per scope, GPU scopes first, in the order listed in the caption.  The dark
+	// bar behind each row is 16.6 ms, a frame at 60 Hz.
+	const float budgetMs = 1000.0f / 60.0f;
+	const float left = 10.0f;
+	const float budgetWidth = 300.0f;
+	const float rowHeight = 8.0f;
+	const float rowSpacing = 3.0f;
+
+	cmdList->SetPipelineState(pso);
+	cmdList->SetGraphicsRootSignature(mOverlayRootSignature.Get());
+	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+
+	auto drawBar = [this, cmdList](float x0, float y0, float x1, float y1, XMFLOAT4 color)
+	{
+		// Pixels to normalized device coordinates, y up.
+		float constants[8] =
+		{
+			2.0f*x0 / mClientWidth - 1.0f, 1.0f - 2.0f*y0 / mClientHeight,
+			2.0f*x1 / mClientWidth - 1.0f, 1.0f - 2.0f*y1 / mClientHeight,
+			color.x, color.y, color.z, color.w
+		};
+		cmdList->SetGraphicsRoot32BitConstants(0, 8, constants, 0);
+		cmdList->DrawInstanced(4, 1, 0, 0);
+	};
+
+	UINT rowCount = mProfiler->GpuScopeCount() + mProfiler->CpuScopeCount();
+	for(UINT row = 0; row < rowCount; ++row)
+	{
+		bool isGpu = row < mProfiler->GpuScopeCount();
+		float ms = isGpu ?
+			mProfiler->GpuMilliseconds(row) :
+			mProfiler->CpuMilliseconds(row - mProfiler->GpuScopeCount());
+
+		// A gap between the GPU and the CPU rows.
+		float top = 10.0f + row*(rowHeight + rowSpacing) + (isGpu ? 0.0f : rowHeight);
+		float bottom = top + rowHeight;
+
+		// Bars past the budget are clamped and turn red.
+		float width = budgetWidth*std::min<float>(ms / budgetMs, 1.0f);
+		XMFLOAT4 color = ms > budgetMs ? XMFLOAT4(1.0f, 0.2f, 0.2f, 0.9f) :
+			isGpu ? XMFLOAT4(0.3f, 0.9f, 0.3f, 0.9f) : XMFLOAT4(0.3f, 0.6f, 1.0f, 0.9f);
+
+		drawBar(left, top, left + budgetWidth, bottom, XMFLOAT4(0.0f, 0.0f, 0.0f, 0.5f));
+		drawBar(left, top, left + width, bottom, color);
+	}
+}
+
+void TreeBillboardsApp::SetFrameState(ID3D12GraphicsCommandList* cmdList)
+{
+    cmdList->RSSetViewports(1, &mScreenViewport);
+    cmdList->RSSetScissorRects(1, &mScissorRect);
+
+    // Specify the buffers we are going to render to.
+    cmdList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
+
+	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
+	cmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+
+	cmdList->SetGraphicsRootSignature(mRootSignature.Get());
+
+	auto passCB = mCurrFrameResource->PassCB->Resource();
+	cmdList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
+
+	// Every material lives in one buffer, so it is bound once and indexed per object.
+	auto matBuffer = mCurrFrameResource->MaterialBuffer->Resource();
+	cmdList->SetGraphicsRootShaderResourceView(3, matBuffer->GetGPUVirtualAddress());
+
+	// The whole texture range is bound once; shaders index it through MaterialData.
+	if(mBindlessEnabled)
+		cmdList->SetGraphicsRootDescriptorTable(6, mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+
+	// Only read by the clustered permutations, which may still be drawing for a
+	// few frames after night ends, so they are always bound.
+	auto lightBuffer = mCurrFrameResource->LightBuffer->Resource();
+	cmdList->SetGraphicsRootShaderResourceView(7, lightBuffer->GetGPUVirtualAddress());
+	cmdList->SetGraphicsRootShaderResourceView(8, mClusteredLights->LightCounts());
+	cmdList->SetGraphicsRootShaderResourceView(9, mClusteredLights->LightIndices());
+}
+
+void TreeBillboardsApp::DrawLayer(ID3D12GraphicsCommandList* cmdList, RenderLayer layer)
+{
+	if(layer == RenderLayer::GpuWaves)
+		cmdList->SetGraphicsRootDescriptorTable(5, mGpuWaves->DisplacementMap());
+
+	if(layer == RenderLayer::AlphaTestedTreeSprites && mGpuForestEnabled)
+	{
+		DrawForest(cmdList, mDrawStats[(int)layer]);
+		return;
+	}
+
+	if(layer == RenderLayer::Terrain)
+	{
+		cmdList->SetGraphicsRootDescriptorTable(5, mTerrain->HeightMap());
+		DrawTerrain(cmdList, LayerUsesBindless(layer), mDrawStats[(int)layer]);
+		return;
+	}
+
+	if(mInstancingEnabled && LayerSupportsInstancing(layer))
+		DrawInstanceBatches(cmdList, mInstanceBatches[(int)layer], LayerUsesBindless(layer), mDrawStats[(int)layer]);
+	else
+		DrawRenderItems(cmdList, mVisibleRitems[(int)layer], LayerUsesBindless(layer), mDrawStats[(int)layer]);
+}
+
+std::string TreeBillboardsApp::GetLayerPSOName(RenderLayer layer)const
+{
+	std::string name;
+	switch(layer)
+	{
+	case RenderLayer::Opaque:
+		name = mInstancingEnabled ? "opaqueInstanced" : "opaque";
+		break;
+	case RenderLayer::Transparent:
+		name = mInstancingEnabled ? "transparentInstanced" : "transparent";
+		break;
+	case RenderLayer::AlphaTested:
+		name = mInstancingEnabled ? "alphaTestedInstanced" : "alphaTested";
+		break;
+	case RenderLayer::AlphaTestedTreeSprites:
+		// The tree sprites sample a texture array, so they always bind their own table.
+		return mGpuForestEnabled ? "treeSpritesIndirect" : "treeSprites";
+	case RenderLayer::GpuWaves:
+		name = "wavesRender";
+		break;
+	case RenderLayer::CpuWaves:
+		name = "cpuWaves";
+		break;
+	case RenderLayer::Terrain:
+		name = "terrain";
+		break;
+	default:
+		return "";
+	}
+
+	if(mBindlessEnabled)
+		name += "Bindless";
+
+	return name;
+}
+
+void TreeBillboardsApp::DrawForest(ID3D12GraphicsCommandList* cmdList, DrawStats& stats)
+{
+	// The GPU culls the trees one by one, so only skip the draw when the whole
+	// forest is out of view.
+	UINT slot = mRitems->Slot(mTreeSpritesRitem);
+	if(!mRitems->Visible[slot])
+		return;
+
+	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
+
+	// No vertex or index buffers: the vertex shader builds the quads from the visible
+	// tree buffer.  The sprites' object constants still pick their material.
+	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	tex.Offset(mRitems->Materials[slot]->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+	cmdList->SetGraphicsRootDescriptorTable(0, tex);
+
+	cmdList->SetGraphicsRootConstantBufferView(1, objectCB->GetGPUVirtualAddress() + mRitems->ObjCBIndices[slot]*objCBByteSize);
+	cmdList->SetGraphicsRootShaderResourceView(4, mGpuForest->VisibleTrees());
+	stats.StateChanges += 4;
+
+	mGpuForest->Draw(cmdList);
+	stats.Draws++;
+}
+
+void TreeBillboardsApp::DrawTerrain(ID3D12GraphicsCommandList* cmdList, bool bindless, DrawStats& stats)
+{
+	const auto& tiles = mTerrain->Tiles();
+	UINT slot = mRitems->Slot(mTerrainRitem);
+	if(!mRitems->Visible[slot] || tiles.empty())
+		return;
+
+	// The tiles change every frame, so they go to the frame's transient upload heap.
+	UINT64 tilesByteSize = tiles.size()*sizeof(Terrain::Tile);
+	auto tileData = mCurrFrameResource->FrameUpload->Allocate(tilesByteSize, sizeof(Terrain::Tile));
+	memcpy(tileData.CPU, tiles.data(), tilesByteSize);
+
+	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
+	const RenderItemDrawArgs& args = mRitems->DrawArgs[slot];
+
+	// Every tile is an instance of the same mesh; the object constants describe the
+	// height map, and the tiles place each instance.
+	cmdList->IASetVertexBuffers(0, 1, &args.Geo->VertexBufferView());
+	cmdList->IASetIndexBuffer(&args.Geo->IndexBufferView());
+	cmdList->IASetPrimitiveTopology(args.PrimitiveType);
+	stats.StateChanges += 3;
+
+	if(!bindless)
+	{
+		CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+		tex.Offset(mRitems->Materials[slot]->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+		cmdList->SetGraphicsRootDescriptorTable(0, tex);
+		stats.StateChanges++;
+	}
+
+	cmdList->SetGraphicsRootConstantBufferView(1, objectCB->GetGPUVirtualAddress() + mRitems->ObjCBIndices[slot]*objCBByteSize);
+	cmdList->SetGraphicsRootShaderResourceView(4, tileData.GPU);
+	stats.StateChanges += 2;
+
+	cmdList->DrawIndexedInstanced(args.IndexCount, (UINT)tiles.size(), args.StartIndexLocation, args.BaseVertexLocation, 0);
+	stats.Draws++;
+}
+
+ID3D12PipelineState* TreeBillboardsApp::GetLayerPSO(RenderLayer layer)
+{
+	// A layer with nothing in it draws nothing, so it does not wait for its PSO.
+	if(mRitems->LayerSize((UINT)layer) == 0)
+		return nullptr;
+
+	std::string name = GetLayerPSOName(layer);
+	auto it = mPSOs.find(name);
+
+	// Toggled to a variant the workers have not finished yet.
+	if(it == mPSOs.end())
+	{
+		CollectBackgroundPSOs(true);
+		it = mPSOs.find(name);
+	}
+
+	return it->second.Get();
+}
+
+bool TreeBillboardsApp::LayerUsesBindless(RenderLayer layer)const
+{
+	return mBindlessEnabled && layer != RenderLayer::AlphaTestedTreeSprites;
+}
+
+int TreeBillboardsApp::RunBenchmark()
+{
+	// Let every texture stream in and every PSO compile first, so each run draws the
+	// same frames however long loading takes.
+	while(mTextureStreamer->PendingCount() > 0 || mPendingBackgroundPSOs > 0)
+	{
+		UpdateTextureStreaming();
+		CollectBackgroundPSOs(false);
+		Sleep(1);
+	}
+
+	mTimer.SetFixedDeltaTime(mBenchmark.DeltaTime);
+	mTimer.Reset();
+
+	std::vector<std::string> gpuScopes, cpuScopes;
+	for(UINT i = 0; i < mProfiler->GpuScopeCount(); ++i)
+		gpuScopes.push_back(mProfiler->GpuScopeName(i));
+	for(UINT i = 0; i < mProfiler->CpuScopeCount(); ++i)
+		cpuScopes.push_back(mProfiler->CpuScopeName(i));
+
+	BenchmarkRecorder recorder(gpuScopes, cpuScopes);
+
+	if(!mBenchmark.FrameLogFilename.empty())
+		mProfiler->StartCapture(mBenchmark.FrameLogFilename);
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	UINT64 readBackCount = mProfiler->ReadBackCount();
+	std::vector<float> gpuMilliseconds(gpuScopes.size());
+	std::vector<float> cpuMilliseconds(cpuScopes.size());
+
+	MSG msg = {0};
+	for(UINT frame = 0; frame < mBenchmark.FrameCount && msg.message != WM_QUIT; ++frame)
+	{
+		// Keep the window responsive, but never pause: the run is not driven by it.
+		while(PeekMessage(&msg, 0, 0, 0, PM_REMOVE))
+		{
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		}
+
+		WaitForNextFrame();
+
+		LARGE_INTEGER start, end;
+		QueryPerformanceCounter(&start);
+
+		mTimer.Tick();
+		Update(mTimer);
+		Draw(mTimer);
+
+		QueryPerformanceCounter(&end);
+
+		DrawStats total;
+		for(auto& stats : mDrawStats)
+		{
+			total.Draws += stats.Draws;
+			total.StateChanges += stats.StateChanges;
+		}
+
+		float frameMilliseconds = (float)(1000.0*(end.QuadPart - start.QuadPart) / frequency.QuadPart);
+		recorder.AddFrame(frameMilliseconds, total.Draws, total.StateChanges, mVisibleRitemCount);
+
+		// Update read back an earlier frame's timings.
+		if(mProfiler->ReadBackCount() != readBackCount)
+		{
+			readBackCount = mProfiler->ReadBackCount();
+
+			for(UINT i = 0; i < mProfiler->GpuScopeCount(); ++i)
+				gpuMilliseconds[i] = mProfiler->LatestGpuMilliseconds(i);
+			for(UINT i = 0; i < mProfiler->CpuScopeCount(); ++i)
+				cpuMilliseconds[i] = mProfiler->LatestCpuMilliseconds(i);
+
+			recorder.AddTimings(gpuMilliseconds, cpuMilliseconds);
+		}
+	}
+
+	FlushCommandQueue();
+	mProfiler->StopCapture();
+
+	recorder.Write(mBenchmark.ReportFilename, mBenchmark);
+
+	return msg.message == WM_QUIT ? (int)msg.wParam : 0;
+}
+
 void TreeBillboardsApp::OnMouseDown(WPARAM btnState, int x, int y)
 {
+	if(mBenchmark.Enabled)
+		return;
+
     mLastMousePos.x = x;
     mLastMousePos.y = y;
 
@@ -351,6 +1246,9 @@ void TreeBillboardsApp::OnMouseUp(WPARAM btnState, int x, int y)
 
 void TreeBillboardsApp::OnMouseMove(WPARAM btnState, int x, int y)
 {
+	if(mBenchmark.Enabled)
+		return;
+
     if((btnState & MK_LBUTTON) != 0)
     {
         // Make each pixel correspond to a quarter of a degree.
@@ -383,17 +1281,76 @@ void TreeBillboardsApp::OnMouseMove(WPARAM btnState, int x, int y)
  
 void TreeBillboardsApp::OnKeyboardInput(const GameTimer& gt)
 {
-}
- 
-void TreeBillboardsApp::UpdateCamera(const GameTimer& gt)
-{
-	// Convert Spherical to Cartesian coordinates.
-	mEyePos.x = mRadius*sinf(mPhi)*cosf(mTheta);
-	mEyePos.z = mRadius*sinf(mPhi)*sinf(mTheta);
-	mEyePos.y = mRadius*cosf(mPhi);
+	// Toggles would make benchmark runs differ.
+	if(mBenchmark.Enabled)
+		return;
 
-	// Build the view matrix.
-	XMVECTOR pos = XMVectorSet(mEyePos.x, mEyePos.y, mEyePos.z, 1.0f);
+	if(WasKeyPressed('I'))
+		mInstancingEnabled = !mInstancingEnabled;
+
+	if(WasKeyPressed('C'))
+		mFrustumCullingEnabled = !mFrustumCullingEnabled;
+
+	if(WasKeyPressed('M'))
+		mMultithreadedRecording = !mMultithreadedRecording;
+
+	if(WasKeyPressed('B'))
+		mBackgroundWaves = !mBackgroundWaves;
+
+	if(WasKeyPressed('O'))
+		mSortByKeyEnabled = !mSortByKeyEnabled;
+
+	if(WasKeyPressed('T'))
+		mBindlessEnabled = !mBindlessEnabled;
+
+	if(WasKeyPressed('F'))
+		mGpuForestEnabled = !mGpuForestEnabled;
+
+	if(WasKeyPressed('P'))
+		mShowProfilerOverlay = !mShowProfilerOverlay;
+
+	if(WasKeyPressed('N'))
+		mNightEnabled = !mNightEnabled;
+
+	if(WasKeyPressed('L'))
+	{
+		if(mProfiler->IsCapturing())
+			mProfiler->StopCapture();
+		else
+			mProfiler->StartCapture(L"Profile.csv");
+	}
+}
+
+bool TreeBillboardsApp::WasKeyPressed(int vkeyCode)
+{
+	// True only on the frame the key goes down, so toggles do not flip every frame.
+	bool isDown = d3dUtil::IsKeyDown(vkeyCode);
+	bool pressed = isDown && !mKeyWasDown[vkeyCode];
+	mKeyWasDown[vkeyCode] = isDown;
+
+	return pressed;
+}
+ 
+void TreeBillboardsApp::UpdateCamera(const GameTimer& gt)
+{
+	// The benchmark circles the scene once over the run, bobbing up and down and
+	// moving in and out so the view covers both close ups and the whole scene.
+	if(mBenchmark.Enabled)
+	{
+		float t = gt.TotalTime() / (mBenchmark.FrameCount*mBenchmark.DeltaTime);
+
+		mTheta = 1.5f*XM_PI + XM_2PI*t;
+		mPhi = 1.0f + 0.4f*sinf(2.0f*XM_2PI*t);
+		mRadius = 80.0f + 40.0f*cosf(3.0f*XM_2PI*t);
+	}
+
+	// Convert Spherical to Cartesian coordinates.
+	mEyePos.x = mRadius*sinf(mPhi)*cosf(mTheta);
+	mEyePos.z = mRadius*sinf(mPhi)*sinf(mTheta);
+	mEyePos.y = mRadius*cosf(mPhi);
+
+	// Build the view matrix.
+	XMVECTOR pos = XMVectorSet(mEyePos.x, mEyePos.y, mEyePos.z, 1.0f);
 	XMVECTOR target = XMVectorZero();
 	XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
 
@@ -427,47 +1384,93 @@ void TreeBillboardsApp::AnimateMaterials(const GameTimer& gt)
 
 void TreeBillboardsApp::UpdateObjectCBs(const GameTimer& gt)
 {
+	Profiler::CpuScope scope(*mProfiler, (UINT)CpuTiming::UpdateObjectCBs);
+
+	// Only the items whose constants have changed are listed.  This needs to be
+	// tracked per frame resource, so an item stays listed until every one has it.
 	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
-	for(auto& e : mAllRitems)
+	for(size_t i = 0; i < mDirtyRitems.size();)
 	{
-		// Only update the cbuffer data if the constants have changed.  
-		// This needs to be tracked per frame resource.
-		if(e->NumFramesDirty > 0)
+		UINT slot = mRitems->Slot(mDirtyRitems[i]);
+		currObjectCB->CopyData(mRitems->ObjCBIndices[slot], MakeObjectConstants(slot));
+
+		// Next FrameResource need to be updated too.
+		if(--mRitems->NumFramesDirty[slot] > 0)
 		{
-			XMMATRIX world = XMLoadFloat4x4(&e->World);
-			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+			++i;
+			continue;
+		}
+
+		mDirtyRitems[i] = mDirtyRitems.back();
+		mDirtyRitems.pop_back();
+	}
+}
 
-			ObjectConstants objConstants;
-			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
+void TreeBillboardsApp::MarkRitemDirty(UINT ritem)
+{
+	UINT slot = mRitems->Slot(ritem);
 
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+	// Transient items are written when they are drawn.
+	if(mRitems->ObjCBIndices[slot] == (UINT)-1)
+		return;
 
-			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;
-		}
+	if(mRitems->NumFramesDirty[slot] <= 0)
+		mDirtyRitems.push_back(ritem);
+	mRitems->NumFramesDirty[slot] = gNumFrameResources;
+}
+
+void TreeBillboardsApp::UpdateTransforms(const GameTimer& gt)
+{
+	Profiler::CpuScope scope(*mProfiler, (UINT)CpuTiming::UpdateTransforms);
+
+	mTransforms.Update();
+
+	for(UINT node : mTransforms.Changed())
+	{
+		UINT ritem = mTransformRitems[node];
+		if(ritem == RenderItemStore::None)
+			continue;
+
+		mRitems->Worlds[mRitems->Slot(ritem)] = mTransforms.World(node);
+		MarkRitemDirty(ritem);
 	}
 }
 
-void TreeBillboardsApp::UpdateMaterialCBs(const GameTimer& gt)
+ObjectConstants TreeBillboardsApp::MakeObjectConstants(UINT slot)const
 {
-	auto currMaterialCB = mCurrFrameResource->MaterialCB.get();
+	XMMATRIX world = XMLoadFloat4x4(&mRitems->Worlds[slot]);
+	XMMATRIX texTransform = XMLoadFloat4x4(&mRitems->TexTransforms[slot]);
+
+	ObjectConstants objConstants;
+	XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
+	XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
+	objConstants.DisplacementMapTexelSize = mRitems->DisplacementMapTexelSizes[slot];
+	objConstants.GridSpatialStep = mRitems->GridSpatialSteps[slot];
+	objConstants.MaterialIndex = mRitems->Materials[slot]->MatCBIndex;
+
+	return objConstants;
+}
+
+void TreeBillboardsApp::UpdateMaterialBuffer(const GameTimer& gt)
+{
+	auto currMaterialBuffer = mCurrFrameResource->MaterialBuffer.get();
 	for(auto& e : mMaterials)
 	{
-		// Only update the cbuffer data if the constants have changed.  If the cbuffer
+		// Only update the buffer data if the constants have changed.  If the buffer
 		// data changes, it needs to be updated for each FrameResource.
 		Material* mat = e.second.get();
 		if(mat->NumFramesDirty > 0)
 		{
 			XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
 
-			MaterialConstants matConstants;
-			matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
-			matConstants.FresnelR0 = mat->FresnelR0;
-			matConstants.Roughness = mat->Roughness;
-			XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
+			MaterialData matData;
+			matData.DiffuseAlbedo = mat->DiffuseAlbedo;
+			matData.FresnelR0 = mat->FresnelR0;
+			matData.Roughness = mat->Roughness;
+			XMStoreFloat4x4(&matData.MatTransform, XMMatrixTranspose(matTransform));
+			matData.DiffuseMapIndex = mat->DiffuseSrvHeapIndex;
 
-			currMaterialCB->CopyData(mat->MatCBIndex, matConstants);
+			currMaterialBuffer->CopyData(mat->MatCBIndex, matData);
 
 			// Next FrameResource need to be updated too.
 			mat->NumFramesDirty--;
@@ -498,16 +1501,42 @@ void TreeBillboardsApp::UpdateMainPassCB(const GameTimer& gt)
 	mMainPassCB.FarZ = 1000.0f;
 	mMainPassCB.TotalTime = gt.TotalTime();
 	mMainPassCB.DeltaTime = gt.DeltaTime();
-	mMainPassCB.AmbientLight = { 0.75f, 0.25f, 0.35f, 1.0f };
+	mMainPassCB.AmbientLight = mNightEnabled ? XMFLOAT4(0.08f, 0.05f, 0.12f, 1.0f) : XMFLOAT4(0.75f, 0.25f, 0.35f, 1.0f);
 	mMainPassCB.Lights[0].Direction = { 45.0f, 2.0f, 0.0f };
 	mMainPassCB.Lights[0].Strength = { 0.025f, 0.010f, 0.005f };
 
+	// The torches are binned into clusters rather than looped over from Lights.
+	mMainPassCB.ClusterCountX = mClusteredLights->ClusterCountX();
+	mMainPassCB.ClusterCountY = mClusteredLights->ClusterCountY();
+	mMainPassCB.ClusterCountZ = mClusteredLights->ClusterCountZ();
+	mMainPassCB.MaxLightsPerCluster = mClusteredLights->MaxLightsPerCluster();
+	mClusteredLights->GetDepthSliceParams(mMainPassCB.NearZ, mMainPassCB.FarZ,
+		mMainPassCB.ClusterDepthScale, mMainPassCB.ClusterDepthBias);
+	mMainPassCB.ClusteredPointLightCount = mTorchPointLightCount;
+
+	// The lit pixel shaders loop over exactly the lights filled in above.
+	ShaderPermutation permutation;
+	permutation.DirLights = 1;
+	permutation.PointLights = 0;
+	permutation.SpotLights = 0;
+	permutation.Fog = mFogEnabled;
+	permutation.Clustered = mNightEnabled;
+	if(permutation != mPassPermutation)
+	{
+		mPassPermutation = permutation;
+		mPermutationChanged = true;
+	}
+
 	auto currPassCB = mCurrFrameResource->PassCB.get();
 	currPassCB->CopyData(0, mMainPassCB);
 }
 
 void TreeBillboardsApp::UpdateWaves(const GameTimer& gt)
 {
+	// The GPU solver is stepped from Draw, on the command list.
+	if(mUseGpuWaves)
+		return;
+
 	// Every quarter second, generate a random wave.
 	//static float t_base = 0.0f;
 	//if((mTimer.TotalTime() - t_base) >= 0.25f)
@@ -522,100 +1551,404 @@ void TreeBillboardsApp::UpdateWaves(const GameTimer& gt)
 	//	mWaves->Disturb(i, j, r);
 	//}
 
+	// Update the wave simulation.  In the background mode the solution read below
+	// is the one finished during the previous frame, and the next one is computed
+	// while this frame is recorded.
+	if(mBackgroundWaves)
+		mWaves->UpdateAsync(gt.DeltaTime());
+	else
+		mWaves->Update(gt.DeltaTime());
+
+	// Update the wave vertex buffer with the new solution.  The tex-coords are in
+	// a static stream, so only positions and normals are written, straight into
+	// the mapped upload memory.
+	auto currWavesVB = mCurrFrameResource->WavesVB.get();
+	mWaves->WriteVertices(currWavesVB->MappedData(), sizeof(WaveVertex));
+
+	//Set the dynamic VB of the wave renderitem to the current frame VB.
+	mRitems->DrawArgs[mRitems->Slot(mWavesRitem)].Geo->VertexBufferGPU = currWavesVB->Resource();
+}
+
+void TreeBillboardsApp::UpdateGpuWaves(const GameTimer& gt)
+{
+	// The compute root signature binds tables from the SRV/UAV heap.
+	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
+	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+
+	// Every quarter second, generate a random wave.
+	//static float t_base = 0.0f;
+	//if((mTimer.TotalTime() - t_base) >= 0.25f)
+	//{
+	//	t_base += 0.25f;
+
+	//	int i = MathHelper::Rand(4, mGpuWaves->RowCount() - 5);
+	//	int j = MathHelper::Rand(4, mGpuWaves->ColumnCount() - 5);
+
+	//	float r = MathHelper::RandF(1.0f, 2.0f);
+
+	//	mGpuWaves->Disturb(mCommandList.Get(), mWavesRootSignature.Get(), mPSOs["wavesDisturb"].Get(), i, j, r);
+	//}
+
 	// Update the wave simulation.
-	mWaves->Update(gt.DeltaTime());
+	mGpuWaves->Update(gt.DeltaTime(), mCommandList.Get(), mWavesRootSignature.Get(), mPSOs["wavesUpdate"].Get());
+}
 
-	// Update the wave vertex buffer with the new solution.
-	auto currWavesVB = mCurrFrameResource->WavesVB.get();
-	for(int i = 0; i < mWaves->VertexCount(); ++i)
+void TreeBillboardsApp::UpdateInstanceData(const GameTimer& gt)
+{
+	if(!mInstancingEnabled)
+		return;
+
+	// The instance buffer is rewritten every frame, so unlike the object
+	// cbuffers there is no dirty tracking here.
+	auto currInstanceBuffer = mCurrFrameResource->InstanceBuffer.get();
+	for(auto& layer : mInstanceBatches)
 	{
-		Vertex v;
+		for(auto& batch : layer)
+		{
+			batch.InstanceCount = 0;
+			for(UINT ritem : batch.Ritems)
+			{
+				UINT slot = mRitems->Slot(ritem);
+				if(!mRitems->Visible[slot] || mRitems->LodIndices[slot] != batch.Lod)
+					continue;
+
+				XMMATRIX world = XMLoadFloat4x4(&mRitems->Worlds[slot]);
+				XMMATRIX texTransform = XMLoadFloat4x4(&mRitems->TexTransforms[slot]);
+
+				InstanceData data;
+				XMStoreFloat4x4(&data.World, XMMatrixTranspose(world));
+				XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(texTransform));
+				data.MaterialIndex = mRitems->Materials[slot]->MatCBIndex;
+
+				currInstanceBuffer->CopyData(batch.InstanceOffset + batch.InstanceCount, data);
+				batch.InstanceCount++;
+			}
+		}
+	}
+}
 
-		v.Pos = mWaves->Position(i);
-		v.Normal = mWaves->Normal(i);
-		
-		// Derive tex-coords from position by 
-		// mapping [-w/2,w/2] --> [0,1]
-		v.TexC.x = 0.5f + v.Pos.x / mWaves->Width();
-		v.TexC.y = 0.5f - v.Pos.z / mWaves->Depth();
+void TreeBillboardsApp::UpdateClusteredLights(const GameTimer& gt)
+{
+	mClusteredLightCount = mNightEnabled ? (UINT)mTorches.size() : 0;
 
-		currWavesVB->CopyData(i, v);
+	// The torches follow the castle and flicker, each out of step with the others.
+	XMMATRIX castleWorld = XMLoadFloat4x4(&mTransforms.World(mCastleNode));
+	const float t = gt.TotalTime();
+
+	auto currLightBuffer = mCurrFrameResource->LightBuffer.get();
+	for(UINT i = 0; i < mClusteredLightCount; ++i)
+	{
+		Light light = mTorches[i];
+
+		XMStoreFloat3(&light.Position, XMVector3TransformCoord(XMLoadFloat3(&light.Position), castleWorld));
+		XMStoreFloat3(&light.Direction, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&light.Direction), castleWorld)));
+
+		float flicker = 0.85f + 0.15f*sinf(11.0f*t + 1.7f*i)*sinf(7.3f*t + 0.9f*i);
+		light.Strength.x *= flicker;
+		light.Strength.y *= flicker;
+		light.Strength.z *= flicker;
+
+		currLightBuffer->CopyData(i, light);
 	}
+}
 
-	//Set the dynamic VB of the wave renderitem to the current frame VB.
-	mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
+void TreeBillboardsApp::CullRenderItems(const GameTimer& gt)
+{
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+
+	// Bring the frustum to world space once, then test each item's world space bounds.
+	BoundingFrustum worldFrustum;
+	mCamFrustum.Transform(worldFrustum, invView);
+
+	mTerrain->Select(mEyePos, worldFrustum, mFrustumCullingEnabled);
+
+	XMVECTOR planes[6];
+	worldFrustum.GetPlanes(&planes[0], &planes[1], &planes[2], &planes[3], &planes[4], &planes[5]);
+	for(int i = 0; i < 6; ++i)
+	{
+		// A plane every point is behind keeps the whole forest when culling is off.
+		if(mFrustumCullingEnabled)
+			XMStoreFloat4(&mWorldFrustumPlanes[i], planes[i]);
+		else
+			mWorldFrustumPlanes[i] = XMFLOAT4(0.0f, 0.0f, 0.0f, -1.0f);
+	}
+
+	mVisibleRitemCount = 0;
+	mCulledRitemCount = 0;
+
+	for(auto& visibleRitems : mVisibleRitems)
+		visibleRitems.clear();
+
+	// One pass over the packed arrays, in slot order, dealing the visible items out
+	// to their layers.
+	const UINT ritemCount = mRitems->Count();
+	for(UINT slot = 0; slot < ritemCount; ++slot)
+	{
+		UINT layer = mRitems->Layers[slot];
+		if(layer == (UINT)RenderLayer::Count)
+			continue;
+
+		XMMATRIX world = XMLoadFloat4x4(&mRitems->Worlds[slot]);
+
+		BoundingBox worldBounds;
+		mRitems->Bounds[slot].Transform(worldBounds, world);
+
+		bool visible = true;
+		if(mFrustumCullingEnabled)
+			visible = worldFrustum.Contains(worldBounds) != DirectX::DISJOINT;
+		mRitems->Visible[slot] = visible;
+
+		if(visible)
+		{
+			if(!mRitems->Lods[slot].empty())
+				SelectLod(slot, worldBounds);
+
+			// Camera space depth of the bounds center.
+			float viewDepth = XMVectorGetZ(XMVector3TransformCoord(XMLoadFloat3(&worldBounds.Center), view));
+			mRitems->SortKeys[slot] = MakeSortKey((RenderLayer)layer, slot, viewDepth);
+
+			mVisibleRitems[layer].push_back(slot);
+			mVisibleRitemCount++;
+		}
+		else
+		{
+			mCulledRitemCount++;
+		}
+	}
+
+	if(mSortByKeyEnabled)
+	{
+		const UINT64* sortKeys = mRitems->SortKeys.data();
+		for(auto& visibleRitems : mVisibleRitems)
+		{
+			std::sort(visibleRitems.begin(), visibleRitems.end(), [sortKeys](UINT a, UINT b)
+			{
+				return sortKeys[a] < sortKeys[b];
+			});
+		}
+	}
+}
+
+void TreeBillboardsApp::SelectLod(UINT slot, const BoundingBox& worldBounds)
+{
+	// Projected height in pixels of the sphere around the bounds; mProj(1, 1) is
+	// 1 / tan(fovY / 2).  From inside the sphere the item is as large as it gets.
+	float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&worldBounds.Extents)));
+	float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&worldBounds.Center) - XMLoadFloat3(&mEyePos)));
+	float screenHeight = distance > radius ? mClientHeight*mProj(1, 1)*radius / distance : FLT_MAX;
+
+	const auto& lods = mRitems->Lods[slot];
+	UINT lod = 0;
+	while(lod + 1 < lods.size() && screenHeight < gLodScreenHeights[lod])
+		++lod;
+
+	// Bounds stay those of the finest level, which encloses the others.
+	const SubmeshGeometry* submesh = lods[lod];
+	RenderItemDrawArgs& args = mRitems->DrawArgs[slot];
+	mRitems->LodIndices[slot] = lod;
+	args.IndexCount = submesh->IndexCount;
+	args.StartIndexLocation = submesh->StartIndexLocation;
+	args.BaseVertexLocation = submesh->BaseVertexLocation;
+}
+
+UINT64 TreeBillboardsApp::MakeSortKey(RenderLayer layer, UINT slot, float viewDepth)const
+{
+	// Quantize the depth over [0, far] to 24 bits.
+	float depth01 = MathHelper::Clamp(viewDepth / mMainPassCB.FarZ, 0.0f, 1.0f);
+	UINT64 depth = (UINT64)(depth01 * 0xFFFFFF);
+
+	UINT64 pso = (UINT64)layer & 0xFF;
+	UINT64 mat = (UINT64)mRitems->Materials[slot]->MatCBIndex & 0xFFFF;
+	UINT64 geo = (UINT64)mGeoSortIds.at(mRitems->DrawArgs[slot].Geo) & 0xFFFF;
+
+	// Blended layers must go back to front, so depth (inverted) comes right after
+	// the PSO.  Everything else groups by state first, then goes front to back.
+	//
+	//   blended: | pso 8 | far-to-near depth 24 | material 16 | geometry 16 |
+	//   other:   | pso 8 | material 16 | geometry 16 | near-to-far depth 24 |
+	if(LayerIsBlended(layer))
+		return (pso << 56) | ((0xFFFFFF - depth) << 32) | (mat << 16) | geo;
+
+	return (pso << 56) | (mat << 40) | (geo << 24) | depth;
+}
+
+void TreeBillboardsApp::UpdateFrameStatsText()
+{
+	// Counters from the frame recorded last, all layers together.
+	DrawStats total;
+	for(auto& stats : mDrawStats)
+	{
+		total.Draws += stats.Draws;
+		total.StateChanges += stats.StateChanges;
+		total.StateChangesSkipped += stats.StateChangesSkipped;
+	}
+
+	mFrameStatsText =
+		L"   visible: " + std::to_wstring(mVisibleRitemCount) +
+		L"   culled: " + std::to_wstring(mCulledRitemCount) +
+		L"   draws: " + std::to_wstring(total.Draws) +
+		L"   state sets: " + std::to_wstring(total.StateChanges) +
+		L"   skipped: " + std::to_wstring(total.StateChangesSkipped);
+
+	mFrameStatsText +=
+		L"   vram: " + std::to_wstring(mTextureHeap->CurrentUsage() >> 20) +
+		L"/" + std::to_wstring(mTextureHeap->Budget() >> 20) + L" MB" +
+		L"   evicted: " + std::to_wstring(mTextureHeap->EvictedHeapCount());
+
+	if(mTextureStreamer->PendingCount() > 0)
+		mFrameStatsText += L"   streaming: " + std::to_wstring(mTextureStreamer->PendingCount());
+
+	if(mClusteredLightCount > 0)
+		mFrameStatsText += L"   lights: " + std::to_wstring(mClusteredLightCount);
+
+	// Labels for the overlay's bars, top to bottom.
+	if(mShowProfilerOverlay)
+	{
+		wchar_t ms[16];
+
+		mFrameStatsText += L"   gpu ms:";
+		for(UINT i = 0; i < mProfiler->GpuScopeCount(); ++i)
+		{
+			swprintf_s(ms, L"%.2f", mProfiler->GpuMilliseconds(i));
+			mFrameStatsText += L" " + AnsiToWString(mProfiler->GpuScopeName(i)) + L" " + ms;
+		}
+
+		mFrameStatsText += L"   cpu ms:";
+		for(UINT i = 0; i < mProfiler->CpuScopeCount(); ++i)
+		{
+			swprintf_s(ms, L"%.2f", mProfiler->CpuMilliseconds(i));
+			mFrameStatsText += L" " + AnsiToWString(mProfiler->CpuScopeName(i)) + L" " + ms;
+		}
+	}
+
+	if(mProfiler->IsCapturing())
+		mFrameStatsText += L"   logging to Profile.csv";
 }
 
 void TreeBillboardsApp::LoadTextures()
 {
-	auto grassTex = std::make_unique<Texture>();
-	grassTex->Name = "grassTex";
-	//grassTex->Filename = L"../../Textures/grass.dds";
-	grassTex->Filename = L"../../A2_Sarras_Asper/A2_Sarras_Asper/Textures/grass.dds";
+	// The placeholder is a single texel, so it is still loaded up front on the main
+	// command list.  Everything else is handed to the streamer.
+	auto placeholderTex = std::make_unique<Texture>();
+	placeholderTex->Name = "placeholderTex";
+	placeholderTex->Filename = L"../../A2_Sarras_Asper/A2_Sarras_Asper/Textures/white1x1.dds";
 	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), grassTex->Filename.c_str(),
-		grassTex->Resource, grassTex->UploadHeap));
+		mCommandList.Get(), placeholderTex->Filename.c_str(),
+		placeholderTex->Resource, placeholderTex->UploadHeap));
 
-	auto waterTex = std::make_unique<Texture>();
-	waterTex->Name = "waterTex";
-	waterTex->Filename = L"../../A2_Sarras_Asper/A2_Sarras_Asper/Textures/water1.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), waterTex->Filename.c_str(),
-		waterTex->Resource, waterTex->UploadHeap));
+	mTextures[placeholderTex->Name] = std::move(placeholderTex);
 
-	auto fenceTex = std::make_unique<Texture>();
-	fenceTex->Name = "fenceTex";
-	fenceTex->Filename = L"../../A2_Sarras_Asper/A2_Sarras_Asper/Textures/bricks3.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), fenceTex->Filename.c_str(),
-		fenceTex->Resource, fenceTex->UploadHeap));
+	mStreamedTextures =
+	{
+		{ "grassTex", L"../../A2_Sarras_Asper/A2_Sarras_Asper/Textures/grass.dds", 0, false },
+		{ "waterTex", L"../../A2_Sarras_Asper/A2_Sarras_Asper/Textures/water1.dds", 1, false },
+		{ "fenceTex", L"../../A2_Sarras_Asper/A2_Sarras_Asper/Textures/bricks3.dds", 2, false },
+		//Walls
+		{ "castleTex", L"../../A2_Sarras_Asper/A2_Sarras_Asper/Textures/bricks.dds", 3, false },
+		{ "dirtTex", L"../../A2_Sarras_Asper/A2_Sarras_Asper/Textures/dirt.dds", 4, false },
+		{ "windowTex", L"../../A2_Sarras_Asper/A2_Sarras_Asper/Textures/window.dds", 5, false },
+		//Castle
+		{ "castle2Tex", L"../../A2_Sarras_Asper/A2_Sarras_Asper/Textures/Castle.dds", 6, false },
+		{ "treeArrayTex", L"../../A2_Sarras_Asper/A2_Sarras_Asper/Textures/treeArray.dds", 7, true },
+	};
 
-	auto treeArrayTex = std::make_unique<Texture>();
-	treeArrayTex->Name = "treeArrayTex";
-	treeArrayTex->Filename = L"../../A2_Sarras_Asper/A2_Sarras_Asper/Textures/treeArray.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), treeArrayTex->Filename.c_str(),
-		treeArrayTex->Resource, treeArrayTex->UploadHeap));
+	mTextureDescriptorCount = (UINT)mStreamedTextures.size() + 2;
 
-	//Walls
-	auto castleTex = std::make_unique<Texture>();
-	castleTex->Name = "castleTex";
-	castleTex->Filename = L"../../A2_Sarras_Asper/A2_Sarras_Asper/Textures/bricks.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), castleTex->Filename.c_str(),
-		castleTex->Resource, castleTex->UploadHeap));
+	for(size_t i = 0; i < mStreamedTextures.size(); ++i)
+	{
+		// UpdateTextureResidency finds a material's texture by its heap slot.
+		assert(mStreamedTextures[i].SrvHeapIndex == i);
+		mTextureStreamer->Request(mStreamedTextures[i].Name, mStreamedTextures[i].Filename);
+	}
+}
 
-	auto dirtTex = std::make_unique<Texture>();
-	dirtTex->Name = "dirtTex";
-	dirtTex->Filename = L"../../A2_Sarras_Asper/A2_Sarras_Asper/Textures/dirt.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), dirtTex->Filename.c_str(),
-		dirtTex->Resource, dirtTex->UploadHeap));
+void TreeBillboardsApp::CreateTextureSrv(const Texture& tex, UINT heapIndex, bool isArray)
+{
+	auto desc = tex.Resource->GetDesc();
 
-	auto windowTex = std::make_unique<Texture>();
-	windowTex->Name = "windowTex";
-	windowTex->Filename = L"../../A2_Sarras_Asper/A2_Sarras_Asper/Textures/window.dds";
-	//castleTex->Filename = L"../../Textures/WireFence.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), windowTex->Filename.c_str(),
-		windowTex->Resource, windowTex->UploadHeap));
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = desc.Format;
+	if(isArray)
+	{
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+		srvDesc.Texture2DArray.MostDetailedMip = 0;
+		srvDesc.Texture2DArray.MipLevels = -1;
+		srvDesc.Texture2DArray.FirstArraySlice = 0;
+		srvDesc.Texture2DArray.ArraySize = desc.DepthOrArraySize;
+	}
+	else
+	{
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MostDetailedMip = 0;
+		srvDesc.Texture2D.MipLevels = -1;
+	}
 
-	//Castle
-	auto castle2Tex = std::make_unique<Texture>();
-	castle2Tex->Name = "castle2Tex";
-	castle2Tex->Filename = L"../../A2_Sarras_Asper/A2_Sarras_Asper/Textures/Castle.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), castle2Tex->Filename.c_str(),
-		castle2Tex->Resource, castle2Tex->UploadHeap));
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+	hDescriptor.Offset(heapIndex, mCbvSrvDescriptorSize);
+	md3dDevice->CreateShaderResourceView(tex.Resource.Get(), &srvDesc, hDescriptor);
+}
 
-	mTextures[grassTex->Name] = std::move(grassTex);
-	mTextures[waterTex->Name] = std::move(waterTex);
-	mTextures[fenceTex->Name] = std::move(fenceTex);
-	mTextures[treeArrayTex->Name] = std::move(treeArrayTex);
-	mTextures[castleTex->Name] = std::move(castleTex);
-	mTextures[dirtTex->Name] = std::move(dirtTex);
-	mTextures[windowTex->Name] = std::move(windowTex);
-	mTextures[castle2Tex->Name] = std::move(castle2Tex);
+void TreeBillboardsApp::UpdateTextureStreaming()
+{
+	std::vector<std::unique_ptr<Texture>> resident;
+	mTextureStreamer->Poll(resident);
+
+	for(auto& tex : resident)
+	{
+		auto streamed = std::find_if(mStreamedTextures.begin(), mStreamedTextures.end(),
+			[&tex](const StreamedTexture& t) { return t.Name == tex->Name; });
+		assert(streamed != mStreamedTextures.end());
+
+		// A reloaded texture replaces one that frames in flight may be sampling
+		// through the same descriptor.  Edits are rare enough to simply let the GPU
+		// catch up first.  Then the old texture's heap space is handed back, and the
+		// resource goes when its entry in mTextures is replaced.
+		if(streamed->Resource != nullptr)
+		{
+			FlushCommandQueue();
+			mTextureHeap->Release(streamed->Resource);
+		}
+
+		// On a first load no material indexes this slot yet, so while frames in flight may have it bound
+		// as part of the bindless table they never read it, and it can be written now.
+		// Only afterwards do the materials switch over to it.
+		CreateTextureSrv(*tex, streamed->SrvHeapIndex, streamed->IsArray);
+		streamed->Resource = tex->Resource.Get();
+
+		for(auto it = mMaterialsAwaitingTextures.begin(); it != mMaterialsAwaitingTextures.end();)
+		{
+			if(it->second == streamed->SrvHeapIndex)
+			{
+				it->first->DiffuseSrvHeapIndex = it->second;
+				it->first->NumFramesDirty = gNumFrameResources;
+				it = mMaterialsAwaitingTextures.erase(it);
+			}
+			else
+				++it;
+		}
+
+		mTextures[tex->Name] = std::move(tex);
+	}
+}
+
+void TreeBillboardsApp::UpdateTextureResidency()
+{
+	// Frames are numbered by the fence value they will signal.
+	const UINT64 frame = mCurrentFence + 1;
+
+	for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		for(UINT slot : mVisibleRitems[layer])
+		{
+			UINT srvIndex = (UINT)mRitems->Materials[slot]->DiffuseSrvHeapIndex;
+			if(srvIndex < mStreamedTextures.size() && mStreamedTextures[srvIndex].Resource != nullptr)
+				mTextureHeap->MarkUsed(mStreamedTextures[srvIndex].Resource, frame);
+		}
+	}
+
+	mTextureHeap->UpdateResidency(frame, mFence->GetCompletedValue());
 }
 
 void TreeBillboardsApp::BuildRootSignature()
@@ -623,19 +1956,34 @@ void TreeBillboardsApp::BuildRootSignature()
 	CD3DX12_DESCRIPTOR_RANGE texTable;
 	texTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
 
+	CD3DX12_DESCRIPTOR_RANGE displacementMapTable;
+	displacementMapTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 1);
+
+	// Every texture slot at once, for the bindless PSOs.
+	CD3DX12_DESCRIPTOR_RANGE bindlessTexTable;
+	bindlessTexTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, mTextureDescriptorCount, 0, 2);
+
     // Root parameter can be a table, root descriptor or root constants.
-    CD3DX12_ROOT_PARAMETER slotRootParameter[4];
+    CD3DX12_ROOT_PARAMETER slotRootParameter[10];
 
 	// Perfomance TIP: Order from most frequent to least frequent.
 	slotRootParameter[0].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
     slotRootParameter[1].InitAsConstantBufferView(0);
     slotRootParameter[2].InitAsConstantBufferView(1);
-    slotRootParameter[3].InitAsConstantBufferView(2);
+    slotRootParameter[3].InitAsShaderResourceView(1, 1);
+	slotRootParameter[4].InitAsShaderResourceView(0, 1, D3D12_SHADER_VISIBILITY_VERTEX);
+	slotRootParameter[5].InitAsDescriptorTable(1, &displacementMapTable, D3D12_SHADER_VISIBILITY_VERTEX);
+	slotRootParameter[6].InitAsDescriptorTable(1, &bindlessTexTable, D3D12_SHADER_VISIBILITY_PIXEL);
+
+	// The clustered lights, the light count of each cluster and their light indices.
+	slotRootParameter[7].InitAsShaderResourceView(0, 3, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[8].InitAsShaderResourceView(1, 3, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[9].InitAsShaderResourceView(2, 3, D3D12_SHADER_VISIBILITY_PIXEL);
 
 	auto staticSamplers = GetStaticSamplers();
 
     // A root signature is an array of root parameters.
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(10, slotRootParameter,
 		(UINT)staticSamplers.size(), staticSamplers.data(),
 		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
@@ -658,252 +2006,274 @@ void TreeBillboardsApp::BuildRootSignature()
         IID_PPV_ARGS(mRootSignature.GetAddressOf())));
 }
 
-void TreeBillboardsApp::BuildDescriptorHeaps()
+void TreeBillboardsApp::BuildWavesRootSignature()
 {
-	//
-	// Create the SRV heap.
-	//
-	D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
-	srvHeapDesc.NumDescriptors = 7;
-	srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&mSrvDescriptorHeap)));
-
-	//
-	// Fill out the heap with actual descriptors.
-	//
-	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
-
-	auto grassTex = mTextures["grassTex"]->Resource;
-	auto waterTex = mTextures["waterTex"]->Resource;
-	auto fenceTex = mTextures["fenceTex"]->Resource;
-	auto treeArrayTex = mTextures["treeArrayTex"]->Resource;
-	auto castleTex = mTextures["castleTex"]->Resource;
-	auto dirtTex = mTextures["dirtTex"]->Resource;
-	auto windowTex = mTextures["windowTex"]->Resource;
-	auto castle2Tex = mTextures["castle2Tex"]->Resource;
-
-	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-	srvDesc.Format = grassTex->GetDesc().Format;
-	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Texture2D.MostDetailedMip = 0;
-	srvDesc.Texture2D.MipLevels = -1;
-	md3dDevice->CreateShaderResourceView(grassTex.Get(), &srvDesc, hDescriptor);
-
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	CD3DX12_DESCRIPTOR_RANGE uavTable0;
+	uavTable0.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
 
-	srvDesc.Format = waterTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(waterTex.Get(), &srvDesc, hDescriptor);
+	CD3DX12_DESCRIPTOR_RANGE uavTable1;
+	uavTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 1);
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	CD3DX12_DESCRIPTOR_RANGE uavTable2;
+	uavTable2.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 2);
 
-	srvDesc.Format = fenceTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(fenceTex.Get(), &srvDesc, hDescriptor);
+	// Root parameter can be a table, root descriptor or root constants.
+	CD3DX12_ROOT_PARAMETER slotRootParameter[4];
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-
-	srvDesc.Format = castleTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(castleTex.Get(), &srvDesc, hDescriptor);
+	// Perfomance TIP: Order from most frequent to least frequent.
+	slotRootParameter[0].InitAsConstants(6, 0);
+	slotRootParameter[1].InitAsDescriptorTable(1, &uavTable0);
+	slotRootParameter[2].InitAsDescriptorTable(1, &uavTable1);
+	slotRootParameter[3].InitAsDescriptorTable(1, &uavTable2);
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	// A root signature is an array of root parameters.
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
+		0, nullptr,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
-	srvDesc.Format = dirtTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(dirtTex.Get(), &srvDesc, hDescriptor);
+	// create a root signature with a single slot which points to a descriptor range consisting of a single constant buffer
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	if(errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	}
+	ThrowIfFailed(hr);
 
-	srvDesc.Format = windowTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(windowTex.Get(), &srvDesc, hDescriptor);
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mWavesRootSignature.GetAddressOf())));
+}
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+void TreeBillboardsApp::BuildForestRootSignature()
+{
+	// Root parameter can be a table, root descriptor or root constants.
+	CD3DX12_ROOT_PARAMETER slotRootParameter[3];
 
-	srvDesc.Format = castle2Tex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(castle2Tex.Get(), &srvDesc, hDescriptor);
+	// Both outputs are plain buffers, so root UAVs do without descriptors.
+	slotRootParameter[0].InitAsConstants(GpuForest::RootConstantCount(), 0);
+	slotRootParameter[1].InitAsUnorderedAccessView(0);
+	slotRootParameter[2].InitAsUnorderedAccessView(1);
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	// A root signature is an array of root parameters.
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(3, slotRootParameter,
+		0, nullptr,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
-	auto desc = treeArrayTex->GetDesc();
-	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
-	srvDesc.Format = treeArrayTex->GetDesc().Format;
-	srvDesc.Texture2DArray.MostDetailedMip = 0;
-	srvDesc.Texture2DArray.MipLevels = -1;
-	srvDesc.Texture2DArray.FirstArraySlice = 0;
-	srvDesc.Texture2DArray.ArraySize = treeArrayTex->GetDesc().DepthOrArraySize;
-	md3dDevice->CreateShaderResourceView(treeArrayTex.Get(), &srvDesc, hDescriptor);
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
 
-	//// next descriptor
-	//hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	if(errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	}
+	ThrowIfFailed(hr);
 
-	//srvDesc.Format = castleTex->GetDesc().Format;
-	//md3dDevice->CreateShaderResourceView(castleTex.Get(), &srvDesc, hDescriptor);
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mForestRootSignature.GetAddressOf())));
 }
 
-void TreeBillboardsApp::BuildShadersAndInputLayouts()
+void TreeBillboardsApp::BuildLightCullRootSignature()
 {
-	// Define "FOG" on the empties "" for allowing fog
-	const D3D_SHADER_MACRO defines[] =
-	{
-		"", "1",
-		NULL, NULL
-	};
+	// Root parameter can be a table, root descriptor or root constants.
+	CD3DX12_ROOT_PARAMETER slotRootParameter[4];
 
-	const D3D_SHADER_MACRO alphaTestDefines[] =
-	{
-		"", "1",
-		"ALPHA_TEST", "1",
-		NULL, NULL
-	};
+	// The lights and both outputs are plain buffers, so root descriptors do.
+	slotRootParameter[0].InitAsConstants(ClusteredLights::RootConstantCount(), 0);
+	slotRootParameter[1].InitAsShaderResourceView(0);
+	slotRootParameter[2].InitAsUnorderedAccessView(0);
+	slotRootParameter[3].InitAsUnorderedAccessView(1);
 
-	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", defines, "PS", "ps_5_1");
-	mShaders["alphaTestedPS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", alphaTestDefines, "PS", "ps_5_1");
-	
-	mShaders["treeSpriteVS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["treeSpriteGS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "GS", "gs_5_1");
-	mShaders["treeSpritePS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", alphaTestDefines, "PS", "ps_5_1");
+	// A root signature is an array of root parameters.
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
+		0, nullptr,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
-    mStdInputLayout =
-    {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-    };
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
 
-	mTreeSpriteInputLayout =
+	if(errorBlob != nullptr)
 	{
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "SIZE", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-	};
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	}
+	ThrowIfFailed(hr);
+
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mLightCullRootSignature.GetAddressOf())));
 }
 
-void TreeBillboardsApp::BuildLandGeometry()
+void TreeBillboardsApp::BuildOverlayRootSignature()
 {
-    GeometryGenerator geoGen;
-    GeometryGenerator::MeshData grid = geoGen.CreateGrid(80.0f,80.0f, 50, 50);
+	// The overlay's rectangle and color.
+	CD3DX12_ROOT_PARAMETER slotRootParameter[1];
+	slotRootParameter[0].InitAsConstants(8, 0);
 
-    //
-    // Extract the vertex elements we are interested and apply the height function to
-    // each vertex.  In addition, color the vertices based on their height so we have
-    // sandy looking beaches, grassy low hills, and snow mountain peaks.
-    //
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(1, slotRootParameter,
+		0, nullptr,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
-    std::vector<Vertex> vertices(grid.Vertices.size());
-    for(size_t i = 0; i < grid.Vertices.size(); ++i)
-    {
-        auto& p = grid.Vertices[i].Position;
-        vertices[i].Pos = p;
-        vertices[i].Pos.y =p.y + 0.1f;
-		//vertices[i].Pos.y = p.y - 0.3f;
-        //vertices[i].Normal = GetHillsNormal(p.x, p.z);
-		vertices[i].Normal = grid.Vertices[i].Normal;
-		vertices[i].TexC = grid.Vertices[i].TexC;
-    }
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
 
-    const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+	if(errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	}
+	ThrowIfFailed(hr);
 
-    std::vector<std::uint16_t> indices = grid.GetIndices16();
-    const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mOverlayRootSignature.GetAddressOf())));
+}
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "landGeo";
+void TreeBillboardsApp::BuildDescriptorHeaps()
+{
+	//
+	// Create the SRV heap.
+	//
+	D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
+	// One SRV per streamed texture, the two placeholder SRVs, the GpuWaves SRVs/UAVs,
+	// then the terrain's height map.
+	srvHeapDesc.NumDescriptors = mTextureDescriptorCount + mGpuWaves->DescriptorCount() + mTerrain->DescriptorCount();
+	srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&mSrvDescriptorHeap)));
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+	//
+	// Fill out the heap with actual descriptors.  The streamed textures' slots are
+	// rewritten by UpdateTextureStreaming as each one becomes resident; until then they
+	// view the placeholder, since the bindless table covers them and every descriptor
+	// in a bound table must be valid.  The placeholder is viewed both as a texture and
+	// as a one slice array for the tree sprites.
+	//
+	mPlaceholderSrvIndex = (UINT)mStreamedTextures.size();
+	mPlaceholderArraySrvIndex = mPlaceholderSrvIndex + 1;
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	auto placeholderTex = mTextures["placeholderTex"].get();
+	for(auto& streamed : mStreamedTextures)
+		CreateTextureSrv(*placeholderTex, streamed.SrvHeapIndex, streamed.IsArray);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+	CreateTextureSrv(*placeholderTex, mPlaceholderSrvIndex, false);
+	CreateTextureSrv(*placeholderTex, mPlaceholderArraySrvIndex, true);
 
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+	mGpuWaves->BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), mTextureDescriptorCount, mCbvSrvDescriptorSize),
+		CD3DX12_GPU_DESCRIPTOR_HANDLE(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(), mTextureDescriptorCount, mCbvSrvDescriptorSize),
+		mCbvSrvDescriptorSize);
 
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
+	UINT terrainDescriptorIndex = mTextureDescriptorCount + mGpuWaves->DescriptorCount();
+	mTerrain->BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), terrainDescriptorIndex, mCbvSrvDescriptorSize),
+		CD3DX12_GPU_DESCRIPTOR_HANDLE(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(), terrainDescriptorIndex, mCbvSrvDescriptorSize),
+		mCbvSrvDescriptorSize);
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["grid"] = submesh;
+	//// next descriptor
+	//hDescriptor.Offset(1, mCbvSrvDescriptorSize);
 
-	mGeometries["landGeo"] = std::move(geo);
+	//srvDesc.Format = castleTex->GetDesc().Format;
+	//md3dDevice->CreateShaderResourceView(castleTex.Get(), &srvDesc, hDescriptor);
 }
 
-void TreeBillboardsApp::BuildUnderLandGeometry()
+void TreeBillboardsApp::BuildShadersAndInputLayouts()
 {
-	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData gridU = geoGen.CreateGrid(128.0f, 128.0f, 50, 50);
-
-	//
-	// Extract the vertex elements we are interested and apply the height function to
-	// each vertex.  In addition, color the vertices based on their height so we have
-	// sandy looking beaches, grassy low hills, and snow mountain peaks.
-	//
-
-	std::vector<Vertex> vertices(gridU.Vertices.size());
-	for (size_t i = 0; i < gridU.Vertices.size(); ++i)
+	const std::vector<std::pair<std::string, std::string>> wavesDefines =
 	{
-		auto& p = gridU.Vertices[i].Position;
-		vertices[i].Pos = p;
-		vertices[i].Pos.y = p.y - 0.51f;
-		//vertices[i].Pos.y = p.y - 0.3f;
-		//vertices[i].Normal = GetHillsNormal(p.x, p.z);
-		vertices[i].Normal = gridU.Vertices[i].Normal;
-		vertices[i].TexC = gridU.Vertices[i].TexC;
-	}
-
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+		{ "DISPLACEMENT_MAP", "1" },
+	};
 
-	std::vector<std::uint16_t> indices = gridU.GetIndices16();
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	const std::vector<std::pair<std::string, std::string>> terrainDefines =
+	{
+		{ "TERRAIN", "1" },
+	};
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "landUGeo";
+	// The bindless pixel shaders index an array the size of the texture table.
+	const std::string textureCount = std::to_string(mTextureDescriptorCount);
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+	const std::vector<std::pair<std::string, std::string>> bindlessDefines =
+	{
+		{ "BINDLESS", "1" },
+		{ "BINDLESS_TEXTURE_COUNT", textureCount },
+	};
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	// Lit shaders take their light counts and fog from the pass permutation.
+	const bool lit = true;
+	const bool alphaTest = true;
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+	mShaderDescs =
+	{
+		{ "standardVS", L"Shaders\\Default.hlsl", {}, "VS", "vs_5_1" },
+		{ "instancedVS", L"Shaders\\Default.hlsl", {}, "VSInstanced", "vs_5_1" },
+		{ "wavesVS", L"Shaders\\Default.hlsl", wavesDefines, "VS", "vs_5_1" },
+		{ "terrainVS", L"Shaders\\Default.hlsl", terrainDefines, "VSTerrain", "vs_5_1" },
+		{ "opaquePS", L"Shaders\\Default.hlsl", {}, "PS", "ps_5_1", lit },
+		{ "alphaTestedPS", L"Shaders\\Default.hlsl", {}, "PS", "ps_5_1", lit, alphaTest },
+		{ "opaqueBindlessPS", L"Shaders\\Default.hlsl", bindlessDefines, "PS", "ps_5_1", lit },
+		{ "alphaTestedBindlessPS", L"Shaders\\Default.hlsl", bindlessDefines, "PS", "ps_5_1", lit, alphaTest },
+
+		{ "treeSpriteVS", L"Shaders\\TreeSprite.hlsl", {}, "VS", "vs_5_1" },
+		{ "treeSpriteGS", L"Shaders\\TreeSprite.hlsl", {}, "GS", "gs_5_1" },
+		{ "treeSpritePS", L"Shaders\\TreeSprite.hlsl", {}, "PS", "ps_5_1", lit, alphaTest },
+		{ "treeSpriteIndirectVS", L"Shaders\\TreeSprite.hlsl", {}, "VSIndirect", "vs_5_1" },
+		{ "treeSpriteIndirectPS", L"Shaders\\TreeSprite.hlsl", {}, "PSIndirect", "ps_5_1", lit, alphaTest },
+		{ "profilerOverlayVS", L"Shaders\\ProfilerOverlay.hlsl", {}, "VS", "vs_5_0" },
+		{ "profilerOverlayPS", L"Shaders\\ProfilerOverlay.hlsl", {}, "PS", "ps_5_0" },
+		{ "forestCullCS", L"Shaders\\ForestCull.hlsl", {}, "ScatterCullCS", "cs_5_0" },
+		{ "lightCullCS", L"Shaders\\LightCull.hlsl", {}, "CullLightsCS", "cs_5_0" },
+
+		{ "wavesUpdateCS", L"Shaders\\WaveSim.hlsl", {}, "UpdateWavesCS", "cs_5_0" },
+		{ "wavesDisturbCS", L"Shaders\\WaveSim.hlsl", {}, "DisturbWavesCS", "cs_5_0" },
+	};
 
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+	for(auto& desc : mShaderDescs)
+		mShaders[desc.Name] = mShaderPermutations->Get(desc, mPassPermutation);
 
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
+	OutputDebugString((L"ShaderCache: " + std::to_wstring(mShaderCache->HitCount()) + L" loaded, " +
+		std::to_wstring(mShaderCache->MissCount()) + L" compiled\n").c_str());
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
+    mStdInputLayout =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    };
 
-	geo->DrawArgs["grid"] = submesh;
+	mTreeSpriteInputLayout =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "SIZE", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	};
 
-	mGeometries["landUGeo"] = std::move(geo);
+	// Slot 0 is the per-frame WaveVertex stream, slot 1 the static tex-coords.
+	mWavesInputLayout =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	};
 }
 
 void TreeBillboardsApp::BuildWavesGeometry()
 {
-    std::vector<std::uint16_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
-	assert(mWaves->VertexCount() < 0x0000ffff);
+    std::vector<std::uint32_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
 
     // Iterate over each quad.
     int m = mWaves->RowCount();
@@ -925,329 +2295,336 @@ void TreeBillboardsApp::BuildWavesGeometry()
         }
     }
 
-	UINT vbByteSize = mWaves->VertexCount()*sizeof(Vertex);
-	UINT ibByteSize = (UINT)indices.size()*sizeof(std::uint16_t);
+	// The tex-coords never change, so derive them once from position by
+	// mapping [-w/2,w/2] --> [0,1].
+	std::vector<XMFLOAT2> texCoords(mWaves->VertexCount());
+	for(int i = 0; i < mWaves->VertexCount(); ++i)
+	{
+		XMFLOAT3 p = mWaves->Position(i);
+		texCoords[i].x = 0.5f + p.x / mWaves->Width();
+		texCoords[i].y = 0.5f - p.z / mWaves->Depth();
+	}
+
+	UINT vbByteSize = mWaves->VertexCount()*sizeof(WaveVertex);
+	UINT tbByteSize = (UINT)texCoords.size()*sizeof(XMFLOAT2);
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "waterGeo";
+	geo->IndexFormat = d3dUtil::CreateIndexBlob(indices, geo->IndexBufferCPU);
+	UINT ibByteSize = (UINT)geo->IndexBufferCPU->GetBufferSize();
 
 	// Set dynamically.
 	geo->VertexBufferCPU = nullptr;
 	geo->VertexBufferGPU = nullptr;
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	ThrowIfFailed(D3DCreateBlob(tbByteSize, &geo->TexCBufferCPU));
+	CopyMemory(geo->TexCBufferCPU->GetBufferPointer(), texCoords.data(), tbByteSize);
+
+	geo->TexCBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+		mCommandList.Get(), texCoords.data(), tbByteSize, geo->TexCBufferUploader);
 
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		mCommandList.Get(), geo->IndexBufferCPU->GetBufferPointer(), ibByteSize, geo->IndexBufferUploader);
 
-	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexByteStride = sizeof(WaveVertex);
 	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->TexCByteStride = sizeof(XMFLOAT2);
+	geo->TexCBufferByteSize = tbByteSize;
 	geo->IndexBufferByteSize = ibByteSize;
 
 	SubmeshGeometry submesh;
 	submesh.IndexCount = (UINT)indices.size();
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
+	
+	// The surface only moves vertically, so bound the grid with some headroom in y.
+	submesh.Bounds.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	submesh.Bounds.Extents = XMFLOAT3(0.5f*mWaves->Width(), 2.0f, 0.5f*mWaves->Depth());
 
 	geo->DrawArgs["grid"] = submesh;
 
 	mGeometries["waterGeo"] = std::move(geo);
 }
 
-void TreeBillboardsApp::BuildBoxGeometry()
+void TreeBillboardsApp::BuildGpuWavesGeometry()
 {
 	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 0);
+	GeometryGenerator::MeshData grid = geoGen.CreateGrid(mGpuWaves->Width(), mGpuWaves->Depth(), mGpuWaves->RowCount(), mGpuWaves->ColumnCount());
 
-	std::vector<Vertex> vertices(box.Vertices.size());
-	for (size_t i = 0; i < box.Vertices.size(); ++i)
+	// The displacement map is sampled by texture coordinates, so the vertices are
+	// free to be reordered.
+	geoGen.Optimize(grid);
+
+	// The grid does not move on the CPU; heights come from the displacement map.
+	std::vector<Vertex> vertices(grid.Vertices.size());
+	for(size_t i = 0; i < grid.Vertices.size(); ++i)
 	{
-		auto& p = box.Vertices[i].Position;
-		vertices[i].Pos = p;
-		vertices[i].Normal = box.Vertices[i].Normal;
-		vertices[i].TexC = box.Vertices[i].TexC;
+		vertices[i].Pos = grid.Vertices[i].Position;
+		vertices[i].Normal = grid.Vertices[i].Normal;
+		vertices[i].TexC = grid.Vertices[i].TexC;
 	}
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-
-	std::vector<std::uint16_t> indices = box.GetIndices16();
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	UINT vbByteSize = (UINT)vertices.size()*sizeof(Vertex);
 
 	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "boxGeo";
+	geo->Name = "gpuWaterGeo";
+
+	// A 512x512 grid does not fit in 16-bit indices; smaller ones get them.
+	geo->IndexFormat = d3dUtil::CreateIndexBlob(grid.Indices32, geo->IndexBufferCPU);
+	UINT ibByteSize = (UINT)geo->IndexBufferCPU->GetBufferSize();
 
 	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
 	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
 	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
 		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
 
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		mCommandList.Get(), geo->IndexBufferCPU->GetBufferPointer(), ibByteSize, geo->IndexBufferUploader);
 
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
 	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
+	submesh.IndexCount = (UINT)grid.Indices32.size();
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
 
-	geo->DrawArgs["box"] = submesh;
+	// The surface only moves vertically, so bound the grid with some headroom in y.
+	submesh.Bounds.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	submesh.Bounds.Extents = XMFLOAT3(0.5f*mGpuWaves->Width(), 2.0f, 0.5f*mGpuWaves->Depth());
 
-	mGeometries["boxGeo"] = std::move(geo);
+	geo->DrawArgs["grid"] = submesh;
+
+	mGeometries["gpuWaterGeo"] = std::move(geo);
 }
 
-void TreeBillboardsApp::BuildPyramidGeometry()
+void TreeBillboardsApp::BuildTerrainGeometry()
 {
 	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData pyramid = geoGen.CreatePyramid(1.0f, 1.0f, 1.0f, 0);
+	GeometryGenerator::MeshData tile = geoGen.CreateTerrainTile(33);
+	geoGen.Optimize(tile);
 
-	std::vector<Vertex> vertices(pyramid.Vertices.size());
-	for (size_t i = 0; i < pyramid.Vertices.size(); ++i)
+	// Only the position is used; the vertex shader derives the rest from the heights.
+	std::vector<Vertex> vertices(tile.Vertices.size());
+	for(size_t i = 0; i < tile.Vertices.size(); ++i)
 	{
-		auto& p = pyramid.Vertices[i].Position;
-		vertices[i].Pos = p;
-		vertices[i].Normal = pyramid.Vertices[i].Normal;
-		vertices[i].TexC = pyramid.Vertices[i].TexC;
+		vertices[i].Pos = tile.Vertices[i].Position;
+		vertices[i].Normal = tile.Vertices[i].Normal;
+		vertices[i].TexC = tile.Vertices[i].TexC;
 	}
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-
-	std::vector<std::uint16_t> indices = pyramid.GetIndices16();
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	UINT vbByteSize = (UINT)vertices.size()*sizeof(Vertex);
 
 	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "pyramidGeo";
+	geo->Name = "terrainGeo";
+
+	geo->IndexFormat = d3dUtil::CreateIndexBlob(tile.Indices32, geo->IndexBufferCPU);
+	UINT ibByteSize = (UINT)geo->IndexBufferCPU->GetBufferSize();
 
 	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
 	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
 	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
 		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
 
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		mCommandList.Get(), geo->IndexBufferCPU->GetBufferPointer(), ibByteSize, geo->IndexBufferUploader);
 
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
+	// Culled as a whole through the render item's bounds, Terrain culls the tiles.
 	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
+	submesh.IndexCount = (UINT)tile.Indices32.size();
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
+	submesh.Bounds = mTerrain->Bounds();
 
-	geo->DrawArgs["pyramid"] = submesh;
+	geo->DrawArgs["tile"] = submesh;
 
-	mGeometries["pyramidGeo"] = std::move(geo);
+	mGeometries["terrainGeo"] = std::move(geo);
 }
 
-void TreeBillboardsApp::BuildCylinderGeometry()
+void TreeBillboardsApp::BuildShapeGeometry()
 {
-	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData cylinder = geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20);
+	//
+	// All the castle's meshes share one vertex and index buffer, each one addressed
+	// by its own submesh, so the static scene binds a single VB/IB and is uploaded
+	// with one pair of copies.  The compiled scene holds both buffers ready to copy,
+	// and is rebuilt from the text whenever that changes.
+	//
 
-	std::vector<Vertex> vertices(cylinder.Vertices.size());
-	for (size_t i = 0; i < cylinder.Vertices.size(); ++i)
-	{
-		auto& p = cylinder.Vertices[i].Position;
-		vertices[i].Pos = p;
-		vertices[i].Normal = cylinder.Vertices[i].Normal;
-		vertices[i].TexC = cylinder.Vertices[i].TexC;
-	}
+	const std::wstring sourceFilename = L"Scenes\\Castle.txt";
+	const std::wstring sceneFilename = L"Scenes\\Castle.scene";
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+	UINT64 sourceStamp = GetSceneSourceStamp(sourceFilename);
 
-	std::vector<std::uint16_t> indices = cylinder.GetIndices16();
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	mScene = std::make_unique<CompiledScene>();
+	if(!mScene->Open(sceneFilename, sourceStamp, sizeof(Vertex)))
+		CompileScene(sourceFilename, sceneFilename, sourceStamp);
 
 	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "cylinderGeo";
-
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
+	geo->Name = "shapeGeo";
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["cylinder"] = submesh;
-
-	mGeometries["cylinderGeo"] = std::move(geo);
-}
-
-void TreeBillboardsApp::BuildConeGeometry()
-{
-	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData cone = geoGen.CreateCylinder(0.5f, 0.0f, 3.0f, 20, 20);
-
-	std::vector<Vertex> vertices(cone.Vertices.size());
-	for (size_t i = 0; i < cone.Vertices.size(); ++i)
+	for(UINT i = 0; i < mScene->SubmeshCount(); ++i)
 	{
-		auto& p = cone.Vertices[i].Position;
-		vertices[i].Pos = p;
-		vertices[i].Normal = cone.Vertices[i].Normal;
-		vertices[i].TexC = cone.Vertices[i].TexC;
+		const SceneSubmesh& s = mScene->Submesh(i);
+
+		SubmeshGeometry submesh;
+		submesh.IndexCount = s.IndexCount;
+		submesh.StartIndexLocation = s.StartIndexLocation;
+		submesh.BaseVertexLocation = s.BaseVertexLocation;
+		submesh.Bounds = s.Bounds;
+		geo->DrawArgs[s.Name] = submesh;
 	}
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-
-	std::vector<std::uint16_t> indices = cone.GetIndices16();
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
-
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "coneGeo";
-
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	const UINT vbByteSize = mScene->VertexCount() * sizeof(Vertex);
+	const UINT ibByteSize = mScene->IndexByteSize();
 
+	// The copies into the upload heaps read straight from the mapped file.
 	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+		mCommandList.Get(), mScene->VertexData(), vbByteSize, geo->VertexBufferUploader);
 
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		mCommandList.Get(), mScene->IndexData(), ibByteSize, geo->IndexBufferUploader);
 
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->IndexFormat = mScene->IndexFormat();
 	geo->IndexBufferByteSize = ibByteSize;
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["cone"] = submesh;
-
-	mGeometries["coneGeo"] = std::move(geo);
+	mGeometries["shapeGeo"] = std::move(geo);
 }
 
-void TreeBillboardsApp::BuildWedgeGeometry()
+void TreeBillboardsApp::CompileScene(const std::wstring& sourceFilename, const std::wstring& sceneFilename, UINT64 sourceStamp)
 {
+	SceneDesc desc = ParseSceneText(sourceFilename);
+
 	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData wedge = geoGen.CreateWedge(1.0f, 1.0f, 1.0f, 0);
 
-	std::vector<Vertex> vertices(wedge.Vertices.size());
-	for (size_t i = 0; i < wedge.Vertices.size(); ++i)
+	struct ShapeMesh
 	{
-		auto& p = wedge.Vertices[i].Position;
-		vertices[i].Pos = p;
-		vertices[i].Normal = wedge.Vertices[i].Normal;
-		vertices[i].TexC = wedge.Vertices[i].TexC;
-	}
-
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-
-	std::vector<std::uint16_t> indices = wedge.GetIndices16();
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
-
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "wedgeGeo";
-
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
-
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["wedge"] = submesh;
-
-	mGeometries["wedgeGeo"] = std::move(geo);
-}
-
-void TreeBillboardsApp::BuildDiamondGeometry()
-{
-	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData diamond = geoGen.CreateDiamond(1.0f, 1.0f, 1.0f, 0);
+		std::string Name;
+		GeometryGenerator::MeshData Mesh;
+	};
 
-	std::vector<Vertex> vertices(diamond.Vertices.size());
-	for (size_t i = 0; i < diamond.Vertices.size(); ++i)
+	std::vector<ShapeMesh> shapes;
+	for(const auto& m : desc.Meshes)
 	{
-		auto& p = diamond.Vertices[i].Position;
-		vertices[i].Pos = p;
-		vertices[i].Normal = diamond.Vertices[i].Normal;
-		vertices[i].TexC = diamond.Vertices[i].TexC;
+		const auto& p = m.Params;
+		auto expect = [&](size_t count)
+		{
+			if(p.size() != count)
+			{
+				throw std::runtime_error("mesh " + m.Name + ": " + m.Shape + " takes " +
+					std::to_string(count) + " parameters");
+			}
+		};
+
+		if(m.Shape == "box" || m.Shape == "pyramid" || m.Shape == "wedge" || m.Shape == "diamond")
+		{
+			expect(4);
+
+			GeometryGenerator::MeshData mesh;
+			if(m.Shape == "box")
+				mesh = geoGen.CreateBox(p[0], p[1], p[2], (UINT)p[3]);
+			else if(m.Shape == "pyramid")
+				mesh = geoGen.CreatePyramid(p[0], p[1], p[2], (UINT)p[3]);
+			else if(m.Shape == "wedge")
+				mesh = geoGen.CreateWedge(p[0], p[1], p[2], (UINT)p[3]);
+			else
+				mesh = geoGen.CreateDiamond(p[0], p[1], p[2], (UINT)p[3]);
+
+			shapes.push_back({ m.Name, mesh });
+		}
+		else if(m.Shape == "cylinder")
+		{
+			expect(5);
+
+			// The towers and gates are seen from up close and across the map, so their
+			// round meshes get coarser levels, named "<name>_lod<n>", for
+			// CullRenderItems to pick.
+			auto lods = geoGen.CreateCylinderLods(p[0], p[1], p[2], (UINT)p[3], (UINT)p[4], gLodCount);
+			for(UINT i = 0; i < gLodCount; ++i)
+				shapes.push_back({ i == 0 ? m.Name : m.Name + "_lod" + std::to_string(i), lods[i] });
+		}
+		else
+		{
+			throw std::runtime_error("mesh " + m.Name + ": unknown shape " + m.Shape);
+		}
 	}
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+	// Check the items against the meshes and layers here, so a compiled scene
+	// never needs it.  Materials are only known once they are built.
+	for(const auto& item : desc.Items)
+	{
+		auto nameMatches = [&](const ShapeMesh& s) { return s.Name == item.Submesh; };
+		if(std::find_if(shapes.begin(), shapes.end(), nameMatches) == shapes.end())
+			throw std::runtime_error(std::string("item ") + item.Name + ": unknown mesh " + item.Submesh);
 
-	std::vector<std::uint16_t> indices = diamond.GetIndices16();
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+		if(FindSceneLayer(item.Layer) == RenderLayer::Count)
+			throw std::runtime_error(std::string("item ") + item.Name + ": unknown layer " + item.Layer);
+	}
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "diamondGeo";
+	size_t totalVertexCount = 0;
+	size_t totalIndexCount = 0;
+	for(auto& s : shapes)
+	{
+		geoGen.Optimize(s.Mesh);
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+		totalVertexCount += s.Mesh.Vertices.size();
+		totalIndexCount += s.Mesh.Indices32.size();
+	}
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	std::vector<Vertex> vertices;
+	std::vector<std::uint32_t> indices;
+	vertices.reserve(totalVertexCount);
+	indices.reserve(totalIndexCount);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+	CompiledScene::Geometry geometry;
 
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+	for(auto& s : shapes)
+	{
+		// Indices stay local to each mesh and are offset by BaseVertexLocation,
+		// so 16-bit indices only need each mesh on its own to fit in them.
+
+		SceneSubmesh submesh = {};
+		if(s.Name.size() >= _countof(submesh.Name))
+			throw std::runtime_error("mesh " + s.Name + ": name too long");
+		CopyMemory(submesh.Name, s.Name.data(), s.Name.size());
+		submesh.IndexCount = (UINT)s.Mesh.Indices32.size();
+		submesh.StartIndexLocation = (UINT)indices.size();
+		submesh.BaseVertexLocation = (INT)vertices.size();
+
+		for(const auto& v : s.Mesh.Vertices)
+		{
+			Vertex vertex;
+			vertex.Pos = v.Position;
+			vertex.Normal = v.Normal;
+			vertex.TexC = v.TexC;
+			vertices.push_back(vertex);
+		}
 
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
+		BoundingBox::CreateFromPoints(submesh.Bounds, s.Mesh.Vertices.size(),
+			&vertices[submesh.BaseVertexLocation].Pos, sizeof(Vertex));
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
+		indices.insert(indices.end(), s.Mesh.Indices32.begin(), s.Mesh.Indices32.end());
 
-	geo->DrawArgs["diamond"] = submesh;
+		geometry.Submeshes.push_back(submesh);
+	}
+
+	ComPtr<ID3DBlob> indexBlob;
+	geometry.IndexFormat = d3dUtil::CreateIndexBlob(indices, indexBlob);
+	geometry.Indices = indexBlob->GetBufferPointer();
+	geometry.IndexByteSize = (UINT)indexBlob->GetBufferSize();
+	geometry.Vertices = vertices.data();
+	geometry.VertexCount = (UINT)vertices.size();
+	geometry.VertexByteStride = sizeof(Vertex);
 
-	mGeometries["diamondGeo"] = std::move(geo);
+	mScene->Create(sceneFilename, sourceStamp, geometry, desc.Items);
 }
 
 void TreeBillboardsApp::BuildTreeSpritesGeometry()
@@ -1386,6 +2763,13 @@ void TreeBillboardsApp::BuildTreeSpritesGeometry()
 	submesh.IndexCount = (UINT)indices.size();
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
+	
+	// Bound the sprite centers, then grow by half a sprite since the quads are
+	// expanded around them in the geometry shader.
+	BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(TreeSpriteVertex));
+	submesh.Bounds.Extents.x += 7.5f;
+	submesh.Bounds.Extents.y += 7.5f;
+	submesh.Bounds.Extents.z += 7.5f;
 
 	geo->DrawArgs["points"] = submesh;
 
@@ -1394,6 +2778,32 @@ void TreeBillboardsApp::BuildTreeSpritesGeometry()
 
 void TreeBillboardsApp::BuildPSOs()
 {
+	// Only the PSOs the first frame draws with are created before it.  The other
+	// variants are left to worker threads.
+	std::vector<std::string> firstFramePSOs;
+	for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		if(mRitems->LayerSize(layer) > 0)
+			firstFramePSOs.push_back(GetLayerPSOName((RenderLayer)layer));
+	}
+
+	std::vector<std::pair<std::string, D3D12_GRAPHICS_PIPELINE_STATE_DESC>> firstFrameDescs;
+	auto createPSO = [this, &firstFramePSOs, &firstFrameDescs](const std::string& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+	{
+		mGraphicsPSODescs[name] = desc;
+
+		if(std::find(firstFramePSOs.begin(), firstFramePSOs.end(), name) != firstFramePSOs.end())
+			firstFrameDescs.push_back({ name, desc });
+		else
+			CreateBackgroundPSO(name, desc);
+	};
+
+	auto createComputePSO = [this](const std::string& name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc)
+	{
+		mComputePSODescs[name] = desc;
+		mPSOs[name] = mPipelineCache->CreateComputePipeline(AnsiToWString(name), desc);
+	};
+
     D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc;
 
 	//
@@ -1427,7 +2837,7 @@ void TreeBillboardsApp::BuildPSOs()
 	opaquePsoDesc.SampleDesc.Count = m4xMsaaState ? 4 : 1;
 	opaquePsoDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
 	opaquePsoDesc.DSVFormat = mDepthStencilFormat;
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque"])));
+    createPSO("opaque", opaquePsoDesc);
 
 	//
 	// PSO for transparent objects
@@ -1450,7 +2860,7 @@ void TreeBillboardsApp::BuildPSOs()
 	//transparentPsoDesc.BlendState.AlphaToCoverageEnable = true;
 
 	transparentPsoDesc.BlendState.RenderTarget[0] = transparencyBlendDesc;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&transparentPsoDesc, IID_PPV_ARGS(&mPSOs["transparent"])));
+	createPSO("transparent", transparentPsoDesc);
 
 	//
 	// PSO for alpha tested objects
@@ -1463,7 +2873,29 @@ void TreeBillboardsApp::BuildPSOs()
 		mShaders["alphaTestedPS"]->GetBufferSize()
 	};
 	alphaTestedPsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&alphaTestedPsoDesc, IID_PPV_ARGS(&mPSOs["alphaTested"])));
+	createPSO("alphaTested", alphaTestedPsoDesc);
+
+	//
+	// Instanced variants: same state, but the vertex shader reads the world matrix
+	// from the instance buffer instead of the per-object cbuffer.
+	//
+	D3D12_SHADER_BYTECODE instancedVS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["instancedVS"]->GetBufferPointer()),
+		mShaders["instancedVS"]->GetBufferSize()
+	};
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC opaqueInstancedPsoDesc = opaquePsoDesc;
+	opaqueInstancedPsoDesc.VS = instancedVS;
+	createPSO("opaqueInstanced", opaqueInstancedPsoDesc);
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC transparentInstancedPsoDesc = transparentPsoDesc;
+	transparentInstancedPsoDesc.VS = instancedVS;
+	createPSO("transparentInstanced", transparentInstancedPsoDesc);
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC alphaTestedInstancedPsoDesc = alphaTestedPsoDesc;
+	alphaTestedInstancedPsoDesc.VS = instancedVS;
+	createPSO("alphaTestedInstanced", alphaTestedInstancedPsoDesc);
 
 	//
 	// PSO for tree sprites
@@ -1489,18 +2921,415 @@ void TreeBillboardsApp::BuildPSOs()
 	treeSpritePsoDesc.InputLayout = { mTreeSpriteInputLayout.data(), (UINT)mTreeSpriteInputLayout.size() };
 	treeSpritePsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
 
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&treeSpritePsoDesc, IID_PPV_ARGS(&mPSOs["treeSprites"])));
+	createPSO("treeSprites", treeSpritePsoDesc);
+
+	//
+	// PSO for the GPU forest: the same sprites as quads built in the vertex shader.
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC treeSpriteIndirectPsoDesc = treeSpritePsoDesc;
+	treeSpriteIndirectPsoDesc.InputLayout = { nullptr, 0 };
+	treeSpriteIndirectPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["treeSpriteIndirectVS"]->GetBufferPointer()),
+		mShaders["treeSpriteIndirectVS"]->GetBufferSize()
+	};
+	treeSpriteIndirectPsoDesc.GS = { nullptr, 0 };
+	treeSpriteIndirectPsoDesc.PS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["treeSpriteIndirectPS"]->GetBufferPointer()),
+		mShaders["treeSpriteIndirectPS"]->GetBufferSize()
+	};
+	treeSpriteIndirectPsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+	createPSO("treeSpritesIndirect", treeSpriteIndirectPsoDesc);
+
+	//
+	// PSO for drawing the GPU waves: transparent, with vertex displacement.
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC wavesRenderPSO = transparentPsoDesc;
+	wavesRenderPSO.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["wavesVS"]->GetBufferPointer()),
+		mShaders["wavesVS"]->GetBufferSize()
+	};
+	createPSO("wavesRender", wavesRenderPSO);
+
+	//
+	// PSO for the terrain: opaque, with tiles placed and lifted by the vertex shader.
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC terrainPsoDesc = opaquePsoDesc;
+	terrainPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["terrainVS"]->GetBufferPointer()),
+		mShaders["terrainVS"]->GetBufferSize()
+	};
+	createPSO("terrain", terrainPsoDesc);
+
+	//
+	// PSO for drawing the CPU waves: transparent, with tex-coords in a second stream.
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC cpuWavesPsoDesc = transparentPsoDesc;
+	cpuWavesPsoDesc.InputLayout = { mWavesInputLayout.data(), (UINT)mWavesInputLayout.size() };
+	createPSO("cpuWaves", cpuWavesPsoDesc);
+
+	//
+	// PSO for the profiler overlay: flat blended rectangles over everything.
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC overlayPsoDesc = transparentPsoDesc;
+	overlayPsoDesc.InputLayout = { nullptr, 0 };
+	overlayPsoDesc.pRootSignature = mOverlayRootSignature.Get();
+	overlayPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["profilerOverlayVS"]->GetBufferPointer()),
+		mShaders["profilerOverlayVS"]->GetBufferSize()
+	};
+	overlayPsoDesc.PS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["profilerOverlayPS"]->GetBufferPointer()),
+		mShaders["profilerOverlayPS"]->GetBufferSize()
+	};
+	overlayPsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+	overlayPsoDesc.DepthStencilState.DepthEnable = false;
+	overlayPsoDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+	createPSO("profilerOverlay", overlayPsoDesc);
+
+	//
+	// Bindless variants: same state, but the pixel shader indexes the texture table
+	// bound once per frame instead of a table set per material.
+	//
+	struct BindlessVariant
+	{
+		std::string Name;
+		const D3D12_GRAPHICS_PIPELINE_STATE_DESC* Desc;
+		std::string PS;
+	};
+
+	const BindlessVariant bindlessVariants[] =
+	{
+		{ "opaque", &opaquePsoDesc, "opaqueBindlessPS" },
+		{ "transparent", &transparentPsoDesc, "opaqueBindlessPS" },
+		{ "alphaTested", &alphaTestedPsoDesc, "alphaTestedBindlessPS" },
+		{ "opaqueInstanced", &opaqueInstancedPsoDesc, "opaqueBindlessPS" },
+		{ "transparentInstanced", &transparentInstancedPsoDesc, "opaqueBindlessPS" },
+		{ "alphaTestedInstanced", &alphaTestedInstancedPsoDesc, "alphaTestedBindlessPS" },
+		{ "wavesRender", &wavesRenderPSO, "opaqueBindlessPS" },
+		{ "cpuWaves", &cpuWavesPsoDesc, "opaqueBindlessPS" },
+		{ "terrain", &terrainPsoDesc, "opaqueBindlessPS" },
+	};
+
+	for(auto& variant : bindlessVariants)
+	{
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC bindlessPsoDesc = *variant.Desc;
+		bindlessPsoDesc.PS =
+		{
+			reinterpret_cast<BYTE*>(mShaders[variant.PS]->GetBufferPointer()),
+			mShaders[variant.PS]->GetBufferSize()
+		};
+		createPSO(variant.Name + "Bindless", bindlessPsoDesc);
+	}
+
+	//
+	// PSO for disturbing waves
+	//
+	D3D12_COMPUTE_PIPELINE_STATE_DESC wavesDisturbPSO = {};
+	wavesDisturbPSO.pRootSignature = mWavesRootSignature.Get();
+	wavesDisturbPSO.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["wavesDisturbCS"]->GetBufferPointer()),
+		mShaders["wavesDisturbCS"]->GetBufferSize()
+	};
+	wavesDisturbPSO.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	createComputePSO("wavesDisturb", wavesDisturbPSO);
+
+	//
+	// PSO for updating waves
+	//
+	D3D12_COMPUTE_PIPELINE_STATE_DESC wavesUpdatePSO = {};
+	wavesUpdatePSO.pRootSignature = mWavesRootSignature.Get();
+	wavesUpdatePSO.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["wavesUpdateCS"]->GetBufferPointer()),
+		mShaders["wavesUpdateCS"]->GetBufferSize()
+	};
+	wavesUpdatePSO.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	createComputePSO("wavesUpdate", wavesUpdatePSO);
+
+	//
+	// PSO for scattering and culling the GPU forest
+	//
+	D3D12_COMPUTE_PIPELINE_STATE_DESC forestCullPSO = {};
+	forestCullPSO.pRootSignature = mForestRootSignature.Get();
+	forestCullPSO.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["forestCullCS"]->GetBufferPointer()),
+		mShaders["forestCullCS"]->GetBufferSize()
+	};
+	forestCullPSO.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	createComputePSO("forestCull", forestCullPSO);
+
+	//
+	// PSO for binning the clustered lights
+	//
+	D3D12_COMPUTE_PIPELINE_STATE_DESC lightCullPSO = {};
+	lightCullPSO.pRootSignature = mLightCullRootSignature.Get();
+	lightCullPSO.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["lightCullCS"]->GetBufferPointer()),
+		mShaders["lightCullCS"]->GetBufferSize()
+	};
+	lightCullPSO.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	createComputePSO("lightCull", lightCullPSO);
+
+	// The first frame waits for these, so compile them side by side.
+	std::vector<ComPtr<ID3D12PipelineState>> firstFrameResults(firstFrameDescs.size());
+	concurrency::parallel_for(size_t(0), firstFrameDescs.size(), [this, &firstFrameDescs, &firstFrameResults](size_t i)
+	{
+		firstFrameResults[i] = mPipelineCache->CreateGraphicsPipeline(AnsiToWString(firstFrameDescs[i].first), firstFrameDescs[i].second);
+	});
+
+	for(size_t i = 0; i < firstFrameDescs.size(); ++i)
+		mPSOs[firstFrameDescs[i].first] = firstFrameResults[i];
+
+	// Nothing left for the workers, so the library is complete already.
+	if(mPendingBackgroundPSOs == 0)
+		mPipelineCache->Save();
+}
+
+void TreeBillboardsApp::CreateBackgroundPSO(const std::string& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+	// The description is copied; what it points at (shaders, input layouts and
+	// the root signature) are members that outlive the task.
+	++mPendingBackgroundPSOs;
+	mBackgroundPSOTasks.run([this, name, desc]()
+	{
+		BackgroundPSO result;
+		result.Name = name;
+		try
+		{
+			result.PSO = mPipelineCache->CreateGraphicsPipeline(AnsiToWString(name), desc);
+		}
+		catch(...)
+		{
+			result.Error = std::current_exception();
+		}
+
+		std::lock_guard<std::mutex> lock(mBackgroundPSOMutex);
+		mBackgroundPSOs.push_back(std::move(result));
+	});
+}
+
+void TreeBillboardsApp::CollectBackgroundPSOs(bool wait)
+{
+	if(wait)
+		mBackgroundPSOTasks.wait();
+
+	std::vector<BackgroundPSO> finished;
+	{
+		std::lock_guard<std::mutex> lock(mBackgroundPSOMutex);
+		finished.swap(mBackgroundPSOs);
+	}
+
+	if(finished.empty())
+		return;
+
+	for(auto& result : finished)
+	{
+		// Rethrown here so failures surface the same way they would on the main thread.
+		if(result.Error != nullptr)
+			std::rethrow_exception(result.Error);
+
+		mPSOs[result.Name] = result.PSO;
+	}
+
+	mPendingBackgroundPSOs -= (UINT)finished.size();
+
+	// Every PSO of this run exists now, so write back whatever was compiled.
+	if(mPendingBackgroundPSOs == 0)
+		mPipelineCache->Save();
+}
+
+void TreeBillboardsApp::UpdateHotReload()
+{
+	const UINT64 completedFence = mFence->GetCompletedValue();
+	mRetiredPSOs.erase(std::remove_if(mRetiredPSOs.begin(), mRetiredPSOs.end(),
+		[completedFence](const std::pair<UINT64, ComPtr<ID3D12PipelineState>>& retired) { return retired.first <= completedFence; }),
+		mRetiredPSOs.end());
+
+	std::vector<std::wstring> changed;
+	if(mFileWatcher != nullptr)
+		mFileWatcher->Poll(changed);
+	for(auto& path : changed)
+	{
+		std::wstring filename = path.substr(path.find_last_of(L"/\\") + 1);
+
+		// Any shader may include the one that changed, so all are recompiled; the
+		// shader cache serves the ones whose preprocessed source is the same.
+		if(filename.size() > 5 && _wcsicmp(filename.c_str() + filename.size() - 5, L".hlsl") == 0)
+			mShadersChanged = true;
+
+		for(auto& t : mStreamedTextures)
+		{
+			if(_wcsicmp(t.Filename.substr(t.Filename.find_last_of(L"/\\") + 1).c_str(), filename.c_str()) == 0)
+				mTextureStreamer->Reload(t.Name, t.Filename);
+		}
+	}
+
+	std::unique_ptr<ShaderReload> reload;
+	{
+		std::lock_guard<std::mutex> lock(mShaderReloadMutex);
+		reload = std::move(mFinishedShaderReload);
+	}
+
+	if(reload != nullptr)
+	{
+		mShaderReloadRunning = false;
+
+		if(!reload->Error.empty())
+		{
+			OutputDebugString((L"Shader reload failed, keeping the old PSOs: " + reload->Error + L"\n").c_str());
+		}
+		else
+		{
+			// Nothing recorded this frame yet, so the new PSOs take over from here on.
+			for(auto& pso : reload->PSOs)
+			{
+				mRetiredPSOs.push_back({ mCurrentFence, mPSOs[pso.first] });
+				mPSOs[pso.first] = pso.second;
+			}
+			for(auto& desc : reload->GraphicsDescs)
+				mGraphicsPSODescs[desc.first] = desc.second;
+			for(auto& desc : reload->ComputeDescs)
+				mComputePSODescs[desc.first] = desc.second;
+			for(auto& shader : reload->Shaders)
+				mShaders[shader.first] = shader.second;
+
+			OutputDebugString((L"Shader reload: " + std::to_wstring(reload->Shaders.size()) + L" shaders, " +
+				std::to_wstring(reload->PSOs.size()) + L" PSOs rebuilt\n").c_str());
+
+			if(!reload->PSOs.empty())
+				mPipelineCache->Save();
+		}
+	}
+
+	// The startup workers still read the shaders a reload would replace.
+	if((mShadersChanged || mPermutationChanged) && !mShaderReloadRunning && mPendingBackgroundPSOs == 0)
+	{
+		StartShaderReload(mShadersChanged);
+		mShadersChanged = false;
+		mPermutationChanged = false;
+	}
+}
+
+void TreeBillboardsApp::StartShaderReload(bool sourcesChanged)
+{
+	// Until the result is swapped in, the main thread leaves mShaders and the PSO
+	// descriptions alone, so the worker can read them.
+	mShaderReloadRunning = true;
+	mShaderReloadTasks.run([this, sourcesChanged, permutation = mPassPermutation]()
+	{
+		auto reload = std::make_unique<ShaderReload>();
+
+		// A new permutation alone can reuse every variant built so far.
+		if(sourcesChanged)
+			mShaderPermutations->Invalidate();
+
+		// Bytecode of the replaced shaders, by the pointer the descriptions hold.  A
+		// shader that fails to compile keeps its old bytecode, and the compiler's
+		// errors go to the debugger output.
+		std::unordered_map<const void*, ID3DBlob*> replaced;
+		for(auto& desc : mShaderDescs)
+		{
+			ComPtr<ID3DBlob> byteCode = mShaderPermutations->Get(desc, permutation);
+			ID3DBlob* current = mShaders.at(desc.Name).Get();
+			if(byteCode == nullptr || (byteCode->GetBufferSize() == current->GetBufferSize() &&
+				memcmp(byteCode->GetBufferPointer(), current->GetBufferPointer(), current->GetBufferSize()) == 0))
+				continue;
+
+			replaced[current->GetBufferPointer()] = byteCode.Get();
+			reload->Shaders[desc.Name] = byteCode;
+		}
+
+		auto patch = [&replaced](D3D12_SHADER_BYTECODE& shader)
+		{
+			auto it = replaced.find(shader.pShaderBytecode);
+			if(it == replaced.end())
+				return false;
+
+			shader = { it->second->GetBufferPointer(), it->second->GetBufferSize() };
+			return true;
+		};
+
+		try
+		{
+			for(auto& pso : mGraphicsPSODescs)
+			{
+				D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = pso.second;
+				bool vs = patch(desc.VS);
+				bool gs = patch(desc.GS);
+				bool ps = patch(desc.PS);
+				if(!vs && !gs && !ps)
+					continue;
+
+				reload->GraphicsDescs[pso.first] = desc;
+				reload->PSOs[pso.first] = mPipelineCache->CreateGraphicsPipeline(AnsiToWString(pso.first), desc);
+			}
+
+			for(auto& pso : mComputePSODescs)
+			{
+				D3D12_COMPUTE_PIPELINE_STATE_DESC desc = pso.second;
+				if(!patch(desc.CS))
+					continue;
+
+				reload->ComputeDescs[pso.first] = desc;
+				reload->PSOs[pso.first] = mPipelineCache->CreateComputePipeline(AnsiToWString(pso.first), desc);
+			}
+		}
+		catch(DxException& e)
+		{
+			// Typically stages whose signatures no longer match after an edit.
+			reload->Error = e.ToString();
+		}
+
+		std::lock_guard<std::mutex> lock(mShaderReloadMutex);
+		mFinishedShaderReload = std::move(reload);
+	});
 }
 
 void TreeBillboardsApp::BuildFrameResources()
 {
+	// ObjectCB only needs slots for the items that were given one.
+	UINT objectCount = 0;
+	for(UINT objCBIndex : mRitems->ObjCBIndices)
+	{
+		if(objCBIndex != (UINT)-1)
+			objectCount = std::max<UINT>(objectCount, objCBIndex + 1);
+	}
+
     for(int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWaves->VertexCount()));
+            1, objectCount, mInstanceCount, (UINT)mMaterials.size(), gMaxClusteredLights, mWaves->VertexCount(),
+            _countof(gLayerDrawOrder), gFrameUploadByteSize));
     }
 }
 
+void TreeBillboardsApp::BuildLayerCommandLists()
+{
+	for(int i = 0; i < _countof(gLayerDrawOrder); ++i)
+	{
+		// The allocator is only used to create the list; each frame resets it with
+		// the current frame resource's worker allocator.
+		ThrowIfFailed(md3dDevice->CreateCommandList(
+			0,
+			D3D12_COMMAND_LIST_TYPE_DIRECT,
+			mFrameResources[0]->WorkerCmdListAllocs[i].Get(),
+			nullptr,
+			IID_PPV_ARGS(mLayerCmdLists[i].GetAddressOf())));
+
+		// Start off in a closed state, like the main command list.
+		ThrowIfFailed(mLayerCmdLists[i]->Close());
+	}
+}
+
 void TreeBillboardsApp::BuildMaterials()
 {
 	auto grass = std::make_unique<Material>();
@@ -1580,761 +3409,544 @@ void TreeBillboardsApp::BuildMaterials()
 	mMaterials["dirt"] = std::move(dirt);
 	mMaterials["window"] = std::move(window);
 	mMaterials["castle2"] = std::move(castle2);
+
+	// Point every material at a placeholder until its texture has streamed in.
+	for(auto& m : mMaterials)
+	{
+		Material* mat = m.second.get();
+		auto streamed = std::find_if(mStreamedTextures.begin(), mStreamedTextures.end(),
+			[mat](const StreamedTexture& t) { return (int)t.SrvHeapIndex == mat->DiffuseSrvHeapIndex; });
+		if(streamed == mStreamedTextures.end())
+			continue;
+
+		mMaterialsAwaitingTextures.push_back({ mat, streamed->SrvHeapIndex });
+		mat->DiffuseSrvHeapIndex = streamed->IsArray ? mPlaceholderArraySrvIndex : mPlaceholderSrvIndex;
+	}
 }
 
 void TreeBillboardsApp::BuildRenderItems()
 {
+	mRitems = std::make_unique<RenderItemStore>((UINT)RenderLayer::Count);
 
 
 	////Test
-	//auto boxRitem = std::make_unique<RenderItem>();
-
-	////XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(10.0f, 12.0f, 10.0f) * XMMatrixTranslation(0.0f, 6.0f, 0.0f));
-	//XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(1.0f, 6.0f, 1.0f) * XMMatrixTranslation(0.0f, 6.0f, 0.0f));
-	//boxRitem->ObjCBIndex = 1;
-	//boxRitem->Mat = mMaterials["wirefence"].get();
-	//boxRitem->Geo = mGeometries["wedgeGeo"].get();
-	//boxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	//boxRitem->IndexCount = boxRitem->Geo->DrawArgs["wedge"].IndexCount;
-	//boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["wedge"].StartIndexLocation;
-	//boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["wedge"].BaseVertexLocation;
-	//mRitemLayer[(int)RenderLayer::Opaque].push_back(boxRitem.get());
-	//mAllRitems.push_back(std::move(boxRitem));
-
-	//Grid
-    auto gridRitem = std::make_unique<RenderItem>();
-    gridRitem->World = MathHelper::Identity4x4();
-	XMStoreFloat4x4(&gridRitem->TexTransform, XMMatrixScaling(0.5f, 0.5f, 2.0f) * XMMatrixTranslation(0.0f, 6.0f, 0.0f));
-	gridRitem->ObjCBIndex = 0;
-	gridRitem->Mat = mMaterials["grass"].get();
-	gridRitem->Geo = mGeometries["landGeo"].get();
-	gridRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-    gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-    gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
-	mAllRitems.push_back(std::move(gridRitem));
-
-	//Body
-	auto boxRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(10.0f, 12.0f, 10.0f) * XMMatrixTranslation(0.0f, 6.0f, 0.0f));
-	boxRitem->ObjCBIndex = 1;
-	boxRitem->Mat = mMaterials["castle2"].get();
-	boxRitem->Geo = mGeometries["boxGeo"].get();
-	boxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
-	boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(boxRitem.get());
-	mAllRitems.push_back(std::move(boxRitem));
-
-	//LeftFront Cylinder
-	auto cylRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&cylRitem->World, XMMatrixScaling(6.0f, 5.0f, 6.0f) * XMMatrixTranslation(-6.0f, 7.5f, -5.0f));
-	cylRitem->ObjCBIndex = 2;
-	cylRitem->Mat = mMaterials["castle2"].get();
-	cylRitem->Geo = mGeometries["cylinderGeo"].get();
-	cylRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	cylRitem->IndexCount = cylRitem->Geo->DrawArgs["cylinder"].IndexCount;
-	cylRitem->StartIndexLocation = cylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-	cylRitem->BaseVertexLocation = cylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(cylRitem.get());
-	mAllRitems.push_back(std::move(cylRitem));
-
-	//RightFront Cylinder
-	auto cyl2Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&cyl2Ritem->World, XMMatrixScaling(6.0f, 5.0f, 6.0f) * XMMatrixTranslation(6.0f, 7.5f, -5.0f));
-	cyl2Ritem->ObjCBIndex = 3;
-	cyl2Ritem->Mat = mMaterials["castle2"].get();
-	cyl2Ritem->Geo = mGeometries["cylinderGeo"].get();
-	cyl2Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	cyl2Ritem->IndexCount = cyl2Ritem->Geo->DrawArgs["cylinder"].IndexCount;
-	cyl2Ritem->StartIndexLocation = cyl2Ritem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-	cyl2Ritem->BaseVertexLocation = cyl2Ritem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(cyl2Ritem.get());
-	mAllRitems.push_back(std::move(cyl2Ritem));
-
-	//LeftBack Cylinder
-	auto cyl3Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&cyl3Ritem->World, XMMatrixScaling(6.0f, 5.0f, 6.0f) * XMMatrixTranslation(-6.0f, 7.5f, 5.0f));
-	cyl3Ritem->ObjCBIndex = 4;
-	cyl3Ritem->Mat = mMaterials["castle2"].get();
-	cyl3Ritem->Geo = mGeometries["cylinderGeo"].get();
-	cyl3Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	cyl3Ritem->IndexCount = cyl3Ritem->Geo->DrawArgs["cylinder"].IndexCount;
-	cyl3Ritem->StartIndexLocation = cyl3Ritem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-	cyl3Ritem->BaseVertexLocation = cyl3Ritem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(cyl3Ritem.get());
-	mAllRitems.push_back(std::move(cyl3Ritem));
-
-	//RightBack Cylinder
-	auto cyl4Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&cyl4Ritem->World, XMMatrixScaling(6.0f, 5.0f, 6.0f) * XMMatrixTranslation(6.0f, 7.5f, 5.0f));
-	cyl4Ritem->ObjCBIndex = 5;
-	cyl4Ritem->Mat = mMaterials["castle2"].get();
-	cyl4Ritem->Geo = mGeometries["cylinderGeo"].get();
-	cyl4Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	cyl4Ritem->IndexCount = cyl4Ritem->Geo->DrawArgs["cylinder"].IndexCount;
-	cyl4Ritem->StartIndexLocation = cyl4Ritem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-	cyl4Ritem->BaseVertexLocation = cyl4Ritem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(cyl4Ritem.get());
-	mAllRitems.push_back(std::move(cyl4Ritem));
-
-	//LeftMost Pyramid Front
-	auto pyrRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyrRitem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(-3.0f, 12.5f, -4.5f));
-	pyrRitem->ObjCBIndex = 6;
-	pyrRitem->Mat = mMaterials["wirefence"].get();
-	pyrRitem->Geo = mGeometries["pyramidGeo"].get();
-	pyrRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyrRitem->IndexCount = pyrRitem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyrRitem->StartIndexLocation = pyrRitem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyrRitem->BaseVertexLocation = pyrRitem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(pyrRitem.get());
-	mAllRitems.push_back(std::move(pyrRitem));
-
-	//SecondLeft Pyramid Front
-	auto pyr2Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyr2Ritem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(-1.5f, 12.5f, -4.5f));
-	pyr2Ritem->ObjCBIndex = 7;
-	pyr2Ritem->Mat = mMaterials["wirefence"].get();
-	pyr2Ritem->Geo = mGeometries["pyramidGeo"].get();
-	pyr2Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyr2Ritem->IndexCount = pyr2Ritem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyr2Ritem->StartIndexLocation = pyr2Ritem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyr2Ritem->BaseVertexLocation = pyr2Ritem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(pyr2Ritem.get());
-	mAllRitems.push_back(std::move(pyr2Ritem));
-
-	//Center Pyramid Front
-	auto pyr3Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyr3Ritem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(0.0f, 12.5f, -4.5f));
-	pyr3Ritem->ObjCBIndex = 8;
-	pyr3Ritem->Mat = mMaterials["wirefence"].get();
-	pyr3Ritem->Geo = mGeometries["pyramidGeo"].get();
-	pyr3Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyr3Ritem->IndexCount = pyr3Ritem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyr3Ritem->StartIndexLocation = pyr3Ritem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyr3Ritem->BaseVertexLocation = pyr3Ritem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(pyr3Ritem.get());
-	mAllRitems.push_back(std::move(pyr3Ritem));
-
-	//SecondRight Pyramid Front
-	auto pyr4Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyr4Ritem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(1.5f, 12.5f, -4.5f));
-	pyr4Ritem->ObjCBIndex = 9;
-	pyr4Ritem->Mat = mMaterials["wirefence"].get();
-	pyr4Ritem->Geo = mGeometries["pyramidGeo"].get();
-	pyr4Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyr4Ritem->IndexCount = pyr4Ritem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyr4Ritem->StartIndexLocation = pyr4Ritem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyr4Ritem->BaseVertexLocation = pyr4Ritem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(pyr4Ritem.get());
-	mAllRitems.push_back(std::move(pyr4Ritem));
-
-	//RightMost Pyramid Front
-	auto pyr5Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyr5Ritem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(3.0f, 12.5f, -4.5f));
-	pyr5Ritem->ObjCBIndex = 10;
-	pyr5Ritem->Mat = mMaterials["wirefence"].get();
-	pyr5Ritem->Geo = mGeometries["pyramidGeo"].get();
-	pyr5Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyr5Ritem->IndexCount = pyr5Ritem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyr5Ritem->StartIndexLocation = pyr5Ritem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyr5Ritem->BaseVertexLocation = pyr5Ritem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(pyr5Ritem.get());
-	mAllRitems.push_back(std::move(pyr5Ritem));
-
-	//Front Pyramid Left
-	auto pyr6Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyr6Ritem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(-4.5f, 12.5f, -1.5f));
-	pyr6Ritem->ObjCBIndex = 11;
-	pyr6Ritem->Mat = mMaterials["wirefence"].get();
-	pyr6Ritem->Geo = mGeometries["pyramidGeo"].get();
-	pyr6Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyr6Ritem->IndexCount = pyr6Ritem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyr6Ritem->StartIndexLocation = pyr6Ritem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyr6Ritem->BaseVertexLocation = pyr6Ritem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(pyr6Ritem.get());
-	mAllRitems.push_back(std::move(pyr6Ritem));
-
-	//Mid Pyramid Left
-	auto pyr7Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyr7Ritem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(-4.5f, 12.5f, 0.0f));
-	pyr7Ritem->ObjCBIndex = 12;
-	pyr7Ritem->Mat = mMaterials["wirefence"].get();
-	pyr7Ritem->Geo = mGeometries["pyramidGeo"].get();
-	pyr7Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyr7Ritem->IndexCount = pyr7Ritem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyr7Ritem->StartIndexLocation = pyr7Ritem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyr7Ritem->BaseVertexLocation = pyr7Ritem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(pyr7Ritem.get());
-	mAllRitems.push_back(std::move(pyr7Ritem));
-
-	//Back Pyramid Left
-	auto pyr8Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyr8Ritem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(-4.5f, 12.5f, +1.5f));
-	pyr8Ritem->ObjCBIndex = 13;
-	pyr8Ritem->Mat = mMaterials["wirefence"].get();
-	pyr8Ritem->Geo = mGeometries["pyramidGeo"].get();
-	pyr8Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyr8Ritem->IndexCount = pyr8Ritem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyr8Ritem->StartIndexLocation = pyr8Ritem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyr8Ritem->BaseVertexLocation = pyr8Ritem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(pyr8Ritem.get());
-	mAllRitems.push_back(std::move(pyr8Ritem));
-
-	//LeftMost Pyramid Back
-	auto pyr9Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyr9Ritem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(-3.0f, 12.5f, 4.5f));
-	pyr9Ritem->ObjCBIndex = 14;
-	pyr9Ritem->Mat = mMaterials["wirefence"].get();
-	pyr9Ritem->Geo = mGeometries["pyramidGeo"].get();
-	pyr9Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyr9Ritem->IndexCount = pyr9Ritem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyr9Ritem->StartIndexLocation = pyr9Ritem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyr9Ritem->BaseVertexLocation = pyr9Ritem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(pyr9Ritem.get());
-	mAllRitems.push_back(std::move(pyr9Ritem));
-
-	//SecondLeft Pyramid Back
-	auto pyr10Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyr10Ritem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(-1.5f, 12.5f, 4.5f));
-	pyr10Ritem->ObjCBIndex = 15;
-	pyr10Ritem->Mat = mMaterials["wirefence"].get();
-	pyr10Ritem->Geo = mGeometries["pyramidGeo"].get();
-	pyr10Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyr10Ritem->IndexCount = pyr10Ritem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyr10Ritem->StartIndexLocation = pyr10Ritem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyr10Ritem->BaseVertexLocation = pyr10Ritem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(pyr10Ritem.get());
-	mAllRitems.push_back(std::move(pyr10Ritem));
-
-	//Mid Pyramid Back
-	auto pyr11Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyr11Ritem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(0.0f, 12.5f, 4.5f));
-	pyr11Ritem->ObjCBIndex = 16;
-	pyr11Ritem->Mat = mMaterials["wirefence"].get();
-	pyr11Ritem->Geo = mGeometries["pyramidGeo"].get();
-	pyr11Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyr11Ritem->IndexCount = pyr11Ritem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyr11Ritem->StartIndexLocation = pyr11Ritem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyr11Ritem->BaseVertexLocation = pyr11Ritem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(pyr11Ritem.get());
-	mAllRitems.push_back(std::move(pyr11Ritem));
-
-	//SecondRight Pyramid Back
-	auto pyr12Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyr12Ritem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(1.5f, 12.5f, 4.5f));
-	pyr12Ritem->ObjCBIndex = 17;
-	pyr12Ritem->Mat = mMaterials["wirefence"].get();
-	pyr12Ritem->Geo = mGeometries["pyramidGeo"].get();
-	pyr12Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyr12Ritem->IndexCount = pyr12Ritem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyr12Ritem->StartIndexLocation = pyr12Ritem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyr12Ritem->BaseVertexLocation = pyr12Ritem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(pyr12Ritem.get());
-	mAllRitems.push_back(std::move(pyr12Ritem));
-
-	//RightMost Pyramid Back
-	auto pyr13Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyr13Ritem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(3.0f, 12.5f, 4.5f));
-	pyr13Ritem->ObjCBIndex = 18;
-	pyr13Ritem->Mat = mMaterials["wirefence"].get();
-	pyr13Ritem->Geo = mGeometries["pyramidGeo"].get();
-	pyr13Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyr13Ritem->IndexCount = pyr13Ritem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyr13Ritem->StartIndexLocation = pyr13Ritem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyr13Ritem->BaseVertexLocation = pyr13Ritem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(pyr13Ritem.get());
-	mAllRitems.push_back(std::move(pyr13Ritem));
-
-	//Front Pyramid Right
-	auto pyr14Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyr14Ritem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(4.5f, 12.5f, -1.5f));
-	pyr14Ritem->ObjCBIndex = 19;
-	pyr14Ritem->Mat = mMaterials["wirefence"].get();
-	pyr14Ritem->Geo = mGeometries["pyramidGeo"].get();
-	pyr14Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyr14Ritem->IndexCount = pyr14Ritem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyr14Ritem->StartIndexLocation = pyr14Ritem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyr14Ritem->BaseVertexLocation = pyr14Ritem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(pyr14Ritem.get());
-	mAllRitems.push_back(std::move(pyr14Ritem));
-
-	//Mid Pyramid Right
-	auto pyr15Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyr15Ritem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(4.5f, 12.5f, 0.0f));
-	pyr15Ritem->ObjCBIndex = 20;
-	pyr15Ritem->Mat = mMaterials["wirefence"].get();
-	pyr15Ritem->Geo = mGeometries["pyramidGeo"].get();
-	pyr15Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyr15Ritem->IndexCount = pyr15Ritem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyr15Ritem->StartIndexLocation = pyr15Ritem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyr15Ritem->BaseVertexLocation = pyr15Ritem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(pyr15Ritem.get());
-	mAllRitems.push_back(std::move(pyr15Ritem));
-
-	//Back Pyramid Right
-	auto pyr16Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyr16Ritem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(4.5f, 12.5f, 1.5f));
-	pyr16Ritem->ObjCBIndex = 21;
-	pyr16Ritem->Mat = mMaterials["wirefence"].get();
-	pyr16Ritem->Geo = mGeometries["pyramidGeo"].get();
-	pyr16Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyr16Ritem->IndexCount = pyr16Ritem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyr16Ritem->StartIndexLocation = pyr16Ritem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyr16Ritem->BaseVertexLocation = pyr16Ritem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(pyr16Ritem.get());
-	mAllRitems.push_back(std::move(pyr16Ritem));
-
-	//
-	//Wedge left
-	auto wedgeRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&wedgeRitem->World, XMMatrixScaling(0.5f, 5.0f, 6.0f) * XMMatrixTranslation(-3.0f, 2.5f, -8.0f));
-	wedgeRitem->ObjCBIndex = 22;
-	wedgeRitem->Mat = mMaterials["wirefence"].get();
-	wedgeRitem->Geo = mGeometries["wedgeGeo"].get();
-	wedgeRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	wedgeRitem->IndexCount = wedgeRitem->Geo->DrawArgs["wedge"].IndexCount;
-	wedgeRitem->StartIndexLocation = wedgeRitem->Geo->DrawArgs["wedge"].StartIndexLocation;
-	wedgeRitem->BaseVertexLocation = wedgeRitem->Geo->DrawArgs["wedge"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(wedgeRitem.get());
-	mAllRitems.push_back(std::move(wedgeRitem));
-
-	//Wedge Right
-	auto wedge1Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&wedge1Ritem->World, XMMatrixScaling(0.5f, 5.0f, 6.0f) * XMMatrixTranslation(3.0f, 2.5f, -8.0f));
-	wedge1Ritem->ObjCBIndex = 23;
-	wedge1Ritem->Mat = mMaterials["wirefence"].get();
-	wedge1Ritem->Geo = mGeometries["wedgeGeo"].get();
-	wedge1Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	wedge1Ritem->IndexCount = wedge1Ritem->Geo->DrawArgs["wedge"].IndexCount;
-	wedge1Ritem->StartIndexLocation = wedge1Ritem->Geo->DrawArgs["wedge"].StartIndexLocation;
-	wedge1Ritem->BaseVertexLocation = wedge1Ritem->Geo->DrawArgs["wedge"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(wedge1Ritem.get());
-	mAllRitems.push_back(std::move(wedge1Ritem));
-
-	//Bridge box
-	auto bridgeBoxRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&bridgeBoxRitem->World, XMMatrixScaling(6.0f, 0.5f, 6.0f) * XMMatrixTranslation(0.0f, 0.0f, -8.0f));
-	bridgeBoxRitem->ObjCBIndex = 24;
-	bridgeBoxRitem->Mat = mMaterials["castle"].get();
-	bridgeBoxRitem->Geo = mGeometries["boxGeo"].get();
-	bridgeBoxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	bridgeBoxRitem->IndexCount = bridgeBoxRitem->Geo->DrawArgs["box"].IndexCount;
-	bridgeBoxRitem->StartIndexLocation = bridgeBoxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-	bridgeBoxRitem->BaseVertexLocation = bridgeBoxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(bridgeBoxRitem.get());
-	mAllRitems.push_back(std::move(bridgeBoxRitem));
-
-	//Diamond
-	auto diamondRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&diamondRitem->World, XMMatrixScaling(1.0f, 1.0f, 0.5f) * XMMatrixTranslation(0.0f, 11.0f, -5.0f));
-	diamondRitem->ObjCBIndex = 25;
-	diamondRitem->Mat = mMaterials["water"].get();
-	diamondRitem->Geo = mGeometries["diamondGeo"].get();
-	diamondRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	diamondRitem->IndexCount = diamondRitem->Geo->DrawArgs["diamond"].IndexCount;
-	diamondRitem->StartIndexLocation = diamondRitem->Geo->DrawArgs["diamond"].StartIndexLocation;
-	diamondRitem->BaseVertexLocation = diamondRitem->Geo->DrawArgs["diamond"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(diamondRitem.get());
-	mAllRitems.push_back(std::move(diamondRitem));
+	//RenderItem boxRitem;
+
+	////XMStoreFloat4x4(&boxRitem.World, XMMatrixScaling(10.0f, 12.0f, 10.0f) * XMMatrixTranslation(0.0f, 6.0f, 0.0f));
+	//XMStoreFloat4x4(&boxRitem.World, XMMatrixScaling(1.0f, 6.0f, 1.0f) * XMMatrixTranslation(0.0f, 6.0f, 0.0f));
+	//boxRitem.ObjCBIndex = 1;
+	//boxRitem.Mat = mMaterials["wirefence"].get();
+	//boxRitem.Geo = mGeometries["shapeGeo"].get();
+	//boxRitem.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	//boxRitem.IndexCount = boxRitem.Geo->DrawArgs["wedge"].IndexCount;
+	//boxRitem.StartIndexLocation = boxRitem.Geo->DrawArgs["wedge"].StartIndexLocation;
+	//boxRitem.BaseVertexLocation = boxRitem.Geo->DrawArgs["wedge"].BaseVertexLocation;
+	//mRitems->Add((UINT)RenderLayer::Opaque, boxRitem);
+
+	// Items are given ObjectCB elements in the order they are built.
+	UINT objCBIndex = 0;
+
+	//Terrain, the castle grounds and the lake bed included
+	RenderItem terrainRitem;
+	terrainRitem.World = MathHelper::Identity4x4();
+	XMStoreFloat4x4(&terrainRitem.TexTransform, XMMatrixScaling(0.0625f, 0.0625f, 1.0f));
+	terrainRitem.ObjCBIndex = objCBIndex++;
+	terrainRitem.Mat = mMaterials["grass"].get();
+	terrainRitem.Geo = mGeometries["terrainGeo"].get();
+	terrainRitem.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	terrainRitem.IndexCount = terrainRitem.Geo->DrawArgs["tile"].IndexCount;
+	terrainRitem.StartIndexLocation = terrainRitem.Geo->DrawArgs["tile"].StartIndexLocation;
+	terrainRitem.BaseVertexLocation = terrainRitem.Geo->DrawArgs["tile"].BaseVertexLocation;
+	terrainRitem.Bounds = mTerrain->Bounds();
+	terrainRitem.DisplacementMapTexelSize = XMFLOAT2(1.0f / mTerrain->HeightResolution(), 1.0f / mTerrain->HeightResolution());
+	terrainRitem.GridSpatialStep = mTerrain->SpatialStep();
+	mTerrainRitem = mRitems->Add((UINT)RenderLayer::Terrain, terrainRitem);
+
+	// The castle, as placed in the compiled scene.
+	for(UINT i = 0; i < mScene->ItemCount(); ++i)
+	{
+		const SceneItem& item = mScene->Item(i);
+
+		auto mat = mMaterials.find(item.Material);
+		if(mat == mMaterials.end())
+			throw std::runtime_error(std::string("item ") + item.Name + ": unknown material " + item.Material);
+
+		// A shipped scene without its text was never checked by CompileScene.
+		RenderLayer layer = FindSceneLayer(item.Layer);
+		if(layer == RenderLayer::Count)
+			throw std::runtime_error(std::string("item ") + item.Name + ": unknown layer " + item.Layer);
+
+		MeshGeometry* geo = mGeometries["shapeGeo"].get();
+		auto submesh = geo->DrawArgs.find(item.Submesh);
+		if(submesh == geo->DrawArgs.end())
+			throw std::runtime_error(std::string("item ") + item.Name + ": unknown mesh " + item.Submesh);
+
+		RenderItem sceneRitem;
+		sceneRitem.World = item.World;
+		sceneRitem.ObjCBIndex = objCBIndex++;
+		sceneRitem.Mat = mat->second.get();
+		sceneRitem.Geo = geo;
+		sceneRitem.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		sceneRitem.IndexCount = submesh->second.IndexCount;
+		sceneRitem.StartIndexLocation = submesh->second.StartIndexLocation;
+		sceneRitem.BaseVertexLocation = submesh->second.BaseVertexLocation;
+		sceneRitem.Bounds = submesh->second.Bounds;
+		mRitems->Add((UINT)layer, sceneRitem);
+	}
 
 	//Water
-   auto wavesRitem = std::make_unique<RenderItem>();
-   wavesRitem->World = MathHelper::Identity4x4();
-   XMStoreFloat4x4(&wavesRitem->TexTransform, XMMatrixScaling(1.0f, 1.0f, 1.0f));
-   wavesRitem->ObjCBIndex = 26;
-   wavesRitem->Mat = mMaterials["water"].get();
-   wavesRitem->Geo = mGeometries["waterGeo"].get();
-   wavesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   wavesRitem->IndexCount = wavesRitem->Geo->DrawArgs["grid"].IndexCount;
-   wavesRitem->StartIndexLocation = wavesRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-   wavesRitem->BaseVertexLocation = wavesRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-   mWavesRitem = wavesRitem.get();
-   mRitemLayer[(int)RenderLayer::Transparent].push_back(wavesRitem.get());
-   mAllRitems.push_back(std::move(wavesRitem));
-
-   
-	//UnderGround
-   auto gridURitem = std::make_unique<RenderItem>();
-   gridURitem->World = MathHelper::Identity4x4();
-   XMStoreFloat4x4(&gridURitem->TexTransform, XMMatrixScaling(0.5f, 0.5f, 2.0f)* XMMatrixTranslation(0.0f, 6.0f, 0.0f));
-   gridURitem->ObjCBIndex = 28;
-   gridURitem->Mat = mMaterials["dirt"].get();
-   gridURitem->Geo = mGeometries["landUGeo"].get();
-   gridURitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   gridURitem->IndexCount = gridURitem->Geo->DrawArgs["grid"].IndexCount;
-   gridURitem->StartIndexLocation = gridURitem->Geo->DrawArgs["grid"].StartIndexLocation;
-   gridURitem->BaseVertexLocation = gridURitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(gridURitem.get());
-   mAllRitems.push_back(std::move(gridURitem));
-
-   //FrontLeftWindow
-   auto windowFLitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&windowFLitem->World, XMMatrixScaling(2.5f, 2.0f, 0.5f)* XMMatrixTranslation(-2.0f, 9.0f,-4.8f));
-   windowFLitem->ObjCBIndex = 29;
-   windowFLitem->Mat = mMaterials["window"].get();
-   windowFLitem->Geo = mGeometries["boxGeo"].get();
-   windowFLitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   windowFLitem->IndexCount = windowFLitem->Geo->DrawArgs["box"].IndexCount;
-   windowFLitem->StartIndexLocation = windowFLitem->Geo->DrawArgs["box"].StartIndexLocation;
-   windowFLitem->BaseVertexLocation = windowFLitem->Geo->DrawArgs["box"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(windowFLitem.get());
-   mAllRitems.push_back(std::move(windowFLitem));
-
-   //FrontRightWindow
-   auto windowFRitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&windowFRitem->World, XMMatrixScaling(2.5f, 2.0f, 0.5f)* XMMatrixTranslation(2.0f, 9.0f, -4.8f));
-   windowFRitem->ObjCBIndex = 30;
-   windowFRitem->Mat = mMaterials["window"].get();
-   windowFRitem->Geo = mGeometries["boxGeo"].get();
-   windowFRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   windowFRitem->IndexCount = windowFRitem->Geo->DrawArgs["box"].IndexCount;
-   windowFRitem->StartIndexLocation = windowFRitem->Geo->DrawArgs["box"].StartIndexLocation;
-   windowFRitem->BaseVertexLocation = windowFRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(windowFRitem.get());
-   mAllRitems.push_back(std::move(windowFRitem));
-
-   //Door
-   auto doorRitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&doorRitem->World, XMMatrixScaling(5.5f, 5.0f, 0.5f)* XMMatrixTranslation(0.0f, 2.5f, -4.8f));
-   doorRitem->ObjCBIndex = 31;
-   doorRitem->Mat = mMaterials["window"].get();
-   doorRitem->Geo = mGeometries["boxGeo"].get();
-   doorRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   doorRitem->IndexCount = doorRitem->Geo->DrawArgs["box"].IndexCount;
-   doorRitem->StartIndexLocation = doorRitem->Geo->DrawArgs["box"].StartIndexLocation;
-   doorRitem->BaseVertexLocation = doorRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(doorRitem.get());
-   mAllRitems.push_back(std::move(doorRitem));
-
-   //DirtRoad
-   auto dirtRoadRitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&dirtRoadRitem->World, XMMatrixScaling(6.0f, 0.3f, 35.0f)* XMMatrixTranslation(0.0f, 0.0f, -22.5f));
-   dirtRoadRitem->ObjCBIndex = 32;
-   dirtRoadRitem->Mat = mMaterials["dirt"].get();
-   dirtRoadRitem->Geo = mGeometries["boxGeo"].get();
-   dirtRoadRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   dirtRoadRitem->IndexCount = dirtRoadRitem->Geo->DrawArgs["box"].IndexCount;
-   dirtRoadRitem->StartIndexLocation = dirtRoadRitem->Geo->DrawArgs["box"].StartIndexLocation;
-   dirtRoadRitem->BaseVertexLocation = dirtRoadRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(dirtRoadRitem.get());
-   mAllRitems.push_back(std::move(dirtRoadRitem));
-
-   //LeftFront Cone
-   auto cone1Ritem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&cone1Ritem->World, XMMatrixScaling(5.0f, 1.0f, 5.0f)* XMMatrixTranslation(-6.0f, 16.5f, -5.0f));
-   cone1Ritem->ObjCBIndex = 33;
-   cone1Ritem->Mat = mMaterials["wirefence"].get();
-   cone1Ritem->Geo = mGeometries["coneGeo"].get();
-   cone1Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   cone1Ritem->IndexCount = cone1Ritem->Geo->DrawArgs["cone"].IndexCount;
-   cone1Ritem->StartIndexLocation = cone1Ritem->Geo->DrawArgs["cone"].StartIndexLocation;
-   cone1Ritem->BaseVertexLocation = cone1Ritem->Geo->DrawArgs["cone"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(cone1Ritem.get());
-   mAllRitems.push_back(std::move(cone1Ritem));
-
-   //RightFront Cone
-   auto cone2Ritem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&cone2Ritem->World, XMMatrixScaling(5.0f, 1.0f, 5.0f)* XMMatrixTranslation(6.0f, 16.5f, -5.0f));
-   cone2Ritem->ObjCBIndex = 34;
-   cone2Ritem->Mat = mMaterials["wirefence"].get();
-   cone2Ritem->Geo = mGeometries["coneGeo"].get();
-   cone2Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   cone2Ritem->IndexCount = cone2Ritem->Geo->DrawArgs["cone"].IndexCount;
-   cone2Ritem->StartIndexLocation = cone2Ritem->Geo->DrawArgs["cone"].StartIndexLocation;
-   cone2Ritem->BaseVertexLocation = cone2Ritem->Geo->DrawArgs["cone"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(cone2Ritem.get());
-   mAllRitems.push_back(std::move(cone2Ritem));
-
-   //LeftBack Cone
-   auto cone3Ritem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&cone3Ritem->World, XMMatrixScaling(5.0f, 1.0f, 5.0f)* XMMatrixTranslation(-6.0f, 16.5f, 5.0f));
-   cone3Ritem->ObjCBIndex = 35;
-   cone3Ritem->Mat = mMaterials["wirefence"].get();
-   cone3Ritem->Geo = mGeometries["coneGeo"].get();
-   cone3Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   cone3Ritem->IndexCount = cone3Ritem->Geo->DrawArgs["cone"].IndexCount;
-   cone3Ritem->StartIndexLocation = cone3Ritem->Geo->DrawArgs["cone"].StartIndexLocation;
-   cone3Ritem->BaseVertexLocation = cone3Ritem->Geo->DrawArgs["cone"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(cone3Ritem.get());
-   mAllRitems.push_back(std::move(cone3Ritem));
-
-   //RightBack Cone
-   auto cone4Ritem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&cone4Ritem->World, XMMatrixScaling(5.0f, 1.0f, 5.0f)* XMMatrixTranslation(6.0f, 16.5f, 5.0f));
-   cone4Ritem->ObjCBIndex = 36;
-   cone4Ritem->Mat = mMaterials["wirefence"].get();
-   cone4Ritem->Geo = mGeometries["coneGeo"].get();
-   cone4Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   cone4Ritem->IndexCount = cone4Ritem->Geo->DrawArgs["cone"].IndexCount;
-   cone4Ritem->StartIndexLocation = cone4Ritem->Geo->DrawArgs["cone"].StartIndexLocation;
-   cone4Ritem->BaseVertexLocation = cone4Ritem->Geo->DrawArgs["cone"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(cone4Ritem.get());
-   mAllRitems.push_back(std::move(cone4Ritem));
-
-   //Bridge Big box
-   auto bridgeBigRitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&bridgeBigRitem->World, XMMatrixScaling(10.0f, 0.5f, 30.0f)* XMMatrixTranslation(0.0f, 0.0f, -49.0f));
-   bridgeBigRitem->ObjCBIndex = 37;
-   bridgeBigRitem->Mat = mMaterials["castle"].get();
-   bridgeBigRitem->Geo = mGeometries["boxGeo"].get();
-   bridgeBigRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   bridgeBigRitem->IndexCount = bridgeBigRitem->Geo->DrawArgs["box"].IndexCount;
-   bridgeBigRitem->StartIndexLocation = bridgeBigRitem->Geo->DrawArgs["box"].StartIndexLocation;
-   bridgeBigRitem->BaseVertexLocation = bridgeBigRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(bridgeBigRitem.get());
-   mAllRitems.push_back(std::move(bridgeBigRitem));
-
-   //LeftFrontGate Cylinder
-   auto cylGateLRitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&cylGateLRitem->World, XMMatrixScaling(6.0f, 4.0f, 6.0f)* XMMatrixTranslation(-6.0f, 6.0f, -37.0f));
-   cylGateLRitem->ObjCBIndex = 38;
-   cylGateLRitem->Mat = mMaterials["castle"].get();
-   cylGateLRitem->Geo = mGeometries["cylinderGeo"].get();
-   cylGateLRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   cylGateLRitem->IndexCount = cylGateLRitem->Geo->DrawArgs["cylinder"].IndexCount;
-   cylGateLRitem->StartIndexLocation = cylGateLRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-   cylGateLRitem->BaseVertexLocation = cylGateLRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(cylGateLRitem.get());
-   mAllRitems.push_back(std::move(cylGateLRitem));
-
-   //RightFrontGate Cylinder
-   auto cylGateRRitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&cylGateRRitem->World, XMMatrixScaling(6.0f, 4.0f, 6.0f)* XMMatrixTranslation(6.0f, 6.0f, -37.0f));
-   cylGateRRitem->ObjCBIndex = 39;
-   cylGateRRitem->Mat = mMaterials["castle"].get();
-   cylGateRRitem->Geo = mGeometries["cylinderGeo"].get();
-   cylGateRRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   cylGateRRitem->IndexCount = cylGateRRitem->Geo->DrawArgs["cylinder"].IndexCount;
-   cylGateRRitem->StartIndexLocation = cylGateRRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-   cylGateRRitem->BaseVertexLocation = cylGateRRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(cylGateRRitem.get());
-   mAllRitems.push_back(std::move(cylGateRRitem));
-
-   //LeftFrontGateW Cylinder
-   auto cylGateWLRitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&cylGateWLRitem->World, XMMatrixScaling(6.0f, 4.0f, 6.0f)* XMMatrixTranslation(-18.0f, 6.0f, -37.0f));
-   cylGateWLRitem->ObjCBIndex = 40;
-   cylGateWLRitem->Mat = mMaterials["castle"].get();
-   cylGateWLRitem->Geo = mGeometries["cylinderGeo"].get();
-   cylGateWLRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   cylGateWLRitem->IndexCount = cylGateWLRitem->Geo->DrawArgs["cylinder"].IndexCount;
-   cylGateWLRitem->StartIndexLocation = cylGateWLRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-   cylGateWLRitem->BaseVertexLocation = cylGateWLRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(cylGateWLRitem.get());
-   mAllRitems.push_back(std::move(cylGateWLRitem));
-
-   //RightFrontGateW Cylinder
-   auto cylGateRWRitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&cylGateRWRitem->World, XMMatrixScaling(6.0f, 4.0f, 6.0f)* XMMatrixTranslation(18.0f, 6.0f, -37.0f));
-   cylGateRWRitem->ObjCBIndex = 41;
-   cylGateRWRitem->Mat = mMaterials["castle"].get();
-   cylGateRWRitem->Geo = mGeometries["cylinderGeo"].get();
-   cylGateRWRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   cylGateRWRitem->IndexCount = cylGateRWRitem->Geo->DrawArgs["cylinder"].IndexCount;
-   cylGateRWRitem->StartIndexLocation = cylGateRWRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-   cylGateRWRitem->BaseVertexLocation = cylGateRWRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(cylGateRWRitem.get());
-   mAllRitems.push_back(std::move(cylGateRWRitem));
-
-   //LeftBackGateW Cylinder
-   auto cylGateWLBRitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&cylGateWLBRitem->World, XMMatrixScaling(6.0f, 4.0f, 6.0f)* XMMatrixTranslation(-18.0f, 6.0f, 20.0f));
-   cylGateWLBRitem->ObjCBIndex = 42;
-   cylGateWLBRitem->Mat = mMaterials["castle"].get();
-   cylGateWLBRitem->Geo = mGeometries["cylinderGeo"].get();
-   cylGateWLBRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   cylGateWLBRitem->IndexCount = cylGateWLBRitem->Geo->DrawArgs["cylinder"].IndexCount;
-   cylGateWLBRitem->StartIndexLocation = cylGateWLBRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-   cylGateWLBRitem->BaseVertexLocation = cylGateWLBRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(cylGateWLBRitem.get());
-   mAllRitems.push_back(std::move(cylGateWLBRitem));
-
-   //RightBackGateW Cylinder
-   auto cylGateRWBRitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&cylGateRWBRitem->World, XMMatrixScaling(6.0f, 4.0f, 6.0f)* XMMatrixTranslation(18.0f, 6.0f, 20.0f));
-   cylGateRWBRitem->ObjCBIndex = 43;
-   cylGateRWBRitem->Mat = mMaterials["castle"].get();
-   cylGateRWBRitem->Geo = mGeometries["cylinderGeo"].get();
-   cylGateRWBRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   cylGateRWBRitem->IndexCount = cylGateRWBRitem->Geo->DrawArgs["cylinder"].IndexCount;
-   cylGateRWBRitem->StartIndexLocation = cylGateRWBRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-   cylGateRWBRitem->BaseVertexLocation = cylGateRWBRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(cylGateRWBRitem.get());
-   mAllRitems.push_back(std::move(cylGateRWBRitem));
-
-   //Front Uper Wall
-   auto outerWallFrontTopRitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&outerWallFrontTopRitem->World, XMMatrixScaling(10.0f, 4.0f, 3.0f)* XMMatrixTranslation(0.0f, 8.0f, -37.0f));
-   outerWallFrontTopRitem->ObjCBIndex = 44;
-   outerWallFrontTopRitem->Mat = mMaterials["castle"].get();
-   outerWallFrontTopRitem->Geo = mGeometries["boxGeo"].get();
-   outerWallFrontTopRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   outerWallFrontTopRitem->IndexCount = outerWallFrontTopRitem->Geo->DrawArgs["box"].IndexCount;
-   outerWallFrontTopRitem->StartIndexLocation = outerWallFrontTopRitem->Geo->DrawArgs["box"].StartIndexLocation;
-   outerWallFrontTopRitem->BaseVertexLocation = outerWallFrontTopRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(outerWallFrontTopRitem.get());
-   mAllRitems.push_back(std::move(outerWallFrontTopRitem));
-
-   //OuterFrontRightWall
-   auto outerWallFrontBRRitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&outerWallFrontBRRitem->World, XMMatrixScaling(15.0f, 10.0f, 3.0f)* XMMatrixTranslation(10.0f, 5.0f, -37.0f));
-   outerWallFrontBRRitem->ObjCBIndex = 45;
-   outerWallFrontBRRitem->Mat = mMaterials["castle"].get();
-   outerWallFrontBRRitem->Geo = mGeometries["boxGeo"].get();
-   outerWallFrontBRRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   outerWallFrontBRRitem->IndexCount = outerWallFrontBRRitem->Geo->DrawArgs["box"].IndexCount;
-   outerWallFrontBRRitem->StartIndexLocation = outerWallFrontBRRitem->Geo->DrawArgs["box"].StartIndexLocation;
-   outerWallFrontBRRitem->BaseVertexLocation = outerWallFrontBRRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(outerWallFrontBRRitem.get());
-   mAllRitems.push_back(std::move(outerWallFrontBRRitem));
-
-   //OuterFrontLeftWall
-   auto outerWallFrontBLRitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&outerWallFrontBLRitem->World, XMMatrixScaling(15.0f, 10.0f, 3.0f)* XMMatrixTranslation(-10.0f, 5.0f, -37.0f));
-   outerWallFrontBLRitem->ObjCBIndex = 46;
-   outerWallFrontBLRitem->Mat = mMaterials["castle"].get();
-   outerWallFrontBLRitem->Geo = mGeometries["boxGeo"].get();
-   outerWallFrontBLRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   outerWallFrontBLRitem->IndexCount = outerWallFrontBLRitem->Geo->DrawArgs["box"].IndexCount;
-   outerWallFrontBLRitem->StartIndexLocation = outerWallFrontBLRitem->Geo->DrawArgs["box"].StartIndexLocation;
-   outerWallFrontBLRitem->BaseVertexLocation = outerWallFrontBLRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(outerWallFrontBLRitem.get());
-   mAllRitems.push_back(std::move(outerWallFrontBLRitem));
-
-   //OuterBackWall
-   auto outerWallBackRitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&outerWallBackRitem->World, XMMatrixScaling(36.0f, 10.0f, 3.0f)* XMMatrixTranslation(0.0f, 5.0f, 20.0f));
-   outerWallBackRitem->ObjCBIndex = 47;
-   outerWallBackRitem->Mat = mMaterials["castle"].get();
-   outerWallBackRitem->Geo = mGeometries["boxGeo"].get();
-   outerWallBackRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   outerWallBackRitem->IndexCount = outerWallBackRitem->Geo->DrawArgs["box"].IndexCount;
-   outerWallBackRitem->StartIndexLocation = outerWallBackRitem->Geo->DrawArgs["box"].StartIndexLocation;
-   outerWallBackRitem->BaseVertexLocation = outerWallBackRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(outerWallBackRitem.get());
-   mAllRitems.push_back(std::move(outerWallBackRitem));
-
-   //OuterRightWall
-   auto outerWallRightRitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&outerWallRightRitem->World, XMMatrixScaling(3.0f, 10.0f, 57.0f)* XMMatrixTranslation(18.0f, 5.0f, -10.0f));
-   outerWallRightRitem->ObjCBIndex = 48;
-   outerWallRightRitem->Mat = mMaterials["castle"].get();
-   outerWallRightRitem->Geo = mGeometries["boxGeo"].get();
-   outerWallRightRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   outerWallRightRitem->IndexCount = outerWallRightRitem->Geo->DrawArgs["box"].IndexCount;
-   outerWallRightRitem->StartIndexLocation = outerWallRightRitem->Geo->DrawArgs["box"].StartIndexLocation;
-   outerWallRightRitem->BaseVertexLocation = outerWallRightRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(outerWallRightRitem.get());
-   mAllRitems.push_back(std::move(outerWallRightRitem));
-
-   //OuterLeftWall
-   auto outerWallLeftRitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&outerWallLeftRitem->World, XMMatrixScaling(3.0f, 10.0f, 57.0f)* XMMatrixTranslation(-18.0f, 5.0f, -10.0f));
-   outerWallLeftRitem->ObjCBIndex = 49;
-   outerWallLeftRitem->Mat = mMaterials["castle"].get();
-   outerWallLeftRitem->Geo = mGeometries["boxGeo"].get();
-   outerWallLeftRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   outerWallLeftRitem->IndexCount = outerWallLeftRitem->Geo->DrawArgs["box"].IndexCount;
-   outerWallLeftRitem->StartIndexLocation = outerWallLeftRitem->Geo->DrawArgs["box"].StartIndexLocation;
-   outerWallLeftRitem->BaseVertexLocation = outerWallLeftRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(outerWallLeftRitem.get());
-   mAllRitems.push_back(std::move(outerWallLeftRitem));
-
-   //Bridge Right Big box
-   auto bridgeBigRightRitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&bridgeBigRightRitem->World, XMMatrixScaling(1.0f, 2.0f, 30.0f)* XMMatrixTranslation(4.5f, 1.0f, -49.0f));
-   bridgeBigRightRitem->ObjCBIndex = 50;
-   bridgeBigRightRitem->Mat = mMaterials["castle"].get();
-   bridgeBigRightRitem->Geo = mGeometries["boxGeo"].get();
-   bridgeBigRightRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   bridgeBigRightRitem->IndexCount = bridgeBigRightRitem->Geo->DrawArgs["box"].IndexCount;
-   bridgeBigRightRitem->StartIndexLocation = bridgeBigRightRitem->Geo->DrawArgs["box"].StartIndexLocation;
-   bridgeBigRightRitem->BaseVertexLocation = bridgeBigRightRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(bridgeBigRightRitem.get());
-   mAllRitems.push_back(std::move(bridgeBigRightRitem));
-
-   //Bridge Left Big box
-   auto bridgeBigLeftRitem = std::make_unique<RenderItem>();
-   XMStoreFloat4x4(&bridgeBigLeftRitem->World, XMMatrixScaling(1.0f, 2.0f, 30.0f)* XMMatrixTranslation(-4.5f, 1.0f, -49.0f));
-   bridgeBigLeftRitem->ObjCBIndex = 51;
-   bridgeBigLeftRitem->Mat = mMaterials["castle"].get();
-   bridgeBigLeftRitem->Geo = mGeometries["boxGeo"].get();
-   bridgeBigLeftRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-   bridgeBigLeftRitem->IndexCount = bridgeBigLeftRitem->Geo->DrawArgs["box"].IndexCount;
-   bridgeBigLeftRitem->StartIndexLocation = bridgeBigLeftRitem->Geo->DrawArgs["box"].StartIndexLocation;
-   bridgeBigLeftRitem->BaseVertexLocation = bridgeBigLeftRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-   mRitemLayer[(int)RenderLayer::Opaque].push_back(bridgeBigLeftRitem.get());
-   mAllRitems.push_back(std::move(bridgeBigLeftRitem));
+   RenderItem wavesRitem;
+   wavesRitem.World = MathHelper::Identity4x4();
+   XMStoreFloat4x4(&wavesRitem.TexTransform, XMMatrixScaling(1.0f, 1.0f, 1.0f));
+   wavesRitem.ObjCBIndex = objCBIndex++;
+   wavesRitem.Mat = mMaterials["water"].get();
+   wavesRitem.Geo = mGeometries["waterGeo"].get();
+   wavesRitem.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+   wavesRitem.IndexCount = wavesRitem.Geo->DrawArgs["grid"].IndexCount;
+   wavesRitem.StartIndexLocation = wavesRitem.Geo->DrawArgs["grid"].StartIndexLocation;
+   wavesRitem.BaseVertexLocation = wavesRitem.Geo->DrawArgs["grid"].BaseVertexLocation;
+   wavesRitem.Bounds = wavesRitem.Geo->DrawArgs["grid"].Bounds;
+   // Both water items are kept, only the one simulated is drawn.
+   mWavesRitem = mRitems->Add(mUseGpuWaves ? (UINT)RenderLayer::Count : (UINT)RenderLayer::CpuWaves, wavesRitem);
+
+   RenderItem gpuWavesRitem;
+   gpuWavesRitem.World = MathHelper::Identity4x4();
+   XMStoreFloat4x4(&gpuWavesRitem.TexTransform, XMMatrixScaling(1.0f, 1.0f, 1.0f));
+   gpuWavesRitem.DisplacementMapTexelSize.x = 1.0f / mGpuWaves->ColumnCount();
+   gpuWavesRitem.DisplacementMapTexelSize.y = 1.0f / mGpuWaves->RowCount();
+   gpuWavesRitem.GridSpatialStep = mGpuWaves->SpatialStep();
+   gpuWavesRitem.ObjCBIndex = objCBIndex++;
+   gpuWavesRitem.Mat = mMaterials["water"].get();
+   gpuWavesRitem.Geo = mGeometries["gpuWaterGeo"].get();
+   gpuWavesRitem.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+   gpuWavesRitem.IndexCount = gpuWavesRitem.Geo->DrawArgs["grid"].IndexCount;
+   gpuWavesRitem.StartIndexLocation = gpuWavesRitem.Geo->DrawArgs["grid"].StartIndexLocation;
+   gpuWavesRitem.BaseVertexLocation = gpuWavesRitem.Geo->DrawArgs["grid"].BaseVertexLocation;
+   gpuWavesRitem.Bounds = gpuWavesRitem.Geo->DrawArgs["grid"].Bounds;
+   mRitems->Add(mUseGpuWaves ? (UINT)RenderLayer::GpuWaves : (UINT)RenderLayer::Count, gpuWavesRitem);
 
 
 	//
 	//TransparentPrism
-	//auto boxRitem = std::make_unique<RenderItem>();
-	//XMStoreFloat4x4(&boxRitem->World, XMMatrixTranslation(3.0f, 2.0f, -9.0f));
-	//boxRitem->ObjCBIndex = 2;
-	//boxRitem->Mat = mMaterials["wirefence"].get();
-	//boxRitem->Geo = mGeometries["boxGeo"].get();
-	//boxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	//boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
-	//boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-	//boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-
-	//mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem.get());
+	//RenderItem boxRitem;
+	//XMStoreFloat4x4(&boxRitem.World, XMMatrixTranslation(3.0f, 2.0f, -9.0f));
+	//boxRitem.ObjCBIndex = 2;
+	//boxRitem.Mat = mMaterials["wirefence"].get();
+	//boxRitem.Geo = mGeometries["shapeGeo"].get();
+	//boxRitem.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	//boxRitem.IndexCount = boxRitem.Geo->DrawArgs["box"].IndexCount;
+	//boxRitem.StartIndexLocation = boxRitem.Geo->DrawArgs["box"].StartIndexLocation;
+	//boxRitem.BaseVertexLocation = boxRitem.Geo->DrawArgs["box"].BaseVertexLocation;
+
+	//mRitems->Add((UINT)RenderLayer::AlphaTested, boxRitem);
 	
 	//Trees
-	auto treeSpritesRitem = std::make_unique<RenderItem>();
-	treeSpritesRitem->World = MathHelper::Identity4x4();
-	treeSpritesRitem->ObjCBIndex = 52;
-	treeSpritesRitem->Mat = mMaterials["treeSprites"].get();
-	treeSpritesRitem->Geo = mGeometries["treeSpritesGeo"].get();
+	RenderItem treeSpritesRitem;
+	treeSpritesRitem.World = MathHelper::Identity4x4();
+	treeSpritesRitem.ObjCBIndex = objCBIndex++;
+	treeSpritesRitem.Mat = mMaterials["treeSprites"].get();
+	treeSpritesRitem.Geo = mGeometries["treeSpritesGeo"].get();
 	//step2
-	treeSpritesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
-	treeSpritesRitem->IndexCount = treeSpritesRitem->Geo->DrawArgs["points"].IndexCount;
-	treeSpritesRitem->StartIndexLocation = treeSpritesRitem->Geo->DrawArgs["points"].StartIndexLocation;
-	treeSpritesRitem->BaseVertexLocation = treeSpritesRitem->Geo->DrawArgs["points"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites].push_back(treeSpritesRitem.get());
-	mAllRitems.push_back(std::move(treeSpritesRitem));
+	treeSpritesRitem.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
+	treeSpritesRitem.IndexCount = treeSpritesRitem.Geo->DrawArgs["points"].IndexCount;
+	treeSpritesRitem.StartIndexLocation = treeSpritesRitem.Geo->DrawArgs["points"].StartIndexLocation;
+	treeSpritesRitem.BaseVertexLocation = treeSpritesRitem.Geo->DrawArgs["points"].BaseVertexLocation;
+	treeSpritesRitem.Bounds = treeSpritesRitem.Geo->DrawArgs["points"].Bounds;
+
+	// The item also stands for the GPU forest, so its bounds cover both.
+	BoundingBox::CreateMerged(treeSpritesRitem.Bounds, treeSpritesRitem.Bounds, mGpuForest->Bounds());
+	mTreeSpritesRitem = mRitems->Add((UINT)RenderLayer::AlphaTestedTreeSprites, treeSpritesRitem);
+
+	// Give every geometry a small id for the sort keys.
+	for(auto& args : mRitems->DrawArgs)
+		mGeoSortIds.emplace(args.Geo, (UINT)mGeoSortIds.size());
+
+	// Every item starts out dirty, so every frame resource gets its constants.
+	for(UINT slot = 0; slot < mRitems->Count(); ++slot)
+	{
+		if(mRitems->ObjCBIndices[slot] != (UINT)-1 && mRitems->NumFramesDirty[slot] > 0)
+			mDirtyRitems.push_back(mRitems->Handle(slot));
+	}
+
+}
+
+void TreeBillboardsApp::BuildTorches()
+{
+	// Torches hang on both faces of every outer wall, with lanterns on the walkway
+	// above shining down over the faces.  The walls are unit boxes scaled into place.
+	const float torchSpacing = 2.5f;
+	const float lanternSpacing = 6.0f;
+
+	std::vector<Light> pointLights;
+	std::vector<Light> spotLights;
+	for(UINT i = 0; i < mScene->ItemCount(); ++i)
+	{
+		const SceneItem& item = mScene->Item(i);
+		if(strncmp(item.Name, "Outer", 5) != 0 || strstr(item.Name, "Wall") == nullptr)
+			continue;
+
+		XMFLOAT3 size = { item.World._11, item.World._22, item.World._33 };
+		XMFLOAT3 center = { item.World._41, item.World._42, item.World._43 };
+
+		// Torches run along the wall's long side and face out of its thin one.
+		bool alongX = size.x >= size.z;
+		float length = alongX ? size.x : size.z;
+		float thickness = alongX ? size.z : size.x;
+		XMVECTOR along = alongX ? XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f) : XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+		XMVECTOR across = alongX ? XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f) : XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+		float top = center.y + 0.5f*size.y;
+
+		for(float side = -1.0f; side <= 1.0f; side += 2.0f)
+		{
+			XMVECTOR out = side*across;
+			XMVECTOR face = XMLoadFloat3(&center) + (0.5f*thickness + 0.4f)*out;
+
+			UINT torchCount = (UINT)(length / torchSpacing);
+			for(UINT j = 0; j < torchCount; ++j)
+			{
+				float offset = (j + 0.5f)*length / torchCount - 0.5f*length;
+
+				Light torch;
+				torch.Strength = { 1.0f, 0.55f, 0.2f };
+				torch.FalloffStart = 0.5f;
+				torch.FalloffEnd = 7.0f;
+				XMStoreFloat3(&torch.Position, face + offset*along + XMVectorSet(0.0f, top - center.y - 2.5f, 0.0f, 0.0f));
+				pointLights.push_back(torch);
+			}
+
+			UINT lanternCount = (UINT)(length / lanternSpacing);
+			for(UINT j = 0; j < lanternCount; ++j)
+			{
+				float offset = (j + 0.5f)*length / lanternCount - 0.5f*length;
+
+				Light lantern;
+				lantern.Strength = { 0.9f, 0.6f, 0.3f };
+				lantern.FalloffStart = 2.0f;
+				lantern.FalloffEnd = 18.0f;
+				lantern.SpotPower = 6.0f;
+				XMStoreFloat3(&lantern.Position, face + offset*along + XMVectorSet(0.0f, top - center.y + 1.0f, 0.0f, 0.0f));
+				XMStoreFloat3(&lantern.Direction, XMVector3Normalize(0.4f*out - XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)));
+				spotLights.push_back(lantern);
+			}
+		}
+	}
 
-	//mAllRitems.push_back(std::move(boxRitem));
+	mTorches = pointLights;
+	mTorches.insert(mTorches.end(), spotLights.begin(), spotLights.end());
+	mTorchPointLightCount = (UINT)pointLights.size();
 
+	if(mTorches.size() > gMaxClusteredLights)
+		throw std::runtime_error("more torches than the clustered light buffer holds");
 }
 
-void TreeBillboardsApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+void TreeBillboardsApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<UINT>& slots, bool bindless, DrawStats& stats)
 {
+	// Recorded on several threads at once, so this adds up their time.
+	Profiler::CpuScope scope(*mProfiler, (UINT)CpuTiming::DrawRenderItems);
+
     UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-    UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
 
 	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
-	auto matCB = mCurrFrameResource->MaterialCB->Resource();
+
+	// State bound by the previous item.  A new command list starts with nothing
+	// bound, so the first item always sets everything.
+	const MeshGeometry* lastGeo = nullptr;
+	D3D12_PRIMITIVE_TOPOLOGY lastTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	const Material* lastMat = nullptr;
 
     // For each render item...
-    for(size_t i = 0; i < ritems.size(); ++i)
+    for(size_t i = 0; i < slots.size(); ++i)
     {
-        auto ri = ritems[i];
+		UINT slot = slots[i];
+		const RenderItemDrawArgs& args = mRitems->DrawArgs[slot];
+		const Material* mat = mRitems->Materials[slot];
+
+		if(args.Geo != lastGeo)
+		{
+			if(args.Geo->TexCBufferGPU != nullptr)
+			{
+				D3D12_VERTEX_BUFFER_VIEW vbvs[] = { args.Geo->VertexBufferView(), args.Geo->TexCBufferView() };
+				cmdList->IASetVertexBuffers(0, _countof(vbvs), vbvs);
+			}
+			else
+			{
+				cmdList->IASetVertexBuffers(0, 1, &args.Geo->VertexBufferView());
+			}
+			cmdList->IASetIndexBuffer(&args.Geo->IndexBufferView());
+
+			lastGeo = args.Geo;
+			stats.StateChanges += 2;
+		}
+		else
+		{
+			stats.StateChangesSkipped += 2;
+		}
 
-        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
 		//step3
-        cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+		if(args.PrimitiveType != lastTopology)
+		{
+			cmdList->IASetPrimitiveTopology(args.PrimitiveType);
 
-		CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-		tex.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+			lastTopology = args.PrimitiveType;
+			stats.StateChanges++;
+		}
+		else
+		{
+			stats.StateChangesSkipped++;
+		}
+
+		// The material itself is found through the object's material index.  Only
+		// without bindless does its texture still need a table of its own.
+		if(!bindless)
+		{
+			if(mat != lastMat)
+			{
+				CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+				tex.Offset(mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+				cmdList->SetGraphicsRootDescriptorTable(0, tex);
+
+				lastMat = mat;
+				stats.StateChanges++;
+			}
+			else
+			{
+				stats.StateChangesSkipped++;
+			}
+		}
 
-        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize;
-		D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex*matCBByteSize;
+        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress;
+		UINT objCBIndex = mRitems->ObjCBIndices[slot];
+		if(objCBIndex == (UINT)-1)
+			objCBAddress = mCurrFrameResource->FrameUpload->AllocateConstants(MakeObjectConstants(slot));
+		else
+			objCBAddress = objectCB->GetGPUVirtualAddress() + objCBIndex*objCBByteSize;
 
-		cmdList->SetGraphicsRootDescriptorTable(0, tex);
+		// Every item has its own object constants.
         cmdList->SetGraphicsRootConstantBufferView(1, objCBAddress);
-        cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
+		stats.StateChanges++;
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+        cmdList->DrawIndexedInstanced(args.IndexCount, 1, args.StartIndexLocation, args.BaseVertexLocation, 0);
+		stats.Draws++;
     }
 }
 
+void TreeBillboardsApp::BuildTransformHierarchy()
+{
+	// The terrain, the water and the trees are laid out in world space; everything
+	// else belongs to the castle.  BuildRenderItems placed the castle's items as if
+	// its node were the identity, so their World matrices become their local ones.
+	const UINT worldLayers[] =
+	{
+		(UINT)RenderLayer::Terrain,
+		(UINT)RenderLayer::GpuWaves,
+		(UINT)RenderLayer::CpuWaves,
+		(UINT)RenderLayer::AlphaTestedTreeSprites,
+		(UINT)RenderLayer::Count
+	};
+
+	mCastleNode = mTransforms.AddNode(TransformHierarchy::None, MathHelper::Identity4x4());
+	mTransformRitems.push_back(RenderItemStore::None);
+
+	for(UINT slot = 0; slot < mRitems->Count(); ++slot)
+	{
+		bool inWorld = std::find(std::begin(worldLayers), std::end(worldLayers), mRitems->Layers[slot]) != std::end(worldLayers);
+		mRitems->TransformNodes[slot] = mTransforms.AddNode(inWorld ? TransformHierarchy::None : mCastleNode, mRitems->Worlds[slot]);
+		mTransformRitems.push_back(mRitems->Handle(slot));
+	}
+}
+
+void TreeBillboardsApp::BuildRenderItemLods()
+{
+	// An item drawing a submesh that has a "_lod1" sibling in DrawArgs gets the whole
+	// chain.  DrawArgs is not modified after this, so the pointers stay valid.
+	for(UINT slot = 0; slot < mRitems->Count(); ++slot)
+	{
+		const RenderItemDrawArgs& args = mRitems->DrawArgs[slot];
+		if(args.Geo == nullptr)
+			continue;
+
+		auto& lods = mRitems->Lods[slot];
+		auto& drawArgs = args.Geo->DrawArgs;
+		for(auto& arg : drawArgs)
+		{
+			const SubmeshGeometry& submesh = arg.second;
+			if(submesh.IndexCount != args.IndexCount ||
+				submesh.StartIndexLocation != args.StartIndexLocation ||
+				submesh.BaseVertexLocation != args.BaseVertexLocation)
+				continue;
+
+			auto coarser = drawArgs.find(arg.first + "_lod1");
+			if(coarser == drawArgs.end())
+				break;
+
+			lods.push_back(&submesh);
+			for(UINT lod = 2; coarser != drawArgs.end(); ++lod)
+			{
+				lods.push_back(&coarser->second);
+				coarser = drawArgs.find(arg.first + "_lod" + std::to_string(lod));
+			}
+			break;
+		}
+	}
+}
+
+void TreeBillboardsApp::BuildInstanceBatches()
+{
+	mInstanceCount = 0;
+
+	for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		auto& batches = mInstanceBatches[layer];
+		batches.clear();
+
+		if(!LayerSupportsInstancing((RenderLayer)layer))
+			continue;
+
+		for(UINT slot = 0; slot < mRitems->Count(); ++slot)
+		{
+			if(mRitems->Layers[slot] != (UINT)layer)
+				continue;
+
+			const RenderItemDrawArgs& args = mRitems->DrawArgs[slot];
+			Material* mat = mRitems->Materials[slot];
+			const auto& lods = mRitems->Lods[slot];
+
+			// An item with levels of detail joins a batch for each level, and is only
+			// written to the one of the level it is at.
+			UINT lodCount = std::max<UINT>((UINT)lods.size(), 1);
+			for(UINT lod = 0; lod < lodCount; ++lod)
+			{
+				SubmeshGeometry submesh;
+				if(lods.empty())
+				{
+					submesh.IndexCount = args.IndexCount;
+					submesh.StartIndexLocation = args.StartIndexLocation;
+					submesh.BaseVertexLocation = args.BaseVertexLocation;
+				}
+				else
+				{
+					submesh = *lods[lod];
+				}
+
+				auto batch = std::find_if(batches.begin(), batches.end(), [&args, mat, &submesh, lod](const InstanceBatch& b)
+				{
+					return b.Geo == args.Geo && b.Mat == mat &&
+						b.PrimitiveType == args.PrimitiveType &&
+						b.IndexCount == submesh.IndexCount &&
+						b.StartIndexLocation == submesh.StartIndexLocation &&
+						b.BaseVertexLocation == submesh.BaseVertexLocation &&
+						b.Lod == lod;
+				});
+
+				if(batch == batches.end())
+				{
+					InstanceBatch newBatch;
+					newBatch.Mat = mat;
+					newBatch.Geo = args.Geo;
+					newBatch.PrimitiveType = args.PrimitiveType;
+					newBatch.IndexCount = submesh.IndexCount;
+					newBatch.StartIndexLocation = submesh.StartIndexLocation;
+					newBatch.BaseVertexLocation = submesh.BaseVertexLocation;
+					newBatch.Lod = lod;
+
+					batches.push_back(newBatch);
+					batch = batches.end() - 1;
+				}
+
+				batch->Ritems.push_back(mRitems->Handle(slot));
+			}
+		}
+
+		// Group batches sharing a material, then a geometry, so DrawInstanceBatches
+		// can skip rebinding them.
+		std::stable_sort(batches.begin(), batches.end(), [this](const InstanceBatch& a, const InstanceBatch& b)
+		{
+			if(a.Mat->MatCBIndex != b.Mat->MatCBIndex)
+				return a.Mat->MatCBIndex < b.Mat->MatCBIndex;
+			return mGeoSortIds.at(a.Geo) < mGeoSortIds.at(b.Geo);
+		});
+
+		// Give each batch a contiguous range of the instance buffer.
+		for(auto& b : batches)
+		{
+			b.InstanceOffset = mInstanceCount;
+			mInstanceCount += (UINT)b.Ritems.size();
+		}
+	}
+}
+
+void TreeBillboardsApp::DrawInstanceBatches(ID3D12GraphicsCommandList* cmdList, const std::vector<InstanceBatch>& batches, bool bindless, DrawStats& stats)
+{
+	Profiler::CpuScope scope(*mProfiler, (UINT)CpuTiming::DrawInstanceBatches);
+
+	auto instanceBuffer = mCurrFrameResource->InstanceBuffer->Resource();
+
+	// Batches are sorted by material then geometry, so neighbours often share state.
+	const MeshGeometry* lastGeo = nullptr;
+	D3D12_PRIMITIVE_TOPOLOGY lastTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	const Material* lastMat = nullptr;
+
+	// For each batch...
+	for(size_t i = 0; i < batches.size(); ++i)
+	{
+		auto& batch = batches[i];
+		if(batch.InstanceCount == 0)
+			continue;
+
+		if(batch.Geo != lastGeo)
+		{
+			cmdList->IASetVertexBuffers(0, 1, &batch.Geo->VertexBufferView());
+			cmdList->IASetIndexBuffer(&batch.Geo->IndexBufferView());
+
+			lastGeo = batch.Geo;
+			stats.StateChanges += 2;
+		}
+		else
+		{
+			stats.StateChangesSkipped += 2;
+		}
+
+		if(batch.PrimitiveType != lastTopology)
+		{
+			cmdList->IASetPrimitiveTopology(batch.PrimitiveType);
+
+			lastTopology = batch.PrimitiveType;
+			stats.StateChanges++;
+		}
+		else
+		{
+			stats.StateChangesSkipped++;
+		}
+
+		// The material itself is found through the object's material index.  Only
+		// without bindless does its texture still need a table of its own.
+		if(!bindless)
+		{
+			if(batch.Mat != lastMat)
+			{
+				CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+				tex.Offset(batch.Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+				cmdList->SetGraphicsRootDescriptorTable(0, tex);
+
+				lastMat = batch.Mat;
+				stats.StateChanges++;
+			}
+			else
+			{
+				stats.StateChangesSkipped++;
+			}
+		}
+
+		// Bind the batch's slice of the instance buffer, so SV_InstanceID indexes from 0.
+		D3D12_GPU_VIRTUAL_ADDRESS instanceAddress = instanceBuffer->GetGPUVirtualAddress() + batch.InstanceOffset*sizeof(InstanceData);
+		cmdList->SetGraphicsRootShaderResourceView(4, instanceAddress);
+		stats.StateChanges++;
+
+		cmdList->DrawIndexedInstanced(batch.IndexCount, batch.InstanceCount, batch.StartIndexLocation, batch.BaseVertexLocation, 0);
+		stats.Draws++;
+	}
+}
+
 std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> TreeBillboardsApp::GetStaticSamplers()
 {
 	// Applications usually only need a handful of samplers.  So just define them all up front
@@ -2394,16 +4006,32 @@ std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> TreeBillboardsApp::GetStaticSam
 
 float TreeBillboardsApp::GetHillsHeight(float x, float z)const
 {
-    return 0.3f*(z*sinf(0.1f*x) + x*cosf(0.1f*z));
+	auto smoothStep = [](float a, float b, float t)
+	{
+		t = MathHelper::Clamp((t - a) / (b - a), 0.0f, 1.0f);
+		return t*t*(3.0f - 2.0f*t);
+	};
+
+	// Rolling hills, flattened into the castle grounds at the old land grid's height
+	// with the lake bed around them, out to where the water grids end.
+	float hills = 8.0f +
+		14.0f*sinf(0.011f*x)*cosf(0.013f*z) +
+		5.0f*sinf(0.037f*x + 1.3f)*sinf(0.029f*z) +
+		1.5f*cosf(0.09f*x)*sinf(0.11f*z);
+
+	float d = std::max<float>(fabsf(x), fabsf(z));
+	float ground = MathHelper::Lerp(0.1f, -0.51f, smoothStep(40.0f, 46.0f, d));
+	return MathHelper::Lerp(ground, hills, smoothStep(56.0f, 120.0f, d));
 }
 
 XMFLOAT3 TreeBillboardsApp::GetHillsNormal(float x, float z)const
 {
-    // n = (-df/dx, 1, -df/dz)
+    // n = (-df/dx, 1, -df/dz), by central differences since the height is pieced together.
+	const float h = 0.5f;
     XMFLOAT3 n(
-        -0.03f*z*cosf(0.1f*x) - 0.3f*cosf(0.1f*z),
+        (GetHillsHeight(x - h, z) - GetHillsHeight(x + h, z)) / (2.0f*h),
         1.0f,
-        -0.3f*sinf(0.1f*x) + 0.03f*x*sinf(0.1f*z));
+        (GetHillsHeight(x, z - h) - GetHillsHeight(x, z + h)) / (2.0f*h));
 
     XMVECTOR unitNormal = XMVector3Normalize(XMLoadFloat3(&n));
     XMStoreFloat3(&n, unitNormal);
@@ -0,0 +1,133 @@
+//***************************************************************************************
+// Benchmark.cpp
+//***************************************************************************************
+
+#include "Benchmark.h"
+
+BenchmarkSettings ParseBenchmarkSettings(const std::string& cmdLine)
+{
+	BenchmarkSettings settings;
+
+	std::istringstream args(cmdLine);
+	std::vector<std::string> tokens;
+	std::string token;
+	while(args >> token)
+		tokens.push_back(token);
+
+	for(size_t i = 0; i < tokens.size(); ++i)
+	{
+		bool hasValue = i + 1 < tokens.size() && tokens[i + 1][0] != '-';
+
+		if(tokens[i] == "-benchmark")
+		{
+			settings.Enabled = true;
+			if(hasValue)
+				settings.FrameCount = (UINT)std::stoul(tokens[++i]);
+		}
+		else if(tokens[i] == "-dt" && hasValue)
+			settings.DeltaTime = std::stof(tokens[++i]);
+		else if(tokens[i] == "-offscreen")
+			settings.Offscreen = true;
+		else if(tokens[i] == "-report" && hasValue)
+			settings.ReportFilename = AnsiToWString(tokens[++i]);
+		else if(tokens[i] == "-framelog" && hasValue)
+			settings.FrameLogFilename = AnsiToWString(tokens[++i]);
+	}
+
+	settings.FrameCount = std::max<UINT>(settings.FrameCount, 1);
+	if(settings.DeltaTime <= 0.0f)
+		settings.DeltaTime = 1.0f / 60.0f;
+
+	return settings;
+}
+
+BenchmarkRecorder::BenchmarkRecorder(const std::vector<std::string>& gpuScopes, const std::vector<std::string>& cpuScopes)
+{
+	mGpuScopeNames = gpuScopes;
+	mCpuScopeNames = cpuScopes;
+
+	mGpuMilliseconds.resize(mGpuScopeNames.size());
+	mCpuMilliseconds.resize(mCpuScopeNames.size());
+}
+
+BenchmarkRecorder::~BenchmarkRecorder()
+{
+}
+
+void BenchmarkRecorder::AddFrame(float frameMilliseconds, UINT draws, UINT stateChanges, UINT visibleRitems)
+{
+	mFrameMilliseconds.push_back(frameMilliseconds);
+	mDraws.push_back((float)draws);
+	mStateChanges.push_back((float)stateChanges);
+	mVisibleRitems.push_back((float)visibleRitems);
+}
+
+void BenchmarkRecorder::AddTimings(const std::vector<float>& gpuMilliseconds, const std::vector<float>& cpuMilliseconds)
+{
+	for(size_t i = 0; i < mGpuMilliseconds.size(); ++i)
+		mGpuMilliseconds[i].push_back(gpuMilliseconds[i]);
+	for(size_t i = 0; i < mCpuMilliseconds.size(); ++i)
+		mCpuMilliseconds[i].push_back(cpuMilliseconds[i]);
+}
+
+void BenchmarkRecorder::Write(const std::wstring& filename, const BenchmarkSettings& settings)const
+{
+	std::ofstream fout(filename);
+
+	fout << "metric,value\n";
+	fout << "frames," << mFrameMilliseconds.size() << "\n";
+	fout << "dt (s)," << settings.DeltaTime << "\n";
+	fout << "offscreen," << (settings.Offscreen ? 1 : 0) << "\n";
+
+	const float percentiles[] = { 0.5f, 0.9f, 0.95f, 0.99f, 1.0f };
+	const char* percentileNames[] = { "p50", "p90", "p95", "p99", "max" };
+
+	fout << "frame mean (ms)," << Mean(mFrameMilliseconds) << "\n";
+	for(int i = 0; i < _countof(percentiles); ++i)
+		fout << "frame " << percentileNames[i] << " (ms)," << Percentile(mFrameMilliseconds, percentiles[i]) << "\n";
+
+	// Every GPU scope gets the same percentiles; the frame scope first, by the
+	// profiler's convention.
+	for(size_t scope = 0; scope < mGpuScopeNames.size(); ++scope)
+	{
+		fout << "gpu " << mGpuScopeNames[scope] << " mean (ms)," << Mean(mGpuMilliseconds[scope]) << "\n";
+		for(int i = 0; i < _countof(percentiles); ++i)
+		{
+			fout << "gpu " << mGpuScopeNames[scope] << " " << percentileNames[i] << " (ms)," <<
+				Percentile(mGpuMilliseconds[scope], percentiles[i]) << "\n";
+		}
+	}
+
+	for(size_t scope = 0; scope < mCpuScopeNames.size(); ++scope)
+	{
+		fout << "cpu " << mCpuScopeNames[scope] << " mean (ms)," << Mean(mCpuMilliseconds[scope]) << "\n";
+		fout << "cpu " << mCpuScopeNames[scope] << " p95 (ms)," << Percentile(mCpuMilliseconds[scope], 0.95f) << "\n";
+	}
+
+	fout << "draws mean," << Mean(mDraws) << "\n";
+	fout << "draws max," << Percentile(mDraws, 1.0f) << "\n";
+	fout << "state changes mean," << Mean(mStateChanges) << "\n";
+	fout << "visible render items mean," << Mean(mVisibleRitems) << "\n";
+}
+
+float BenchmarkRecorder::Percentile(std::vector<float> values, float p)
+{
+	if(values.empty())
+		return 0.0f;
+
+	size_t rank = (size_t)(p*(values.size() - 1) + 0.5f);
+	std::nth_element(values.begin(), values.begin() + rank, values.end());
+	return values[rank];
+}
+
+float BenchmarkRecorder::Mean(const std::vector<float>& values)
+{
+	if(values.empty())
+		return 0.0f;
+
+	double sum = 0.0;
+	for(float v : values)
+		sum += v;
+
+	return (float)(sum / values.size());
+}
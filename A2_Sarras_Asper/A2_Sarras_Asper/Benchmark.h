@@ -0,0 +1,70 @@
+//***************************************************************************************
+// Benchmark.h
+//
+// Settings and results of a benchmark run: a fixed number of frames at a fixed time
+// step along a scripted camera path, so that runs of the same build draw the same
+// frames and can be compared.  The results are written as "metric,value" CSV lines.
+//
+// Command line:
+//   -benchmark [frames]   run the benchmark instead of the interactive loop
+//   -dt seconds           time step of every frame (default 1/60)
+//   -offscreen            render without a visible window or swap chain
+//   -report file          summary output (default Benchmark.csv)
+//   -framelog file        also write every frame's profiler timings
+//***************************************************************************************
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "../../Common/d3dUtil.h"
+
+struct BenchmarkSettings
+{
+	bool Enabled = false;
+	UINT FrameCount = 1000;
+	float DeltaTime = 1.0f / 60.0f;
+	bool Offscreen = false;
+	std::wstring ReportFilename = L"Benchmark.csv";
+	std::wstring FrameLogFilename;
+};
+
+// Throws std::invalid_argument on a malformed number.
+BenchmarkSettings ParseBenchmarkSettings(const std::string& cmdLine);
+
+class BenchmarkRecorder
+{
+public:
+	BenchmarkRecorder(const std::vector<std::string>& gpuScopes, const std::vector<std::string>& cpuScopes);
+	BenchmarkRecorder(const BenchmarkRecorder& rhs) = delete;
+	BenchmarkRecorder& operator=(const BenchmarkRecorder& rhs) = delete;
+	~BenchmarkRecorder();
+
+	// Wall clock milliseconds the CPU spent on a frame, and what the frame drew.
+	void AddFrame(float frameMilliseconds, UINT draws, UINT stateChanges, UINT visibleRitems);
+
+	// One frame's profiler timings, indexed by scope.  These arrive a few frames after
+	// the frame's AddFrame, so the last frames of a run may have none.
+	void AddTimings(const std::vector<float>& gpuMilliseconds, const std::vector<float>& cpuMilliseconds);
+
+	void Write(const std::wstring& filename, const BenchmarkSettings& settings)const;
+
+private:
+	// p in [0, 1], nearest rank.
+	static float Percentile(std::vector<float> values, float p);
+	static float Mean(const std::vector<float>& values);
+
+private:
+	std::vector<std::string> mGpuScopeNames;
+	std::vector<std::string> mCpuScopeNames;
+
+	std::vector<float> mFrameMilliseconds;
+	std::vector<float> mDraws;
+	std::vector<float> mStateChanges;
+	std::vector<float> mVisibleRitems;
+
+	// One list of samples per scope.
+	std::vector<std::vector<float>> mGpuMilliseconds;
+	std::vector<std::vector<float>> mCpuMilliseconds;
+};
+
+#endif // BENCHMARK_H
@@ -0,0 +1,152 @@
+//***************************************************************************************
+// ClusteredLights.cpp
+//***************************************************************************************
+
+#include "ClusteredLights.h"
+
+using namespace DirectX;
+
+ClusteredLights::ClusteredLights(ID3D12Device* device,
+	UINT clusterCountX, UINT clusterCountY, UINT clusterCountZ, UINT maxLightsPerCluster)
+{
+	md3dDevice = device;
+
+	mClusterCountX = clusterCountX;
+	mClusterCountY = clusterCountY;
+	mClusterCountZ = clusterCountZ;
+	mMaxLightsPerCluster = maxLightsPerCluster;
+
+	BuildResources();
+}
+
+ClusteredLights::~ClusteredLights()
+{
+}
+
+UINT ClusteredLights::ClusterCountX()const
+{
+	return mClusterCountX;
+}
+
+UINT ClusteredLights::ClusterCountY()const
+{
+	return mClusterCountY;
+}
+
+UINT ClusteredLights::ClusterCountZ()const
+{
+	return mClusterCountZ;
+}
+
+UINT ClusteredLights::MaxLightsPerCluster()const
+{
+	return mMaxLightsPerCluster;
+}
+
+void ClusteredLights::GetDepthSliceParams(float nearZ, float farZ, float& scale, float& bias)const
+{
+	// Slice k starts at depth nearZ*(farZ/nearZ)^(k/ClusterCountZ).
+	float logDepthRange = logf(farZ / nearZ);
+	scale = mClusterCountZ / logDepthRange;
+	bias = mClusterCountZ*logf(nearZ) / logDepthRange;
+}
+
+UINT ClusteredLights::RootConstantCount()
+{
+	return sizeof(ClusterConstants) / 4;
+}
+
+void ClusteredLights::Cull(
+	ID3D12GraphicsCommandList* cmdList,
+	ID3D12RootSignature* rootSig,
+	ID3D12PipelineState* pso,
+	const XMFLOAT4X4& view,
+	const XMFLOAT4X4& proj,
+	float nearZ, float farZ,
+	D3D12_GPU_VIRTUAL_ADDRESS lights,
+	UINT lightCount)
+{
+	if(lightCount == 0 && mClustersEmpty)
+		return;
+
+	// Make the clusters writable again now that the previous frame's pixels have
+	// read them.
+	D3D12_RESOURCE_BARRIER toCull[] =
+	{
+		CD3DX12_RESOURCE_BARRIER::Transition(mLightCounts.Get(), mClusterState, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+		CD3DX12_RESOURCE_BARRIER::Transition(mLightIndices.Get(), mClusterState, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+	};
+	cmdList->ResourceBarrier(_countof(toCull), toCull);
+
+	XMMATRIX P = XMLoadFloat4x4(&proj);
+	XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(P), P);
+
+	ClusterConstants constants;
+	XMStoreFloat4x4(&constants.View, XMMatrixTranspose(XMLoadFloat4x4(&view)));
+	XMStoreFloat4x4(&constants.InvProj, XMMatrixTranspose(invProj));
+	constants.ClusterCountX = mClusterCountX;
+	constants.ClusterCountY = mClusterCountY;
+	constants.ClusterCountZ = mClusterCountZ;
+	constants.MaxLightsPerCluster = mMaxLightsPerCluster;
+	constants.NearZ = nearZ;
+	constants.FarZ = farZ;
+	constants.LightCount = lightCount;
+	constants.Pad0 = 0.0f;
+
+	cmdList->SetPipelineState(pso);
+	cmdList->SetComputeRootSignature(rootSig);
+
+	cmdList->SetComputeRoot32BitConstants(0, RootConstantCount(), &constants, 0);
+	cmdList->SetComputeRootShaderResourceView(1, lights);
+	cmdList->SetComputeRootUnorderedAccessView(2, mLightCounts->GetGPUVirtualAddress());
+	cmdList->SetComputeRootUnorderedAccessView(3, mLightIndices->GetGPUVirtualAddress());
+
+	// One thread per cluster.
+	UINT clusterCount = mClusterCountX*mClusterCountY*mClusterCountZ;
+	UINT numGroups = (clusterCount + CullGroupSize - 1) / CullGroupSize;
+	cmdList->Dispatch(numGroups, 1, 1);
+
+	D3D12_RESOURCE_BARRIER toDraw[] =
+	{
+		CD3DX12_RESOURCE_BARRIER::Transition(mLightCounts.Get(),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
+		CD3DX12_RESOURCE_BARRIER::Transition(mLightIndices.Get(),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
+	};
+	cmdList->ResourceBarrier(_countof(toDraw), toDraw);
+
+	mClusterState = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+	mClustersEmpty = lightCount == 0;
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS ClusteredLights::LightCounts()const
+{
+	return mLightCounts->GetGPUVirtualAddress();
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS ClusteredLights::LightIndices()const
+{
+	return mLightIndices->GetGPUVirtualAddress();
+}
+
+void ClusteredLights::BuildResources()
+{
+	UINT clusterCount = mClusterCountX*mClusterCountY*mClusterCountZ;
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(clusterCount*sizeof(UINT), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&mLightCounts)));
+
+	// Sized for every cluster being full, so no cluster needs an offset of its own.
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer((UINT64)clusterCount*mMaxLightsPerCluster*sizeof(UINT), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&mLightIndices)));
+}
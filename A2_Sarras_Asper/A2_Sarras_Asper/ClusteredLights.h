@@ -0,0 +1,104 @@
+//***************************************************************************************
+// ClusteredLights.h
+//
+// Bins point and spot lights into clusters, tiles of the screen further split into
+// slices of view depth, so a pixel shader only loops over the lights that can reach
+// its cluster.  Every frame a compute shader bounds each cluster by a view space box
+// and tests it against every light's sphere of influence, writing the indices of the
+// lights that touch it to a fixed size list per cluster.
+//
+// The clusters split the screen evenly in x and y, so they do not depend on the
+// render target size.  Depth slices grow exponentially from the near plane, the way
+// perspective shrinks things on screen.
+//***************************************************************************************
+
+#ifndef CLUSTEREDLIGHTS_H
+#define CLUSTEREDLIGHTS_H
+
+#include "../../Common/d3dUtil.h"
+
+class ClusteredLights
+{
+public:
+	// A cluster keeps at most maxLightsPerCluster lights; the others touching it are
+	// dropped.
+	ClusteredLights(ID3D12Device* device,
+		UINT clusterCountX, UINT clusterCountY, UINT clusterCountZ, UINT maxLightsPerCluster);
+	ClusteredLights(const ClusteredLights& rhs) = delete;
+	ClusteredLights& operator=(const ClusteredLights& rhs) = delete;
+	~ClusteredLights();
+
+	UINT ClusterCountX()const;
+	UINT ClusterCountY()const;
+	UINT ClusterCountZ()const;
+	UINT MaxLightsPerCluster()const;
+
+	// A pixel at view depth z lies in slice floor(log(z)*scale - bias), for the same
+	// near and far planes Cull is given.
+	void GetDepthSliceParams(float nearZ, float farZ, float& scale, float& bias)const;
+
+	// Number of 32-bit root constants Cull sets at root parameter 0.  Parameter 1 must
+	// be a root SRV for the lights (t0), and parameters 2 and 3 root UAVs for the
+	// light counts (u0) and light indices (u1) of the clusters.
+	static UINT RootConstantCount();
+
+	// Records the binning pass.  view and proj are the camera's, not transposed.
+	// lights is a structured buffer of lightCount Light elements in world space, of
+	// which only Position and FalloffEnd are read.  Afterwards pixel shaders can read
+	// LightCounts and LightIndices.  While lightCount stays 0 nothing is recorded,
+	// since the clusters are already empty.
+	void Cull(
+		ID3D12GraphicsCommandList* cmdList,
+		ID3D12RootSignature* rootSig,
+		ID3D12PipelineState* pso,
+		const DirectX::XMFLOAT4X4& view,
+		const DirectX::XMFLOAT4X4& proj,
+		float nearZ, float farZ,
+		D3D12_GPU_VIRTUAL_ADDRESS lights,
+		UINT lightCount);
+
+	// One uint per cluster, numbered x first, then y, then depth slice.
+	D3D12_GPU_VIRTUAL_ADDRESS LightCounts()const;
+
+	// MaxLightsPerCluster uints per cluster, of which the first LightCounts are the
+	// indices of the lights touching it, in the order they were given.
+	D3D12_GPU_VIRTUAL_ADDRESS LightIndices()const;
+
+private:
+	void BuildResources();
+
+private:
+	// Layout of cbClusters in LightCull.hlsl.
+	struct ClusterConstants
+	{
+		DirectX::XMFLOAT4X4 View;
+		DirectX::XMFLOAT4X4 InvProj;
+		UINT ClusterCountX;
+		UINT ClusterCountY;
+		UINT ClusterCountZ;
+		UINT MaxLightsPerCluster;
+		float NearZ;
+		float FarZ;
+		UINT LightCount;
+		float Pad0;
+	};
+
+	ID3D12Device* md3dDevice = nullptr;
+
+	UINT mClusterCountX = 0;
+	UINT mClusterCountY = 0;
+	UINT mClusterCountZ = 0;
+	UINT mMaxLightsPerCluster = 0;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mLightCounts = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mLightIndices = nullptr;
+	D3D12_RESOURCE_STATES mClusterState = D3D12_RESOURCE_STATE_COMMON;
+
+	// Set once a Cull with no lights has run, until one with lights does.
+	bool mClustersEmpty = false;
+
+	// Must match CULL_GROUP_SIZE in LightCull.hlsl.
+	static const UINT CullGroupSize = 128;
+};
+
+#endif // CLUSTEREDLIGHTS_H
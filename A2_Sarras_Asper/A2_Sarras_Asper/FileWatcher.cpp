@@ -0,0 +1,80 @@
+//***************************************************************************************
+// FileWatcher.cpp
+//***************************************************************************************
+
+#include "FileWatcher.h"
+
+// How long a file must go unwritten before it is reported.
+const ULONGLONG gSettleMilliseconds = 250;
+
+FileWatcher::FileWatcher()
+{
+}
+
+FileWatcher::~FileWatcher()
+{
+	for(auto& directory : mDirectories)
+		FindCloseChangeNotification(directory.Notification);
+}
+
+void FileWatcher::Watch(const std::wstring& directory)
+{
+	Directory watched;
+	watched.Path = directory;
+	watched.Notification = FindFirstChangeNotificationW(directory.c_str(), FALSE,
+		FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+	if(watched.Notification == INVALID_HANDLE_VALUE)
+		return;
+
+	Scan(watched, false);
+	mDirectories.push_back(std::move(watched));
+}
+
+void FileWatcher::Poll(std::vector<std::wstring>& changed)
+{
+	ULONGLONG now = GetTickCount64();
+
+	for(auto& directory : mDirectories)
+	{
+		// Rearm before scanning, so a write during the scan signals again.
+		if(WaitForSingleObject(directory.Notification, 0) == WAIT_OBJECT_0)
+		{
+			FindNextChangeNotification(directory.Notification);
+			Scan(directory, true);
+		}
+
+		for(auto& file : directory.Files)
+		{
+			if(file.second.PendingSince != 0 && now - file.second.PendingSince >= gSettleMilliseconds)
+			{
+				file.second.PendingSince = 0;
+				changed.push_back(directory.Path + L"\\" + file.first);
+			}
+		}
+	}
+}
+
+void FileWatcher::Scan(Directory& directory, bool markChanges)
+{
+	WIN32_FIND_DATAW findData;
+	HANDLE find = FindFirstFileW((directory.Path + L"\\*").c_str(), &findData);
+	if(find == INVALID_HANDLE_VALUE)
+		return;
+
+	ULONGLONG now = GetTickCount64();
+	do
+	{
+		if(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+
+		UINT64 writeTime = (UINT64)findData.ftLastWriteTime.dwHighDateTime << 32 | findData.ftLastWriteTime.dwLowDateTime;
+
+		File& file = directory.Files[findData.cFileName];
+		if(file.WriteTime != writeTime && markChanges)
+			file.PendingSince = now;
+		file.WriteTime = writeTime;
+	}
+	while(FindNextFileW(find, &findData));
+
+	FindClose(find);
+}
@@ -0,0 +1,55 @@
+//***************************************************************************************
+// FileWatcher.h
+//
+// Reports files that were written in a set of watched directories.  Each directory
+// has a change notification handle that Poll checks without blocking, so nothing is
+// scanned while nothing changes.  A file is reported only once it has not been written
+// for a short while, so editors that save in several writes are seen finishing first.
+//***************************************************************************************
+
+#ifndef FILEWATCHER_H
+#define FILEWATCHER_H
+
+#include "../../Common/d3dUtil.h"
+
+class FileWatcher
+{
+public:
+	FileWatcher();
+	FileWatcher(const FileWatcher& rhs) = delete;
+	FileWatcher& operator=(const FileWatcher& rhs) = delete;
+	~FileWatcher();
+
+	// Files already in directory are not reported until they are written again.
+	// Subdirectories are not watched.  Does nothing if directory does not exist.
+	void Watch(const std::wstring& directory);
+
+	// Call once per frame.  Appends the paths, as directory + L"\\" + file name, of the
+	// files written since they were last reported.
+	void Poll(std::vector<std::wstring>& changed);
+
+private:
+	struct File
+	{
+		UINT64 WriteTime = 0;
+
+		// Tick count of the write not reported yet, or 0.
+		ULONGLONG PendingSince = 0;
+	};
+
+	struct Directory
+	{
+		std::wstring Path;
+		HANDLE Notification = INVALID_HANDLE_VALUE;
+		std::unordered_map<std::wstring, File> Files;
+	};
+
+	// Records the write time of every file in directory and marks the ones that
+	// changed since the last scan.
+	static void Scan(Directory& directory, bool markChanges);
+
+private:
+	std::vector<Directory> mDirectories;
+};
+
+#endif // FILEWATCHER_H
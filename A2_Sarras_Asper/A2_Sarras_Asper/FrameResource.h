@@ -3,11 +3,45 @@
 #include "../../Common/d3dUtil.h"
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
+#include "../../Common/LinearUploadAllocator.h"
 
 struct ObjectConstants
 {
     DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+	DirectX::XMFLOAT2 DisplacementMapTexelSize = { 1.0f, 1.0f };
+	float GridSpatialStep = 1.0f;
+	UINT MaterialIndex = 0;
+};
+
+// Per-instance data read from a StructuredBuffer by the instanced vertex shader.
+// Same layout as ObjectConstants, but tightly packed instead of 256-byte aligned.
+struct InstanceData
+{
+    DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+	UINT MaterialIndex = 0;
+	UINT InstancePad0;
+	UINT InstancePad1;
+	UINT InstancePad2;
+};
+
+// One element of the per-frame material StructuredBuffer, indexed by
+// Material::MatCBIndex.  Tightly packed, unlike a 256-byte aligned cbuffer slot.
+struct MaterialData
+{
+	DirectX::XMFLOAT4 DiffuseAlbedo = { 1.0f, 1.0f, 1.0f, 1.0f };
+	DirectX::XMFLOAT3 FresnelR0 = { 0.01f, 0.01f, 0.01f };
+	float Roughness = 0.25f;
+
+	// Used in texture mapping.
+	DirectX::XMFLOAT4X4 MatTransform = MathHelper::Identity4x4();
+
+	// Slot of the diffuse map in the bindless texture table.
+	UINT DiffuseMapIndex = 0;
+	UINT MaterialPad0;
+	UINT MaterialPad1;
+	UINT MaterialPad2;
 };
 
 struct PassConstants
@@ -39,6 +73,19 @@ struct PassConstants
     // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
     // are spot lights for a maximum of MaxLights per object.
     Light Lights[MaxLights];
+
+    // Clusters the point and spot lights are binned into; see ClusteredLights.h.
+    UINT ClusterCountX = 1;
+    UINT ClusterCountY = 1;
+    UINT ClusterCountZ = 1;
+    UINT MaxLightsPerCluster = 0;
+    float ClusterDepthScale = 0.0f;
+    float ClusterDepthBias = 0.0f;
+
+    // Clustered lights [0, ClusteredPointLightCount) are point lights; the rest
+    // are spot lights.
+    UINT ClusteredPointLightCount = 0;
+    UINT cbPerObjectPad3 = 0;
 };
 
 struct Vertex
@@ -48,14 +95,22 @@ struct Vertex
 	DirectX::XMFLOAT2 TexC;
 };
 
+// Dynamic part of a wave vertex.  The tex-coords never change, so they are kept
+// in a separate static vertex stream.
+struct WaveVertex
+{
+    DirectX::XMFLOAT3 Pos;
+    DirectX::XMFLOAT3 Normal;
+};
+
 // Stores the resources needed for the CPU to build the command lists
 // for a frame.  
 struct FrameResource
 {
 public:
     
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount);
-	FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount);
+    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT instanceCount, UINT materialCount, UINT lightCount, UINT waveVertCount, UINT workerCount, UINT64 uploadByteSize);
+	FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT instanceCount, UINT materialCount, UINT lightCount, UINT workerCount, UINT64 uploadByteSize);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
@@ -64,16 +119,32 @@ public:
     // So each frame needs their own allocator.
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
 
+    // One allocator per command list recorded on a worker thread, since an
+    // allocator can only be used by one recording command list at a time.
+    std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> WorkerCmdListAllocs;
+
     // We cannot update a cbuffer until the GPU is done processing the commands
     // that reference it.  So each frame needs their own cbuffers.
    // std::unique_ptr<UploadBuffer<FrameConstants>> FrameCB = nullptr;
     std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
-    std::unique_ptr<UploadBuffer<MaterialConstants>> MaterialCB = nullptr;
+    std::unique_ptr<UploadBuffer<MaterialData>> MaterialBuffer = nullptr;
     std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
 
+    // Per-instance transforms for the instanced draw path.  Rewritten every frame,
+    // so each frame needs its own.
+    std::unique_ptr<UploadBuffer<InstanceData>> InstanceBuffer = nullptr;
+
+    // World space point and spot lights for the clustered path, binned by
+    // ClusteredLights::Cull and read by the lit pixel shaders.
+    std::unique_ptr<UploadBuffer<Light>> LightBuffer = nullptr;
+
+    // Transient constants for objects that have no slot in ObjectCB, such as
+    // render items added at runtime.  Reset once the frame's fence is reached.
+    std::unique_ptr<LinearUploadAllocator> FrameUpload = nullptr;
+
     // We cannot update a dynamic vertex buffer until the GPU is done processing
     // the commands that reference it.  So each frame needs their own.
-    std::unique_ptr<UploadBuffer<Vertex>> WavesVB = nullptr;
+    std::unique_ptr<UploadBuffer<WaveVertex>> WavesVB = nullptr;
 
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
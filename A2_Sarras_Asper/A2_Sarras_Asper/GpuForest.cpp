@@ -0,0 +1,159 @@
+//***************************************************************************************
+// GpuForest.cpp
+//***************************************************************************************
+
+#include "GpuForest.h"
+
+using namespace DirectX;
+
+GpuForest::GpuForest(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+	UINT treeCount, float areaHalfExtent, float clearingRadius, float groundHeight,
+	float minTreeSize, float maxTreeSize)
+{
+	md3dDevice = device;
+
+	mTreeCount = treeCount;
+	mAreaHalfExtent = areaHalfExtent;
+	mClearingRadius = clearingRadius;
+	mGroundHeight = groundHeight;
+	mMinTreeSize = minTreeSize;
+	mMaxTreeSize = maxTreeSize;
+
+	BuildResources(cmdList);
+}
+
+GpuForest::~GpuForest()
+{
+}
+
+UINT GpuForest::TreeCount()const
+{
+	return mTreeCount;
+}
+
+BoundingBox GpuForest::Bounds()const
+{
+	// Trees stand on the ground, so the box spans their full height above it.
+	// Half a tree is added sideways since the quads turn to face the camera.
+	BoundingBox bounds;
+	bounds.Center = XMFLOAT3(0.0f, mGroundHeight + 0.5f*mMaxTreeSize, 0.0f);
+	bounds.Extents = XMFLOAT3(
+		mAreaHalfExtent + 0.5f*mMaxTreeSize,
+		0.5f*mMaxTreeSize,
+		mAreaHalfExtent + 0.5f*mMaxTreeSize);
+
+	return bounds;
+}
+
+UINT GpuForest::RootConstantCount()
+{
+	return sizeof(ForestConstants) / 4;
+}
+
+void GpuForest::Cull(
+	ID3D12GraphicsCommandList* cmdList,
+	ID3D12RootSignature* rootSig,
+	ID3D12PipelineState* pso,
+	const XMFLOAT4 planes[6])
+{
+	// Zero the instance count, and make both buffers writable again now that the
+	// previous frame's draw has read them.
+	D3D12_RESOURCE_BARRIER toCopy[] =
+	{
+		CD3DX12_RESOURCE_BARRIER::Transition(mDrawArgs.Get(), mDrawArgsState, D3D12_RESOURCE_STATE_COPY_DEST),
+		CD3DX12_RESOURCE_BARRIER::Transition(mVisibleTrees.Get(), mVisibleTreesState, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+	};
+	cmdList->ResourceBarrier(_countof(toCopy), toCopy);
+
+	cmdList->CopyBufferRegion(mDrawArgs.Get(), 0, mDrawArgsReset.Get(), 0, sizeof(D3D12_DRAW_ARGUMENTS));
+
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mDrawArgs.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+
+	ForestConstants constants;
+	for(int i = 0; i < 6; ++i)
+		constants.FrustumPlanes[i] = planes[i];
+	constants.TreeCount = mTreeCount;
+	constants.AreaHalfExtent = mAreaHalfExtent;
+	constants.ClearingRadius = mClearingRadius;
+	constants.GroundHeight = mGroundHeight;
+	constants.MinTreeSize = mMinTreeSize;
+	constants.MaxTreeSize = mMaxTreeSize;
+	constants.Pad0 = 0.0f;
+	constants.Pad1 = 0.0f;
+
+	cmdList->SetPipelineState(pso);
+	cmdList->SetComputeRootSignature(rootSig);
+
+	cmdList->SetComputeRoot32BitConstants(0, RootConstantCount(), &constants, 0);
+	cmdList->SetComputeRootUnorderedAccessView(1, mVisibleTrees->GetGPUVirtualAddress());
+	cmdList->SetComputeRootUnorderedAccessView(2, mDrawArgs->GetGPUVirtualAddress());
+
+	UINT numGroups = (mTreeCount + CullGroupSize - 1) / CullGroupSize;
+	cmdList->Dispatch(numGroups, 1, 1);
+
+	D3D12_RESOURCE_BARRIER toDraw[] =
+	{
+		CD3DX12_RESOURCE_BARRIER::Transition(mDrawArgs.Get(),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT),
+		CD3DX12_RESOURCE_BARRIER::Transition(mVisibleTrees.Get(),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE),
+	};
+	cmdList->ResourceBarrier(_countof(toDraw), toDraw);
+
+	mDrawArgsState = D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT;
+	mVisibleTreesState = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS GpuForest::VisibleTrees()const
+{
+	return mVisibleTrees->GetGPUVirtualAddress();
+}
+
+void GpuForest::Draw(ID3D12GraphicsCommandList* cmdList)
+{
+	cmdList->ExecuteIndirect(mCommandSignature.Get(), 1, mDrawArgs.Get(), 0, nullptr, 0);
+}
+
+void GpuForest::BuildResources(ID3D12GraphicsCommandList* cmdList)
+{
+	// Sized for the worst case of every tree being visible.
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(mTreeCount*sizeof(TreeInstance), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&mVisibleTrees)));
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(sizeof(D3D12_DRAW_ARGUMENTS), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&mDrawArgs)));
+
+	// One quad of two triangles per tree; the cull shader fills in the instance count.
+	D3D12_DRAW_ARGUMENTS resetArgs;
+	resetArgs.VertexCountPerInstance = 6;
+	resetArgs.InstanceCount = 0;
+	resetArgs.StartVertexLocation = 0;
+	resetArgs.StartInstanceLocation = 0;
+
+	mDrawArgsReset = d3dUtil::CreateDefaultBuffer(md3dDevice, cmdList,
+		&resetArgs, sizeof(resetArgs), mDrawArgsResetUploader);
+
+	// Only the draw is indirect; the root arguments are set as usual, so the
+	// signature does not need the root signature.
+	D3D12_INDIRECT_ARGUMENT_DESC argumentDesc = {};
+	argumentDesc.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW;
+
+	D3D12_COMMAND_SIGNATURE_DESC signatureDesc = {};
+	signatureDesc.ByteStride = sizeof(D3D12_DRAW_ARGUMENTS);
+	signatureDesc.NumArgumentDescs = 1;
+	signatureDesc.pArgumentDescs = &argumentDesc;
+	signatureDesc.NodeMask = 0;
+
+	ThrowIfFailed(md3dDevice->CreateCommandSignature(&signatureDesc, nullptr, IID_PPV_ARGS(&mCommandSignature)));
+}
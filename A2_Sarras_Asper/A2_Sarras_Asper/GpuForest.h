@@ -0,0 +1,104 @@
+//***************************************************************************************
+// GpuForest.h
+//
+// Scatters a large number of tree billboards entirely on the GPU.  Every frame a
+// compute shader places each tree from a hash of its index, culls it against the
+// camera frustum and appends the survivors to a buffer, counting them straight into
+// the instance count of an indirect draw.  The client then draws them with
+// ExecuteIndirect as instanced quads, expanded in the vertex shader from
+// SV_VertexID, so neither the CPU nor a geometry shader touches individual trees.
+//***************************************************************************************
+
+#ifndef GPUFOREST_H
+#define GPUFOREST_H
+
+#include "../../Common/d3dUtil.h"
+
+class GpuForest
+{
+public:
+	// Trees are placed in the square [-areaHalfExtent, areaHalfExtent]^2 of the
+	// y = groundHeight plane, leaving a disc of clearingRadius around the origin free.
+	GpuForest(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+		UINT treeCount, float areaHalfExtent, float clearingRadius, float groundHeight,
+		float minTreeSize, float maxTreeSize);
+	GpuForest(const GpuForest& rhs) = delete;
+	GpuForest& operator=(const GpuForest& rhs) = delete;
+	~GpuForest();
+
+	UINT TreeCount()const;
+
+	// World space box around every tree the forest can place.
+	DirectX::BoundingBox Bounds()const;
+
+	// Number of 32-bit root constants Cull sets at root parameter 0.  Parameters 1 and
+	// 2 must be root UAVs for the visible trees (u0) and the draw arguments (u1).
+	static UINT RootConstantCount();
+
+	// Records the scatter and cull pass.  planes are the world space frustum planes,
+	// facing outward, as returned by BoundingFrustum::GetPlanes.  Afterwards the
+	// visible trees can be read by vertex shaders and the draw arguments by Draw.
+	void Cull(
+		ID3D12GraphicsCommandList* cmdList,
+		ID3D12RootSignature* rootSig,
+		ID3D12PipelineState* pso,
+		const DirectX::XMFLOAT4 planes[6]);
+
+	// Structured buffer of the trees that survived the last Cull.
+	D3D12_GPU_VIRTUAL_ADDRESS VisibleTrees()const;
+
+	// Draws six vertices per visible tree; SV_InstanceID indexes VisibleTrees.
+	void Draw(ID3D12GraphicsCommandList* cmdList);
+
+private:
+	void BuildResources(ID3D12GraphicsCommandList* cmdList);
+
+private:
+	// Tree as written by the cull shader.
+	struct TreeInstance
+	{
+		DirectX::XMFLOAT3 PosW;
+		DirectX::XMFLOAT2 SizeW;
+		UINT Variant;
+	};
+
+	// Layout of cbForest in ForestCull.hlsl.
+	struct ForestConstants
+	{
+		DirectX::XMFLOAT4 FrustumPlanes[6];
+		UINT TreeCount;
+		float AreaHalfExtent;
+		float ClearingRadius;
+		float GroundHeight;
+		float MinTreeSize;
+		float MaxTreeSize;
+		float Pad0;
+		float Pad1;
+	};
+
+	ID3D12Device* md3dDevice = nullptr;
+
+	UINT mTreeCount = 0;
+	float mAreaHalfExtent = 0.0f;
+	float mClearingRadius = 0.0f;
+	float mGroundHeight = 0.0f;
+	float mMinTreeSize = 0.0f;
+	float mMaxTreeSize = 0.0f;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mVisibleTrees = nullptr;
+	D3D12_RESOURCE_STATES mVisibleTreesState = D3D12_RESOURCE_STATE_COMMON;
+
+	// D3D12_DRAW_ARGUMENTS whose InstanceCount the cull shader increments.  It is
+	// reset from mDrawArgsReset before every cull.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mDrawArgs = nullptr;
+	D3D12_RESOURCE_STATES mDrawArgsState = D3D12_RESOURCE_STATE_COMMON;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mDrawArgsReset = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mDrawArgsResetUploader = nullptr;
+
+	Microsoft::WRL::ComPtr<ID3D12CommandSignature> mCommandSignature = nullptr;
+
+	static const UINT CullGroupSize = 64;
+};
+
+#endif // GPUFOREST_H
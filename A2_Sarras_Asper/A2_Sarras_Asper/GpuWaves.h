@@ -0,0 +1,103 @@
+//***************************************************************************************
+// GpuWaves.h
+//
+// Performs the calculations for the wave simulation using the ComputeShader on the GPU.
+// The solution is saved to a floating-point texture.  The client must then set this
+// texture as a SRV and do the displacement mapping in the vertex shader over a grid.
+//
+// This is the GPU counterpart of Waves; it never touches the solution on the CPU.
+//***************************************************************************************
+
+#ifndef GPUWAVES_H
+#define GPUWAVES_H
+
+#include "../../Common/d3dUtil.h"
+
+class GpuWaves
+{
+public:
+	// Note that m,n should be divisible by 16 so there is no
+	// remainder when we divide into thread groups.
+	GpuWaves(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+		int m, int n, float dx, float dt, float speed, float damping);
+	GpuWaves(const GpuWaves& rhs) = delete;
+	GpuWaves& operator=(const GpuWaves& rhs) = delete;
+	~GpuWaves();
+
+	UINT RowCount()const;
+	UINT ColumnCount()const;
+	UINT VertexCount()const;
+	UINT TriangleCount()const;
+	float Width()const;
+	float Depth()const;
+	float SpatialStep()const;
+
+	// SRV of the current solution, sampled by the vertex shader for displacement.
+	CD3DX12_GPU_DESCRIPTOR_HANDLE DisplacementMap()const;
+
+	// Number of consecutive SRV/UAV heap descriptors BuildDescriptors fills.
+	UINT DescriptorCount()const;
+
+	void BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDescriptor,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuDescriptor,
+		UINT descriptorSize);
+
+	// Records the solver steps due for dt on cmdList.  Time left over is carried to
+	// the next call, and at most MaxSubsteps steps are recorded per call.  The
+	// current solution is left in the NON_PIXEL_SHADER_RESOURCE state.
+	void Update(
+		float dt,
+		ID3D12GraphicsCommandList* cmdList,
+		ID3D12RootSignature* rootSig,
+		ID3D12PipelineState* pso);
+
+	void Disturb(
+		ID3D12GraphicsCommandList* cmdList,
+		ID3D12RootSignature* rootSig,
+		ID3D12PipelineState* pso,
+		UINT i, UINT j,
+		float magnitude);
+
+private:
+	void BuildResources(ID3D12GraphicsCommandList* cmdList);
+	void Step(ID3D12GraphicsCommandList* cmdList);
+
+private:
+	UINT mNumRows = 0;
+	UINT mNumCols = 0;
+
+	UINT mVertexCount = 0;
+	UINT mTriangleCount = 0;
+
+	// Simulation constants we can precompute.
+	float mK[3];
+
+	float mTimeStep = 0.0f;
+	float mSpatialStep = 0.0f;
+
+	// Time accumulated toward the next solver step.
+	float mAccumTime = 0.0f;
+
+	static const int MaxSubsteps = 4;
+
+	ID3D12Device* md3dDevice = nullptr;
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mPrevSolSrv;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mCurrSolSrv;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mNextSolSrv;
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mPrevSolUav;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mCurrSolUav;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mNextSolUav;
+
+	// Three textures ping-ponged between prev, current and next solution.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mPrevSol = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mCurrSol = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mNextSol = nullptr;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mPrevUploadBuffer = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mCurrUploadBuffer = nullptr;
+};
+
+#endif // GPUWAVES_H
@@ -0,0 +1,161 @@
+//***************************************************************************************
+// PipelineCache.cpp
+//***************************************************************************************
+
+#include "PipelineCache.h"
+
+using Microsoft::WRL::ComPtr;
+
+PipelineCache::PipelineCache(ID3D12Device* device, const std::wstring& filename)
+{
+	md3dDevice = device;
+	mFilename = filename;
+
+	// Pipeline libraries need ID3D12Device1.  Without it every PSO is compiled.
+	if(FAILED(device->QueryInterface(IID_PPV_ARGS(&md3dDevice1))))
+		return;
+
+	OpenLibrary();
+}
+
+PipelineCache::~PipelineCache()
+{
+}
+
+ComPtr<ID3D12PipelineState> PipelineCache::CreateGraphicsPipeline(
+	const std::wstring& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+	ComPtr<ID3D12PipelineState> pso;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		// Fails if the library has no PSO by this name, or if its description changed.
+		if(mLibrary != nullptr && SUCCEEDED(mLibrary->LoadGraphicsPipeline(name.c_str(), &desc, IID_PPV_ARGS(&pso))))
+		{
+			Store(name, pso.Get(), false);
+			return pso;
+		}
+	}
+
+	// Compile outside the lock so several threads can create PSOs at once.
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pso)));
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	Store(name, pso.Get(), true);
+
+	return pso;
+}
+
+ComPtr<ID3D12PipelineState> PipelineCache::CreateComputePipeline(
+	const std::wstring& name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc)
+{
+	ComPtr<ID3D12PipelineState> pso;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		if(mLibrary != nullptr && SUCCEEDED(mLibrary->LoadComputePipeline(name.c_str(), &desc, IID_PPV_ARGS(&pso))))
+		{
+			Store(name, pso.Get(), false);
+			return pso;
+		}
+	}
+
+	ThrowIfFailed(md3dDevice->CreateComputePipelineState(&desc, IID_PPV_ARGS(&pso)));
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	Store(name, pso.Get(), true);
+
+	return pso;
+}
+
+void PipelineCache::Save()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	OutputDebugString((L"PipelineCache: " + std::to_wstring(mHitCount) + L" loaded, " +
+		std::to_wstring(mMissCount) + L" compiled\n").c_str());
+
+	if(md3dDevice1 == nullptr || !mDirty)
+		return;
+
+	// Build a fresh library from this run's PSOs.  Entries whose description
+	// changed cannot be replaced in the old one, and unused ones would pile up.
+	ComPtr<ID3D12PipelineLibrary> library;
+	if(FAILED(md3dDevice1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&library))))
+		return;
+
+	for(auto& pipeline : mPipelines)
+		ThrowIfFailed(library->StorePipeline(pipeline.first.c_str(), pipeline.second.Get()));
+
+	std::vector<char> data(library->GetSerializedSize());
+	ThrowIfFailed(library->Serialize(data.data(), data.size()));
+
+	// Write under a temporary name first, so an interrupted write never leaves a
+	// truncated library behind.
+	std::wstring tempFilename = mFilename + L".tmp";
+	{
+		std::ofstream fout(tempFilename, std::ios::binary);
+		fout.write(data.data(), data.size());
+		if(!fout)
+		{
+			fout.close();
+			DeleteFileW(tempFilename.c_str());
+			return;
+		}
+	}
+	MoveFileExW(tempFilename.c_str(), mFilename.c_str(), MOVEFILE_REPLACE_EXISTING);
+
+	// Later misses go into the library that matches the file again.
+	mLibrary = library;
+	mLibraryData = std::move(data);
+	mDirty = false;
+}
+
+UINT PipelineCache::HitCount()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mHitCount;
+}
+
+UINT PipelineCache::MissCount()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mMissCount;
+}
+
+void PipelineCache::OpenLibrary()
+{
+	std::ifstream fin(mFilename, std::ios::binary);
+	if(fin)
+		mLibraryData.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+
+	HRESULT hr = E_FAIL;
+	if(!mLibraryData.empty())
+		hr = md3dDevice1->CreatePipelineLibrary(mLibraryData.data(), mLibraryData.size(), IID_PPV_ARGS(&mLibrary));
+
+	// A driver update or a different adapter invalidates the file, so start over.
+	if(FAILED(hr))
+	{
+		mLibraryData.clear();
+		mLibrary = nullptr;
+
+		// Drivers without library support just compile every PSO.
+		if(FAILED(md3dDevice1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&mLibrary))))
+			mLibrary = nullptr;
+	}
+}
+
+void PipelineCache::Store(const std::wstring& name, ID3D12PipelineState* pso, bool compiled)
+{
+	mPipelines[name] = pso;
+
+	if(compiled)
+	{
+		++mMissCount;
+		mDirty = true;
+	}
+	else
+	{
+		++mHitCount;
+	}
+}
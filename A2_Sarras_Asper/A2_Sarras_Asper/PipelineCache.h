@@ -0,0 +1,65 @@
+//***************************************************************************************
+// PipelineCache.h
+//
+// Keeps the driver's compiled pipeline states on disk between runs in an
+// ID3D12PipelineLibrary.  A PSO found in the library is deserialized instead of being
+// recompiled by the driver.  The library is rewritten once all the PSOs of a run have
+// been created, if any of them had to be compiled.  When the library cannot be used
+// (older runtime, a driver update, a different adapter) PSOs are simply created the
+// usual way.
+//***************************************************************************************
+
+#ifndef PIPELINECACHE_H
+#define PIPELINECACHE_H
+
+#include "../../Common/d3dUtil.h"
+#include <mutex>
+
+class PipelineCache
+{
+public:
+	PipelineCache(ID3D12Device* device, const std::wstring& filename);
+	PipelineCache(const PipelineCache& rhs) = delete;
+	PipelineCache& operator=(const PipelineCache& rhs) = delete;
+	~PipelineCache();
+
+	// May be called from any thread.  name must be unique per description.
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> CreateGraphicsPipeline(
+		const std::wstring& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> CreateComputePipeline(
+		const std::wstring& name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc);
+
+	// Writes the library back to disk if any PSO was compiled this run.  Stale
+	// entries are dropped, since only the PSOs created this run are stored.
+	void Save();
+
+	UINT HitCount()const;
+	UINT MissCount()const;
+
+private:
+	void OpenLibrary();
+	void Store(const std::wstring& name, ID3D12PipelineState* pso, bool compiled);
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Device1> md3dDevice1;
+	std::wstring mFilename;
+
+	// Guards everything below.
+	mutable std::mutex mMutex;
+
+	// The library reads from this blob for as long as it lives.
+	std::vector<char> mLibraryData;
+	Microsoft::WRL::ComPtr<ID3D12PipelineLibrary> mLibrary;
+
+	// Every PSO created this run, which is what Save stores.
+	std::unordered_map<std::wstring, Microsoft::WRL::ComPtr<ID3D12PipelineState>> mPipelines;
+
+	// Set when a PSO was compiled and the file on disk lacks it.
+	bool mDirty = false;
+
+	UINT mHitCount = 0;
+	UINT mMissCount = 0;
+};
+
+#endif // PIPELINECACHE_H
@@ -0,0 +1,225 @@
+//***************************************************************************************
+// Profiler.cpp
+//***************************************************************************************
+
+#include "Profiler.h"
+
+// Weight of the newest frame in the displayed times.
+const float gSmoothing = 0.1f;
+
+Profiler::Profiler(ID3D12Device* device, ID3D12CommandQueue* queue, UINT frameResourceCount,
+	const std::vector<std::string>& gpuScopes,
+	const std::vector<std::string>& cpuScopes)
+{
+	md3dDevice = device;
+	mGpuScopeNames = gpuScopes;
+	mCpuScopeNames = cpuScopes;
+
+	UINT queryCount = 2 * (UINT)mGpuScopeNames.size() * frameResourceCount;
+
+	D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+	queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	queryHeapDesc.Count = queryCount;
+	queryHeapDesc.NodeMask = 0;
+	ThrowIfFailed(md3dDevice->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&mQueryHeap)));
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(queryCount*sizeof(UINT64)),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&mReadbackBuffer)));
+
+	ThrowIfFailed(queue->GetTimestampFrequency(&mTimestampFrequency));
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	mCpuTicksPerMillisecond = frequency.QuadPart / 1000.0;
+
+	mFrameSlots.resize(frameResourceCount);
+	for(auto& slot : mFrameSlots)
+		slot.CpuMilliseconds.resize(mCpuScopeNames.size());
+
+	mCpuTicks = std::make_unique<std::atomic<LONGLONG>[]>(mCpuScopeNames.size());
+	for(size_t i = 0; i < mCpuScopeNames.size(); ++i)
+		mCpuTicks[i] = 0;
+
+	mGpuMilliseconds.resize(mGpuScopeNames.size(), 0.0f);
+	mCpuMilliseconds.resize(mCpuScopeNames.size(), 0.0f);
+	mLatestGpuMilliseconds.resize(mGpuScopeNames.size(), 0.0f);
+	mLatestCpuMilliseconds.resize(mCpuScopeNames.size(), 0.0f);
+}
+
+Profiler::~Profiler()
+{
+}
+
+void Profiler::BeginFrame(UINT frameResourceIndex)
+{
+	mCurrFrameResourceIndex = frameResourceIndex;
+
+	if(mFrameSlots[frameResourceIndex].Pending)
+		ReadBack(frameResourceIndex);
+
+	for(size_t i = 0; i < mCpuScopeNames.size(); ++i)
+		mCpuTicks[i] = 0;
+}
+
+void Profiler::BeginGpuScope(ID3D12GraphicsCommandList* cmdList, UINT scope)
+{
+	UINT query = 2 * (mCurrFrameResourceIndex*(UINT)mGpuScopeNames.size() + scope);
+	cmdList->EndQuery(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, query);
+}
+
+void Profiler::EndGpuScope(ID3D12GraphicsCommandList* cmdList, UINT scope)
+{
+	UINT query = 2 * (mCurrFrameResourceIndex*(UINT)mGpuScopeNames.size() + scope) + 1;
+	cmdList->EndQuery(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, query);
+}
+
+void Profiler::EndFrame(ID3D12GraphicsCommandList* cmdList)
+{
+	// Each frame resource resolves into its own region, which nothing reads until its
+	// fence comes back.
+	UINT queriesPerFrame = 2 * (UINT)mGpuScopeNames.size();
+	UINT firstQuery = mCurrFrameResourceIndex*queriesPerFrame;
+	cmdList->ResolveQueryData(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+		firstQuery, queriesPerFrame, mReadbackBuffer.Get(), firstQuery*sizeof(UINT64));
+
+	FrameSlot& slot = mFrameSlots[mCurrFrameResourceIndex];
+	slot.Pending = true;
+	slot.FrameNumber = mFrameNumber++;
+	for(size_t i = 0; i < mCpuScopeNames.size(); ++i)
+		slot.CpuMilliseconds[i] = mCpuTicks[i] / mCpuTicksPerMillisecond;
+}
+
+Profiler::CpuScope::CpuScope(Profiler& profiler, UINT scope)
+	: mProfiler(profiler), mScope(scope)
+{
+	QueryPerformanceCounter(&mStart);
+}
+
+Profiler::CpuScope::~CpuScope()
+{
+	LARGE_INTEGER end;
+	QueryPerformanceCounter(&end);
+	mProfiler.mCpuTicks[mScope] += end.QuadPart - mStart.QuadPart;
+}
+
+float Profiler::GpuMilliseconds(UINT scope)const
+{
+	return mGpuMilliseconds[scope];
+}
+
+float Profiler::CpuMilliseconds(UINT scope)const
+{
+	return mCpuMilliseconds[scope];
+}
+
+float Profiler::LatestGpuMilliseconds(UINT scope)const
+{
+	return mLatestGpuMilliseconds[scope];
+}
+
+float Profiler::LatestCpuMilliseconds(UINT scope)const
+{
+	return mLatestCpuMilliseconds[scope];
+}
+
+UINT64 Profiler::ReadBackCount()const
+{
+	return mReadBackCount;
+}
+
+UINT Profiler::GpuScopeCount()const
+{
+	return (UINT)mGpuScopeNames.size();
+}
+
+UINT Profiler::CpuScopeCount()const
+{
+	return (UINT)mCpuScopeNames.size();
+}
+
+const std::string& Profiler::GpuScopeName(UINT scope)const
+{
+	return mGpuScopeNames[scope];
+}
+
+const std::string& Profiler::CpuScopeName(UINT scope)const
+{
+	return mCpuScopeNames[scope];
+}
+
+void Profiler::StartCapture(const std::wstring& filename)
+{
+	mCapture.close();
+	mCapture.clear();
+	mCapture.open(filename);
+
+	mCapture << "frame";
+	for(auto& name : mGpuScopeNames)
+		mCapture << ",gpu " << name << " (ms)";
+	for(auto& name : mCpuScopeNames)
+		mCapture << ",cpu " << name << " (ms)";
+	mCapture << "\n";
+}
+
+void Profiler::StopCapture()
+{
+	mCapture.close();
+}
+
+bool Profiler::IsCapturing()const
+{
+	return mCapture.is_open();
+}
+
+void Profiler::ReadBack(UINT frameResourceIndex)
+{
+	FrameSlot& slot = mFrameSlots[frameResourceIndex];
+	slot.Pending = false;
+
+	UINT queriesPerFrame = 2 * (UINT)mGpuScopeNames.size();
+	UINT firstQuery = frameResourceIndex*queriesPerFrame;
+
+	// Only this frame resource's region is read; the GPU may be writing the others.
+	D3D12_RANGE readRange = { firstQuery*sizeof(UINT64), (firstQuery + queriesPerFrame)*sizeof(UINT64) };
+	UINT64* timestamps = nullptr;
+	ThrowIfFailed(mReadbackBuffer->Map(0, &readRange, reinterpret_cast<void**>(&timestamps)));
+	timestamps += firstQuery;
+
+	std::vector<double> gpuMilliseconds(mGpuScopeNames.size());
+	for(size_t i = 0; i < mGpuScopeNames.size(); ++i)
+	{
+		UINT64 begin = timestamps[2*i];
+		UINT64 end = timestamps[2*i + 1];
+		gpuMilliseconds[i] = end > begin ? 1000.0*(end - begin) / mTimestampFrequency : 0.0;
+	}
+
+	D3D12_RANGE writeRange = { 0, 0 };
+	mReadbackBuffer->Unmap(0, &writeRange);
+
+	for(size_t i = 0; i < mGpuScopeNames.size(); ++i)
+	{
+		mLatestGpuMilliseconds[i] = (float)gpuMilliseconds[i];
+		mGpuMilliseconds[i] += gSmoothing*(mLatestGpuMilliseconds[i] - mGpuMilliseconds[i]);
+	}
+	for(size_t i = 0; i < mCpuScopeNames.size(); ++i)
+	{
+		mLatestCpuMilliseconds[i] = (float)slot.CpuMilliseconds[i];
+		mCpuMilliseconds[i] += gSmoothing*(mLatestCpuMilliseconds[i] - mCpuMilliseconds[i]);
+	}
+	++mReadBackCount;
+
+	if(mCapture.is_open())
+	{
+		mCapture << slot.FrameNumber;
+		for(double ms : gpuMilliseconds)
+			mCapture << "," << ms;
+		for(double ms : slot.CpuMilliseconds)
+			mCapture << "," << ms;
+		mCapture << "\n";
+	}
+}
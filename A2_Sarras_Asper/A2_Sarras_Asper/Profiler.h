@@ -0,0 +1,117 @@
+//***************************************************************************************
+// Profiler.h
+//
+// Times named GPU and CPU scopes of a frame.  GPU scopes are bracketed by timestamp
+// queries that are resolved into a readback buffer at the end of the frame, one region
+// per frame resource, and read back the next time that frame resource comes around, so
+// the CPU never waits on the GPU for the results.  CPU scopes are timed with the
+// performance counter and may be entered from several threads at once; their times
+// add up.  Results can be captured to a CSV file, one row per frame.
+//***************************************************************************************
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "../../Common/d3dUtil.h"
+#include <atomic>
+
+class Profiler
+{
+public:
+	// Scopes are identified by their index into gpuScopes and cpuScopes.
+	Profiler(ID3D12Device* device, ID3D12CommandQueue* queue, UINT frameResourceCount,
+		const std::vector<std::string>& gpuScopes,
+		const std::vector<std::string>& cpuScopes);
+	Profiler(const Profiler& rhs) = delete;
+	Profiler& operator=(const Profiler& rhs) = delete;
+	~Profiler();
+
+	// Call once the frame resource's fence has passed, before anything else is timed.
+	// Picks up the timings of the frame resource's previous frame.
+	void BeginFrame(UINT frameResourceIndex);
+
+	// Every GPU scope must be entered exactly once per frame, on the direct queue, since
+	// the whole frame's queries are resolved together.  Scopes may nest and may begin
+	// and end in different command lists, as long as the lists are submitted in order.
+	void BeginGpuScope(ID3D12GraphicsCommandList* cmdList, UINT scope);
+	void EndGpuScope(ID3D12GraphicsCommandList* cmdList, UINT scope);
+
+	// Records the resolve into the last command list of the frame, after every
+	// EndGpuScope in submission order.  Also closes the frame's CPU timings.
+	void EndFrame(ID3D12GraphicsCommandList* cmdList);
+
+	// Times a block of CPU code.  Safe to use from any thread.
+	class CpuScope
+	{
+	public:
+		CpuScope(Profiler& profiler, UINT scope);
+		CpuScope(const CpuScope& rhs) = delete;
+		CpuScope& operator=(const CpuScope& rhs) = delete;
+		~CpuScope();
+
+	private:
+		Profiler& mProfiler;
+		UINT mScope;
+		LARGE_INTEGER mStart;
+	};
+
+	// Milliseconds of the newest frame read back, smoothed over a few frames.
+	float GpuMilliseconds(UINT scope)const;
+	float CpuMilliseconds(UINT scope)const;
+
+	// Unsmoothed milliseconds of the newest frame read back, and how many frames have
+	// been read back so far, to tell when they change.
+	float LatestGpuMilliseconds(UINT scope)const;
+	float LatestCpuMilliseconds(UINT scope)const;
+	UINT64 ReadBackCount()const;
+
+	UINT GpuScopeCount()const;
+	UINT CpuScopeCount()const;
+	const std::string& GpuScopeName(UINT scope)const;
+	const std::string& CpuScopeName(UINT scope)const;
+
+	// Appends a row to filename for every frame read back until StopCapture.
+	void StartCapture(const std::wstring& filename);
+	void StopCapture();
+	bool IsCapturing()const;
+
+private:
+	void ReadBack(UINT frameResourceIndex);
+
+private:
+	// Timings recorded with one frame resource, waiting for its fence.
+	struct FrameSlot
+	{
+		bool Pending = false;
+		UINT64 FrameNumber = 0;
+		std::vector<double> CpuMilliseconds;
+	};
+
+	ID3D12Device* md3dDevice = nullptr;
+
+	std::vector<std::string> mGpuScopeNames;
+	std::vector<std::string> mCpuScopeNames;
+
+	// Two timestamps per GPU scope per frame resource.
+	Microsoft::WRL::ComPtr<ID3D12QueryHeap> mQueryHeap;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mReadbackBuffer;
+	UINT64 mTimestampFrequency = 1;
+
+	std::vector<FrameSlot> mFrameSlots;
+	UINT mCurrFrameResourceIndex = 0;
+	UINT64 mFrameNumber = 0;
+
+	// Performance counter ticks spent in each CPU scope this frame.
+	std::unique_ptr<std::atomic<LONGLONG>[]> mCpuTicks;
+	double mCpuTicksPerMillisecond = 1.0;
+
+	std::vector<float> mGpuMilliseconds;
+	std::vector<float> mCpuMilliseconds;
+	std::vector<float> mLatestGpuMilliseconds;
+	std::vector<float> mLatestCpuMilliseconds;
+	UINT64 mReadBackCount = 0;
+
+	std::ofstream mCapture;
+};
+
+#endif // PROFILER_H
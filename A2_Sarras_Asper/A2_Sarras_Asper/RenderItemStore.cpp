@@ -0,0 +1,133 @@
+//***************************************************************************************
+// RenderItemStore.cpp
+//***************************************************************************************
+
+#include "RenderItemStore.h"
+
+using namespace DirectX;
+
+RenderItemStore::RenderItemStore(UINT layerCount)
+{
+	mLayerSizes.resize(layerCount, 0);
+}
+
+RenderItemStore::~RenderItemStore()
+{
+}
+
+UINT RenderItemStore::Add(UINT layer, const RenderItem& item)
+{
+	assert(layer <= mLayerSizes.size());
+
+	UINT handle = (UINT)mSlots.size();
+	mSlots.push_back(Count());
+	mHandles.push_back(handle);
+
+	RenderItemDrawArgs drawArgs;
+	drawArgs.Geo = item.Geo;
+	drawArgs.PrimitiveType = item.PrimitiveType;
+	drawArgs.IndexCount = item.IndexCount;
+	drawArgs.StartIndexLocation = item.StartIndexLocation;
+	drawArgs.BaseVertexLocation = item.BaseVertexLocation;
+
+	Worlds.push_back(item.World);
+	TexTransforms.push_back(item.TexTransform);
+	Bounds.push_back(item.Bounds);
+	DrawArgs.push_back(drawArgs);
+	Materials.push_back(item.Mat);
+	ObjCBIndices.push_back(item.ObjCBIndex);
+	Layers.push_back(layer);
+	NumFramesDirty.push_back(gNumFrameResources);
+	Visible.push_back(1);
+	SortKeys.push_back(0);
+	Lods.emplace_back();
+	LodIndices.push_back(0);
+	TransformNodes.push_back(None);
+	DisplacementMapTexelSizes.push_back(item.DisplacementMapTexelSize);
+	GridSpatialSteps.push_back(item.GridSpatialStep);
+
+	if(layer < mLayerSizes.size())
+		mLayerSizes[layer]++;
+
+	return handle;
+}
+
+void RenderItemStore::Remove(UINT handle)
+{
+	UINT slot = mSlots[handle];
+	assert(slot != None);
+
+	if(Layers[slot] < mLayerSizes.size())
+		mLayerSizes[Layers[slot]]--;
+
+	// Keep the arrays packed by filling the hole with the last item.
+	UINT last = Count() - 1;
+	if(slot != last)
+		MoveSlot(last, slot);
+	PopSlot();
+
+	mSlots[handle] = None;
+}
+
+UINT RenderItemStore::Count()const
+{
+	return (UINT)mHandles.size();
+}
+
+UINT RenderItemStore::Slot(UINT handle)const
+{
+	return mSlots[handle];
+}
+
+UINT RenderItemStore::Handle(UINT slot)const
+{
+	return mHandles[slot];
+}
+
+UINT RenderItemStore::LayerSize(UINT layer)const
+{
+	return mLayerSizes[layer];
+}
+
+void RenderItemStore::MoveSlot(UINT from, UINT to)
+{
+	Worlds[to] = Worlds[from];
+	TexTransforms[to] = TexTransforms[from];
+	Bounds[to] = Bounds[from];
+	DrawArgs[to] = DrawArgs[from];
+	Materials[to] = Materials[from];
+	ObjCBIndices[to] = ObjCBIndices[from];
+	Layers[to] = Layers[from];
+	NumFramesDirty[to] = NumFramesDirty[from];
+	Visible[to] = Visible[from];
+	SortKeys[to] = SortKeys[from];
+	Lods[to] = std::move(Lods[from]);
+	LodIndices[to] = LodIndices[from];
+	TransformNodes[to] = TransformNodes[from];
+	DisplacementMapTexelSizes[to] = DisplacementMapTexelSizes[from];
+	GridSpatialSteps[to] = GridSpatialSteps[from];
+
+	mHandles[to] = mHandles[from];
+	mSlots[mHandles[to]] = to;
+}
+
+void RenderItemStore::PopSlot()
+{
+	Worlds.pop_back();
+	TexTransforms.pop_back();
+	Bounds.pop_back();
+	DrawArgs.pop_back();
+	Materials.pop_back();
+	ObjCBIndices.pop_back();
+	Layers.pop_back();
+	NumFramesDirty.pop_back();
+	Visible.pop_back();
+	SortKeys.pop_back();
+	Lods.pop_back();
+	LodIndices.pop_back();
+	TransformNodes.pop_back();
+	DisplacementMapTexelSizes.pop_back();
+	GridSpatialSteps.pop_back();
+
+	mHandles.pop_back();
+}
@@ -0,0 +1,133 @@
+//***************************************************************************************
+// RenderItemStore.h
+//
+// Render items kept as a structure of arrays: the transforms, bounds, draw arguments,
+// materials and per-frame state of every item each live in one packed array, so the
+// per-frame passes stream through the fields they use instead of chasing a pointer per
+// item.  Items are referred to by handles, which stay valid while others are added and
+// removed; the arrays are indexed by slot, and Remove moves the last item into the
+// slot it frees.
+//***************************************************************************************
+
+#ifndef RENDERITEMSTORE_H
+#define RENDERITEMSTORE_H
+
+#include "../../Common/d3dUtil.h"
+
+// Lightweight structure stores parameters to draw a shape.  This will
+// vary from app-to-app.  Only used to describe an item to RenderItemStore::Add.
+struct RenderItem
+{
+	RenderItem() = default;
+
+    // World matrix of the shape that describes the object's local space
+    // relative to the world space, which defines the position, orientation,
+    // and scale of the object in the world.
+    DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+
+	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+
+	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
+	// Items left at -1 get their constants from the frame's transient upload heap
+	// each time they are drawn, so they can be added without resizing ObjectCB.
+	UINT ObjCBIndex = -1;
+
+	Material* Mat = nullptr;
+	MeshGeometry* Geo = nullptr;
+
+    // Primitive topology.
+    D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+
+    // DrawIndexedInstanced parameters.
+    UINT IndexCount = 0;
+    UINT StartIndexLocation = 0;
+    int BaseVertexLocation = 0;
+
+	// Local space bounds of the geometry drawn, copied from the submesh.
+	DirectX::BoundingBox Bounds;
+
+	// Used by items that displace their vertices with the GpuWaves solution.
+	DirectX::XMFLOAT2 DisplacementMapTexelSize = { 1.0f, 1.0f };
+	float GridSpatialStep = 1.0f;
+};
+
+// What a draw of an item binds and draws, kept together for draw submission.
+struct RenderItemDrawArgs
+{
+	MeshGeometry* Geo = nullptr;
+	D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+
+	// Of the current level of detail.
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	int BaseVertexLocation = 0;
+};
+
+class RenderItemStore
+{
+public:
+	// Handle of no item.
+	static const UINT None = (UINT)-1;
+
+	// Items are in one of layerCount layers, or in none for layer == layerCount.
+	RenderItemStore(UINT layerCount);
+	RenderItemStore(const RenderItemStore& rhs) = delete;
+	RenderItemStore& operator=(const RenderItemStore& rhs) = delete;
+	~RenderItemStore();
+
+	// Returns the new item's handle.  Handles are never reused.  The item starts out
+	// dirty for every frame resource.
+	UINT Add(UINT layer, const RenderItem& item);
+	void Remove(UINT handle);
+
+	UINT Count()const;
+	UINT Slot(UINT handle)const;
+	UINT Handle(UINT slot)const;
+
+	// Number of items in layer.
+	UINT LayerSize(UINT layer)const;
+
+public:
+	// Indexed by slot and Count() long.  Fields may be written in place, but only Add
+	// and Remove change the sizes.
+	std::vector<DirectX::XMFLOAT4X4> Worlds;
+	std::vector<DirectX::XMFLOAT4X4> TexTransforms;
+	std::vector<DirectX::BoundingBox> Bounds;
+	std::vector<RenderItemDrawArgs> DrawArgs;
+	std::vector<Material*> Materials;
+	std::vector<UINT> ObjCBIndices;
+	std::vector<UINT> Layers;
+
+	// Frame resources still to get the item's object constants.
+	std::vector<int> NumFramesDirty;
+
+	// Result of frustum culling and the draw order within the layer, for the
+	// current frame.
+	std::vector<std::uint8_t> Visible;
+	std::vector<UINT64> SortKeys;
+
+	// Levels of detail of the mesh, finest first, or empty if it has only one, and the
+	// level the draw arguments are at.
+	std::vector<std::vector<const SubmeshGeometry*>> Lods;
+	std::vector<UINT> LodIndices;
+
+	// Node of the item in the app's transform hierarchy.
+	std::vector<UINT> TransformNodes;
+
+	std::vector<DirectX::XMFLOAT2> DisplacementMapTexelSizes;
+	std::vector<float> GridSpatialSteps;
+
+private:
+	void MoveSlot(UINT from, UINT to);
+	void PopSlot();
+
+private:
+	// Slot of every handle ever given out, None once removed, and the handle of
+	// every slot.
+	std::vector<UINT> mSlots;
+	std::vector<UINT> mHandles;
+
+	std::vector<UINT> mLayerSizes;
+};
+
+#endif // RENDERITEMSTORE_H
@@ -0,0 +1,319 @@
+//***************************************************************************************
+// SceneFile.cpp
+//***************************************************************************************
+
+#include "SceneFile.h"
+
+using namespace DirectX;
+
+// "SCNE" read as a little-endian UINT.
+const UINT gSceneFileMagic = 0x454e4353;
+
+namespace
+{
+	// For error messages.
+	std::string WStringToAnsi(const std::wstring& str)
+	{
+		char buffer[512];
+		WideCharToMultiByte(CP_ACP, 0, str.c_str(), -1, buffer, 512, nullptr, nullptr);
+		return std::string(buffer);
+	}
+
+	// Copies src into a fixed-size name field, failing if it does not fit.
+	template<size_t N>
+	bool CopyName(char (&dst)[N], const std::string& src)
+	{
+		if(src.size() >= N)
+			return false;
+
+		ZeroMemory(dst, N);
+		CopyMemory(dst, src.data(), src.size());
+		return true;
+	}
+
+	// Whether a fixed-size name field read from a file ends within the field.
+	template<size_t N>
+	bool IsTerminated(const char (&name)[N])
+	{
+		return memchr(name, '\0', N) != nullptr;
+	}
+
+	UINT64 AlignOffset(UINT64 offset)
+	{
+		return (offset + 15) & ~UINT64(15);
+	}
+}
+
+SceneDesc ParseSceneText(const std::wstring& filename)
+{
+	std::string name = WStringToAnsi(filename);
+
+	std::ifstream fin(filename);
+	if(!fin)
+		throw std::runtime_error(name + ": cannot be opened");
+
+	SceneDesc desc;
+
+	std::string line;
+	for(UINT lineNumber = 1; std::getline(fin, line); ++lineNumber)
+	{
+		auto fail = [&](const std::string& what)
+		{
+			throw std::runtime_error(name + "(" + std::to_string(lineNumber) + "): " + what);
+		};
+
+		std::istringstream tokens(line);
+		std::string keyword;
+		if(!(tokens >> keyword) || keyword[0] == '#')
+			continue;
+
+		if(keyword == "mesh")
+		{
+			SceneMeshDesc mesh;
+			if(!(tokens >> mesh.Name >> mesh.Shape))
+				fail("expected a mesh name and shape");
+
+			float param;
+			while(tokens >> param)
+				mesh.Params.push_back(param);
+			if(!tokens.eof())
+				fail("malformed number");
+
+			desc.Meshes.push_back(mesh);
+		}
+		else if(keyword == "item")
+		{
+			std::string itemName, layer, submesh, material;
+			XMFLOAT3 scale, translation;
+			if(!(tokens >> itemName >> layer >> submesh >> material >>
+				scale.x >> scale.y >> scale.z >> translation.x >> translation.y >> translation.z))
+				fail("expected name, layer, mesh, material, scale and translation");
+
+			std::string rest;
+			if(tokens >> rest)
+				fail("unexpected \"" + rest + "\"");
+
+			SceneItem item;
+			if(!CopyName(item.Name, itemName) || !CopyName(item.Layer, layer) ||
+				!CopyName(item.Submesh, submesh) || !CopyName(item.Material, material))
+				fail("name too long");
+
+			XMStoreFloat4x4(&item.World, XMMatrixScaling(scale.x, scale.y, scale.z) *
+				XMMatrixTranslation(translation.x, translation.y, translation.z));
+
+			desc.Items.push_back(item);
+		}
+		else
+		{
+			fail("unknown keyword \"" + keyword + "\"");
+		}
+	}
+
+	return desc;
+}
+
+UINT64 GetSceneSourceStamp(const std::wstring& filename)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if(!GetFileAttributesExW(filename.c_str(), GetFileExInfoStandard, &attributes))
+		return 0;
+
+	return (UINT64)attributes.ftLastWriteTime.dwHighDateTime << 32 | attributes.ftLastWriteTime.dwLowDateTime;
+}
+
+CompiledScene::CompiledScene()
+{
+}
+
+CompiledScene::~CompiledScene()
+{
+	Close();
+}
+
+bool CompiledScene::Open(const std::wstring& filename, UINT64 sourceStamp, UINT vertexByteStride)
+{
+	Close();
+
+	mFile = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(mFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(mFile, &fileSize) || (UINT64)fileSize.QuadPart < sizeof(Header))
+	{
+		Close();
+		return false;
+	}
+
+	mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(mMapping != nullptr)
+		mView = reinterpret_cast<const char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	if(mView == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	// Every table must lie inside the file, so a truncated or foreign file is
+	// rejected here instead of being read past its end.
+	const Header& header = GetHeader();
+	UINT64 size = (UINT64)fileSize.QuadPart;
+	auto fits = [size](UINT64 offset, UINT64 byteSize)
+	{
+		return offset <= size && byteSize <= size - offset;
+	};
+
+	bool valid =
+		header.Magic == gSceneFileMagic &&
+		header.Version == gSceneFileVersion &&
+		(sourceStamp == 0 || header.SourceStamp == sourceStamp) &&
+		header.VertexByteStride == vertexByteStride &&
+		fits(header.VertexOffset, (UINT64)header.VertexCount*header.VertexByteStride) &&
+		fits(header.IndexOffset, header.IndexByteSize) &&
+		fits(header.SubmeshOffset, (UINT64)header.SubmeshCount*sizeof(SceneSubmesh)) &&
+		fits(header.ItemOffset, (UINT64)header.ItemCount*sizeof(SceneItem));
+
+	// The names are read as C strings, so each must end inside its field.
+	for(UINT i = 0; valid && i < header.SubmeshCount; ++i)
+		valid = IsTerminated(Submesh(i).Name);
+
+	for(UINT i = 0; valid && i < header.ItemCount; ++i)
+	{
+		const SceneItem& item = Item(i);
+		valid = IsTerminated(item.Name) && IsTerminated(item.Layer) &&
+			IsTerminated(item.Submesh) && IsTerminated(item.Material);
+	}
+
+	if(!valid)
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void CompiledScene::Create(const std::wstring& filename, UINT64 sourceStamp,
+	const Geometry& geometry, const std::vector<SceneItem>& items)
+{
+	Close();
+
+	// Each block starts 16-byte aligned, so the mapped tables can be read in place.
+	Header header = {};
+	header.Magic = gSceneFileMagic;
+	header.Version = gSceneFileVersion;
+	header.SourceStamp = sourceStamp;
+	header.VertexCount = geometry.VertexCount;
+	header.VertexByteStride = geometry.VertexByteStride;
+	header.IndexByteSize = geometry.IndexByteSize;
+	header.IndexFormat = geometry.IndexFormat;
+	header.SubmeshCount = (UINT)geometry.Submeshes.size();
+	header.ItemCount = (UINT)items.size();
+	header.VertexOffset = AlignOffset(sizeof(Header));
+	header.IndexOffset = AlignOffset(header.VertexOffset + (UINT64)geometry.VertexCount*geometry.VertexByteStride);
+	header.SubmeshOffset = AlignOffset(header.IndexOffset + geometry.IndexByteSize);
+	header.ItemOffset = AlignOffset(header.SubmeshOffset + geometry.Submeshes.size()*sizeof(SceneSubmesh));
+
+	std::vector<char> data((size_t)(header.ItemOffset + items.size()*sizeof(SceneItem)));
+	CopyMemory(&data[0], &header, sizeof(Header));
+	CopyMemory(&data[(size_t)header.VertexOffset], geometry.Vertices, (size_t)geometry.VertexCount*geometry.VertexByteStride);
+	CopyMemory(&data[(size_t)header.IndexOffset], geometry.Indices, geometry.IndexByteSize);
+	if(!geometry.Submeshes.empty())
+		CopyMemory(&data[(size_t)header.SubmeshOffset], geometry.Submeshes.data(), geometry.Submeshes.size()*sizeof(SceneSubmesh));
+	if(!items.empty())
+		CopyMemory(&data[(size_t)header.ItemOffset], items.data(), items.size()*sizeof(SceneItem));
+
+	std::string name = WStringToAnsi(filename);
+
+	// Write under a temporary name first, so an interrupted write never leaves a
+	// truncated scene behind.
+	std::wstring tempFilename = filename + L".tmp";
+	{
+		std::ofstream fout(tempFilename, std::ios::binary);
+		fout.write(data.data(), data.size());
+		if(!fout)
+		{
+			fout.close();
+			DeleteFileW(tempFilename.c_str());
+			throw std::runtime_error(name + ": cannot be written");
+		}
+	}
+	if(!MoveFileExW(tempFilename.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileW(tempFilename.c_str());
+		throw std::runtime_error(name + ": cannot be written");
+	}
+
+	if(!Open(filename, sourceStamp, geometry.VertexByteStride))
+		throw std::runtime_error(name + ": cannot be read back");
+}
+
+void CompiledScene::Close()
+{
+	if(mView != nullptr)
+		UnmapViewOfFile(mView);
+	if(mMapping != nullptr)
+		CloseHandle(mMapping);
+	if(mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+
+	mView = nullptr;
+	mMapping = nullptr;
+	mFile = INVALID_HANDLE_VALUE;
+}
+
+const void* CompiledScene::VertexData()const
+{
+	return mView + GetHeader().VertexOffset;
+}
+
+UINT CompiledScene::VertexCount()const
+{
+	return GetHeader().VertexCount;
+}
+
+UINT CompiledScene::VertexByteStride()const
+{
+	return GetHeader().VertexByteStride;
+}
+
+const void* CompiledScene::IndexData()const
+{
+	return mView + GetHeader().IndexOffset;
+}
+
+UINT CompiledScene::IndexByteSize()const
+{
+	return GetHeader().IndexByteSize;
+}
+
+DXGI_FORMAT CompiledScene::IndexFormat()const
+{
+	return GetHeader().IndexFormat;
+}
+
+UINT CompiledScene::SubmeshCount()const
+{
+	return GetHeader().SubmeshCount;
+}
+
+const SceneSubmesh& CompiledScene::Submesh(UINT i)const
+{
+	return reinterpret_cast<const SceneSubmesh*>(mView + GetHeader().SubmeshOffset)[i];
+}
+
+UINT CompiledScene::ItemCount()const
+{
+	return GetHeader().ItemCount;
+}
+
+const SceneItem& CompiledScene::Item(UINT i)const
+{
+	return reinterpret_cast<const SceneItem*>(mView + GetHeader().ItemOffset)[i];
+}
+
+const CompiledScene::Header& CompiledScene::GetHeader()const
+{
+	return *reinterpret_cast<const Header*>(mView);
+}
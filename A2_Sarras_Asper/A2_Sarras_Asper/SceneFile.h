@@ -0,0 +1,132 @@
+//***************************************************************************************
+// SceneFile.h
+//
+// Scenes are authored as text (see Scenes/Castle.txt) and compiled into a binary file
+// that holds the finished vertex and index data next to the submesh and item tables.
+// A compiled scene is memory-mapped and its buffers are copied straight to the GPU, so
+// loading does no parsing and no mesh generation.  The binary remembers the write
+// time of the text it came from and is rebuilt whenever the text changes.
+//***************************************************************************************
+
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+#include "../../Common/d3dUtil.h"
+
+// Bump whenever the layout or the way meshes are generated changes, so older
+// compiled scenes are rebuilt.
+const UINT gSceneFileVersion = 1;
+
+// A range of the scene's buffers, as stored in the compiled file.
+struct SceneSubmesh
+{
+	char Name[48];
+	UINT IndexCount;
+	UINT StartIndexLocation;
+	INT BaseVertexLocation;
+	DirectX::BoundingBox Bounds;
+};
+
+// One placed mesh, as stored in the compiled file.  World is baked from the
+// item's scale and translation.
+struct SceneItem
+{
+	char Name[48];
+	char Layer[24];
+	char Submesh[48];
+	char Material[24];
+	DirectX::XMFLOAT4X4 World;
+};
+
+// A mesh line of the text: a shape and its generator's parameters.
+struct SceneMeshDesc
+{
+	std::string Name;
+	std::string Shape;
+	std::vector<float> Params;
+};
+
+struct SceneDesc
+{
+	std::vector<SceneMeshDesc> Meshes;
+	std::vector<SceneItem> Items;
+};
+
+// Throws std::runtime_error naming the file and line of malformed input.
+SceneDesc ParseSceneText(const std::wstring& filename);
+
+// Last write time of filename, or 0 if it does not exist.
+UINT64 GetSceneSourceStamp(const std::wstring& filename);
+
+class CompiledScene
+{
+public:
+	// Geometry to compile, laid out the way the app draws it.
+	struct Geometry
+	{
+		const void* Vertices = nullptr;
+		UINT VertexCount = 0;
+		UINT VertexByteStride = 0;
+		const void* Indices = nullptr;
+		UINT IndexByteSize = 0;
+		DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
+		std::vector<SceneSubmesh> Submeshes;
+	};
+
+	CompiledScene();
+	CompiledScene(const CompiledScene& rhs) = delete;
+	CompiledScene& operator=(const CompiledScene& rhs) = delete;
+	~CompiledScene();
+
+	// Maps filename.  Fails if it is missing, malformed, from another version, has
+	// another vertex stride, or was compiled from another sourceStamp.  A sourceStamp
+	// of 0, for a scene shipped without its text, accepts any.
+	bool Open(const std::wstring& filename, UINT64 sourceStamp, UINT vertexByteStride);
+
+	// Writes the scene to filename and maps it.  Throws std::runtime_error if the
+	// file cannot be written.
+	void Create(const std::wstring& filename, UINT64 sourceStamp,
+		const Geometry& geometry, const std::vector<SceneItem>& items);
+
+	void Close();
+
+	// Valid until Close.
+	const void* VertexData()const;
+	UINT VertexCount()const;
+	UINT VertexByteStride()const;
+	const void* IndexData()const;
+	UINT IndexByteSize()const;
+	DXGI_FORMAT IndexFormat()const;
+
+	UINT SubmeshCount()const;
+	const SceneSubmesh& Submesh(UINT i)const;
+	UINT ItemCount()const;
+	const SceneItem& Item(UINT i)const;
+
+private:
+	struct Header
+	{
+		UINT Magic;
+		UINT Version;
+		UINT64 SourceStamp;
+		UINT VertexCount;
+		UINT VertexByteStride;
+		UINT IndexByteSize;
+		DXGI_FORMAT IndexFormat;
+		UINT SubmeshCount;
+		UINT ItemCount;
+		UINT64 VertexOffset;
+		UINT64 IndexOffset;
+		UINT64 SubmeshOffset;
+		UINT64 ItemOffset;
+	};
+
+	const Header& GetHeader()const;
+
+private:
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	HANDLE mMapping = nullptr;
+	const char* mView = nullptr;
+};
+
+#endif // SCENEFILE_H
@@ -0,0 +1,182 @@
+//***************************************************************************************
+// ShaderCache.cpp
+//***************************************************************************************
+
+#include "ShaderCache.h"
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	const UINT64 FnvOffsetBasis = 14695981039346656037ull;
+	const UINT64 FnvPrime = 1099511628211ull;
+
+	// 64-bit FNV-1a, continued from hash.
+	UINT64 HashBytes(UINT64 hash, const void* data, size_t byteSize)
+	{
+		const BYTE* bytes = reinterpret_cast<const BYTE*>(data);
+		for(size_t i = 0; i < byteSize; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= FnvPrime;
+		}
+
+		return hash;
+	}
+
+	UINT64 HashString(UINT64 hash, const std::string& str)
+	{
+		// Hash the terminator too, so "ab"+"c" and "a"+"bc" differ.
+		return HashBytes(hash, str.c_str(), str.size() + 1);
+	}
+
+	std::string WStringToAnsi(const std::wstring& str)
+	{
+		int size = WideCharToMultiByte(CP_ACP, 0, str.c_str(), -1, nullptr, 0, nullptr, nullptr);
+		std::string result(size, '\0');
+		WideCharToMultiByte(CP_ACP, 0, str.c_str(), -1, &result[0], size, nullptr, nullptr);
+		result.resize(size - 1);
+
+		return result;
+	}
+}
+
+ShaderCache::ShaderCache(const std::wstring& cacheDirectory)
+{
+	mCacheDirectory = cacheDirectory;
+
+	// Fails harmlessly if the directory is already there.
+	CreateDirectoryW(mCacheDirectory.c_str(), nullptr);
+}
+
+ShaderCache::~ShaderCache()
+{
+}
+
+ComPtr<ID3DBlob> ShaderCache::CompileShader(
+	const std::string& name,
+	const std::wstring& filename,
+	const D3D_SHADER_MACRO* defines,
+	const std::string& entrypoint,
+	const std::string& target)
+{
+	UINT64 hash = HashShader(filename, defines, entrypoint, target);
+
+	wchar_t hashText[17];
+	swprintf_s(hashText, L"%016llx", hash);
+
+	std::wstring entryName = AnsiToWString(name) + L"_" + hashText + L".cso";
+	std::wstring path = mCacheDirectory + L"\\" + entryName;
+
+	if(hash != 0 && GetFileAttributesW(path.c_str()) != INVALID_FILE_ATTRIBUTES)
+	{
+		ComPtr<ID3DBlob> byteCode = d3dUtil::LoadBinary(path);
+		if(byteCode->GetBufferSize() > 0)
+		{
+			++mHitCount;
+			return byteCode;
+		}
+	}
+
+	++mMissCount;
+
+	ComPtr<ID3DBlob> byteCode = d3dUtil::CompileShader(filename, defines, entrypoint, target);
+	if(byteCode == nullptr || hash == 0)
+		return byteCode;
+
+	RemoveStaleEntries(AnsiToWString(name), entryName);
+
+	// Write under a temporary name first, so an interrupted write never leaves a
+	// truncated blob behind a valid key.
+	std::wstring tempPath = path + L".tmp";
+	{
+		std::ofstream fout(tempPath, std::ios::binary);
+		fout.write(reinterpret_cast<const char*>(byteCode->GetBufferPointer()), byteCode->GetBufferSize());
+		if(!fout)
+		{
+			fout.close();
+			DeleteFileW(tempPath.c_str());
+			return byteCode;
+		}
+	}
+	MoveFileExW(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+
+	return byteCode;
+}
+
+UINT ShaderCache::HitCount()const
+{
+	return mHitCount;
+}
+
+UINT ShaderCache::MissCount()const
+{
+	return mMissCount;
+}
+
+UINT64 ShaderCache::HashShader(
+	const std::wstring& filename,
+	const D3D_SHADER_MACRO* defines,
+	const std::string& entrypoint,
+	const std::string& target)const
+{
+	std::ifstream fin(filename, std::ios::binary);
+	if(!fin)
+		return 0;
+
+	std::string source((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+	fin.close();
+
+	// Preprocessing resolves the includes and defines for a fraction of the cost of
+	// a compile, so a change anywhere in the source invalidates the entry.
+	ComPtr<ID3DBlob> preprocessed;
+	ComPtr<ID3DBlob> errors;
+	HRESULT hr = D3DPreprocess(source.data(), source.size(), WStringToAnsi(filename).c_str(),
+		defines, D3D_COMPILE_STANDARD_FILE_INCLUDE, &preprocessed, &errors);
+	if(FAILED(hr))
+		return 0;
+
+	// Must match the flags d3dUtil::CompileShader compiles with.
+	UINT compileFlags = 0;
+#if defined(DEBUG) || defined(_DEBUG)
+	compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+
+	UINT64 hash = FnvOffsetBasis;
+	hash = HashBytes(hash, preprocessed->GetBufferPointer(), preprocessed->GetBufferSize());
+	hash = HashString(hash, entrypoint);
+	hash = HashString(hash, target);
+	hash = HashBytes(hash, &compileFlags, sizeof(compileFlags));
+
+	for(const D3D_SHADER_MACRO* define = defines; define != nullptr && define->Name != nullptr; ++define)
+	{
+		hash = HashString(hash, define->Name);
+		hash = HashString(hash, define->Definition != nullptr ? define->Definition : "");
+	}
+
+	// 0 is reserved for "could not hash".
+	return hash != 0 ? hash : 1;
+}
+
+void ShaderCache::RemoveStaleEntries(const std::wstring& name, const std::wstring& keep)const
+{
+	std::wstring pattern = mCacheDirectory + L"\\" + name + L"_*.cso";
+
+	WIN32_FIND_DATAW findData;
+	HANDLE find = FindFirstFileW(pattern.c_str(), &findData);
+	if(find == INVALID_HANDLE_VALUE)
+		return;
+
+	do
+	{
+		std::wstring entryName = findData.cFileName;
+
+		// Only name_<16 hex digits>.cso, so a shader whose name merely starts with
+		// this one keeps its entries.
+		if(entryName != keep && entryName.size() == keep.size())
+			DeleteFileW((mCacheDirectory + L"\\" + entryName).c_str());
+	}
+	while(FindNextFileW(find, &findData));
+
+	FindClose(find);
+}
@@ -0,0 +1,56 @@
+//***************************************************************************************
+// ShaderCache.h
+//
+// Keeps compiled shader bytecode on disk as .cso files so later launches can load it
+// with d3dUtil::LoadBinary instead of compiling.  Each entry is keyed by a hash of the
+// preprocessed source (so edits to included files and the defines count), the entry
+// point, the target and the compile flags.  When the key no longer matches a file on
+// disk the shader is compiled at runtime and the stale file is replaced.
+//***************************************************************************************
+
+#ifndef SHADERCACHE_H
+#define SHADERCACHE_H
+
+#include "../../Common/d3dUtil.h"
+
+class ShaderCache
+{
+public:
+	// cacheDirectory is created if it does not exist yet.
+	ShaderCache(const std::wstring& cacheDirectory);
+	ShaderCache(const ShaderCache& rhs) = delete;
+	ShaderCache& operator=(const ShaderCache& rhs) = delete;
+	~ShaderCache();
+
+	// Same as d3dUtil::CompileShader, but served from the cache when the source has
+	// not changed.  name identifies the shader within the cache and must be unique
+	// per combination of file, defines and entry point.  Returns nullptr if the
+	// shader failed to compile.
+	Microsoft::WRL::ComPtr<ID3DBlob> CompileShader(
+		const std::string& name,
+		const std::wstring& filename,
+		const D3D_SHADER_MACRO* defines,
+		const std::string& entrypoint,
+		const std::string& target);
+
+	UINT HitCount()const;
+	UINT MissCount()const;
+
+private:
+	// Returns 0 if the source could not be read or preprocessed.
+	UINT64 HashShader(
+		const std::wstring& filename,
+		const D3D_SHADER_MACRO* defines,
+		const std::string& entrypoint,
+		const std::string& target)const;
+
+	void RemoveStaleEntries(const std::wstring& name, const std::wstring& keep)const;
+
+private:
+	std::wstring mCacheDirectory;
+
+	UINT mHitCount = 0;
+	UINT mMissCount = 0;
+};
+
+#endif // SHADERCACHE_H
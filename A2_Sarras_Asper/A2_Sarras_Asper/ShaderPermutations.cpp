@@ -0,0 +1,88 @@
+//***************************************************************************************
+// ShaderPermutations.cpp
+//***************************************************************************************
+
+#include "ShaderPermutations.h"
+#include <cassert>
+
+using Microsoft::WRL::ComPtr;
+
+bool ShaderPermutation::operator==(const ShaderPermutation& rhs)const
+{
+	return DirLights == rhs.DirLights && PointLights == rhs.PointLights &&
+		SpotLights == rhs.SpotLights && Fog == rhs.Fog && Clustered == rhs.Clustered;
+}
+
+bool ShaderPermutation::operator!=(const ShaderPermutation& rhs)const
+{
+	return !(*this == rhs);
+}
+
+std::string ShaderPermutation::Suffix()const
+{
+	return "_d" + std::to_string(DirLights) + "p" + std::to_string(PointLights) +
+		"s" + std::to_string(SpotLights) + (Fog ? "_fog" : "") + (Clustered ? "_clustered" : "");
+}
+
+ShaderPermutations::ShaderPermutations(ShaderCache* shaderCache)
+{
+	mShaderCache = shaderCache;
+}
+
+ShaderPermutations::~ShaderPermutations()
+{
+}
+
+ComPtr<ID3DBlob> ShaderPermutations::Get(const ShaderDesc& desc, const ShaderPermutation& permutation)
+{
+	// The shaders size their light array by MaxLights.
+	assert(!desc.Lit || permutation.DirLights + permutation.PointLights + permutation.SpotLights <= MaxLights);
+
+	std::string name = desc.Name;
+	std::vector<std::pair<std::string, std::string>> defines = desc.Defines;
+	if(desc.Lit)
+	{
+		name += permutation.Suffix();
+		defines.push_back({ "NUM_DIR_LIGHTS", std::to_string(permutation.DirLights) });
+		defines.push_back({ "NUM_POINT_LIGHTS", std::to_string(permutation.PointLights) });
+		defines.push_back({ "NUM_SPOT_LIGHTS", std::to_string(permutation.SpotLights) });
+		if(permutation.Fog)
+			defines.push_back({ "FOG", "1" });
+		if(permutation.Clustered)
+			defines.push_back({ "CLUSTERED_LIGHTING", "1" });
+	}
+	if(desc.AlphaTest)
+		defines.push_back({ "ALPHA_TEST", "1" });
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto it = mVariants.find(name);
+	if(it != mVariants.end())
+		return it->second;
+
+	std::vector<D3D_SHADER_MACRO> macros;
+	for(auto& define : defines)
+		macros.push_back({ define.first.c_str(), define.second.c_str() });
+	macros.push_back({ nullptr, nullptr });
+
+	ComPtr<ID3DBlob> byteCode = mShaderCache->CompileShader(name, desc.Filename,
+		defines.empty() ? nullptr : macros.data(), desc.EntryPoint, desc.Target);
+
+	// Failures are not kept, so the next Get tries again.
+	if(byteCode != nullptr)
+		mVariants[name] = byteCode;
+
+	return byteCode;
+}
+
+void ShaderPermutations::Invalidate()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mVariants.clear();
+}
+
+UINT ShaderPermutations::VariantCount()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return (UINT)mVariants.size();
+}
@@ -0,0 +1,78 @@
+//***************************************************************************************
+// ShaderPermutations.h
+//
+// Compiles the variants of a shader that differ only in compile-time features: how
+// many lights of each kind the lit pixel shaders loop over, whether they also read
+// the clustered lights, fog, and alpha testing.
+// The client picks the smallest permutation that covers what a pass actually uses.
+// Each variant goes through the ShaderCache under a name of its own, so every variant
+// has its own file on disk, and is then kept in memory, so switching back to a
+// permutation built before costs nothing.
+//***************************************************************************************
+
+#ifndef SHADERPERMUTATIONS_H
+#define SHADERPERMUTATIONS_H
+
+#include "../../Common/d3dUtil.h"
+#include "ShaderCache.h"
+#include <mutex>
+
+// The features of a pass that lit shaders are compiled for.
+struct ShaderPermutation
+{
+	UINT DirLights = 1;
+	UINT PointLights = 0;
+	UINT SpotLights = 0;
+	bool Fog = false;
+
+	// Adds the point and spot lights binned by ClusteredLights to the ones above.
+	bool Clustered = false;
+
+	bool operator==(const ShaderPermutation& rhs)const;
+	bool operator!=(const ShaderPermutation& rhs)const;
+
+	// Appended to a lit shader's name, e.g. "_d1p0s0" or "_d3p2s0_fog_clustered".
+	std::string Suffix()const;
+};
+
+// How a shader is compiled.  Lit shaders get NUM_DIR_LIGHTS, NUM_POINT_LIGHTS,
+// NUM_SPOT_LIGHTS, FOG and CLUSTERED_LIGHTING from the permutation they are compiled
+// for; the others ignore it.  Alpha tested shaders are compiled with ALPHA_TEST.
+struct ShaderDesc
+{
+	std::string Name;
+	std::wstring Filename;
+	std::vector<std::pair<std::string, std::string>> Defines;
+	std::string EntryPoint;
+	std::string Target;
+	bool Lit = false;
+	bool AlphaTest = false;
+};
+
+class ShaderPermutations
+{
+public:
+	ShaderPermutations(ShaderCache* shaderCache);
+	ShaderPermutations(const ShaderPermutations& rhs) = delete;
+	ShaderPermutations& operator=(const ShaderPermutations& rhs) = delete;
+	~ShaderPermutations();
+
+	// May be called from any thread.  Returns the variant of desc for permutation,
+	// compiling it on first use.  Returns nullptr if the shader failed to compile.
+	Microsoft::WRL::ComPtr<ID3DBlob> Get(const ShaderDesc& desc, const ShaderPermutation& permutation);
+
+	// Forgets the variants kept in memory, for when their sources changed.  Later
+	// calls to Get go back to the ShaderCache, which only recompiles what changed.
+	void Invalidate();
+
+	UINT VariantCount()const;
+
+private:
+	ShaderCache* mShaderCache = nullptr;
+
+	// Guards everything below, and serializes the ShaderCache.
+	mutable std::mutex mMutex;
+	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3DBlob>> mVariants;
+};
+
+#endif // SHADERPERMUTATIONS_H
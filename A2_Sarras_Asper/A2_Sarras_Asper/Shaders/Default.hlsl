@@ -20,7 +20,25 @@
 // Include structures and functions for lighting.
 #include "LightingUtil.hlsl"
 
+#ifdef BINDLESS
+// Every texture slot, bound once per frame.  Materials pick theirs by DiffuseMapIndex.
+// The range also spans the Texture2DArray SRVs (treeArrayTex and the placeholder array
+// slot), which must never be indexed through this table; only the tree sprites sample
+// them, through a table of their own.
+Texture2D    gTextureMaps[BINDLESS_TEXTURE_COUNT] : register(t0, space2);
+#else
 Texture2D    gDiffuseMap : register(t0);
+#endif
+
+#ifdef DISPLACEMENT_MAP
+// Height field written by the GpuWaves compute solver.
+Texture2D    gDisplacementMap : register(t1);
+#endif
+
+#ifdef TERRAIN
+// Heights of the whole terrain, in the slot the displacement map takes elsewhere.
+Texture2D    gHeightMap : register(t1);
+#endif
 
 
 SamplerState gsamPointWrap        : register(s0);
@@ -35,8 +53,50 @@ cbuffer cbPerObject : register(b0)
 {
     float4x4 gWorld;
 	float4x4 gTexTransform;
+	float2 gDisplacementMapTexelSize;
+	float gGridSpatialStep;
+	uint gMaterialIndex;
+};
+
+// Per-instance data for the instanced path; replaces cbPerObject.
+struct InstanceData
+{
+    float4x4 World;
+	float4x4 TexTransform;
+	uint     MaterialIndex;
+	uint     InstPad0;
+	uint     InstPad1;
+	uint     InstPad2;
+};
+
+// Every material of the scene, indexed by gMaterialIndex or MaterialIndex.
+struct MaterialData
+{
+	float4   DiffuseAlbedo;
+    float3   FresnelR0;
+    float    Roughness;
+	float4x4 MatTransform;
+	uint     DiffuseMapIndex;
+	uint     MatPad0;
+	uint     MatPad1;
+	uint     MatPad2;
+};
+
+#ifdef TERRAIN
+// Tile picked by Terrain::Select; replaces the instance data.
+struct TerrainTile
+{
+	float2 CenterW;
+	float  Size;
+	float  SkirtDepth;
 };
 
+StructuredBuffer<TerrainTile> gTerrainTiles : register(t0, space1);
+#else
+StructuredBuffer<InstanceData> gInstanceData : register(t0, space1);
+#endif
+StructuredBuffer<MaterialData> gMaterialData : register(t1, space1);
+
 // Constant data that varies per material.
 cbuffer cbPass : register(b1)
 {
@@ -66,15 +126,58 @@ cbuffer cbPass : register(b1)
     // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
     // are spot lights for a maximum of MaxLights per object.
     Light gLights[MaxLights];
+
+    // Clusters the point and spot lights are binned into; see ClusteredLights.h.
+    uint gClusterCountX;
+    uint gClusterCountY;
+    uint gClusterCountZ;
+    uint gMaxLightsPerCluster;
+    float gClusterDepthScale;
+    float gClusterDepthBias;
+
+    // Clustered lights [0, gClusteredPointLightCount) are point lights; the
+    // rest are spot lights.
+    uint gClusteredPointLightCount;
+    uint cbPerObjectPad3;
 };
 
-cbuffer cbMaterial : register(b2)
+#ifdef CLUSTERED_LIGHTING
+// World space lights, and the lights touching each cluster as ClusteredLights::Cull
+// listed them.
+StructuredBuffer<Light> gClusteredLights     : register(t0, space3);
+StructuredBuffer<uint>  gClusterLightCounts  : register(t1, space3);
+StructuredBuffer<uint>  gClusterLightIndices : register(t2, space3);
+
+// Sums the point and spot lights of the cluster the pixel at posH lies in.
+float3 ComputeClusteredLighting(float4 posH, float3 posW, Material mat, float3 normal, float3 toEye)
 {
-	float4   gDiffuseAlbedo;
-    float3   gFresnelR0;
-    float    gRoughness;
-	float4x4 gMatTransform;
-};
+    float viewDepth = mul(float4(posW, 1.0f), gView).z;
+
+    uint3 cluster;
+    cluster.xy = (uint2)(posH.xy*gInvRenderTargetSize*float2(gClusterCountX, gClusterCountY));
+    cluster.xy = min(cluster.xy, uint2(gClusterCountX - 1, gClusterCountY - 1));
+    cluster.z = (uint)max(log(viewDepth)*gClusterDepthScale - gClusterDepthBias, 0.0f);
+    cluster.z = min(cluster.z, gClusterCountZ - 1);
+
+    uint clusterIndex = (cluster.z*gClusterCountY + cluster.y)*gClusterCountX + cluster.x;
+    uint lightCount = gClusterLightCounts[clusterIndex];
+    uint firstIndex = clusterIndex*gMaxLightsPerCluster;
+
+    float3 result = 0.0f;
+    for(uint i = 0; i < lightCount; ++i)
+    {
+        uint lightIndex = gClusterLightIndices[firstIndex + i];
+        Light light = gClusteredLights[lightIndex];
+
+        if(lightIndex < gClusteredPointLightCount)
+            result += ComputePointLight(light, mat, posW, normal, toEye);
+        else
+            result += ComputeSpotLight(light, mat, posW, normal, toEye);
+    }
+
+    return result;
+}
+#endif
 
 struct VertexIn
 {
@@ -89,32 +192,109 @@ struct VertexOut
     float3 PosW    : POSITION;
     float3 NormalW : NORMAL;
 	float2 TexC    : TEXCOORD;
+
+	// Same for the whole draw call's object, so it is not interpolated.
+	nointerpolation uint MatIndex : MATINDEX;
 };
 
-VertexOut VS(VertexIn vin)
+VertexOut TransformVertex(VertexIn vin, float4x4 world, float4x4 texTransform, uint matIndex)
 {
 	VertexOut vout = (VertexOut)0.0f;
+
+	MaterialData matData = gMaterialData[matIndex];
+	vout.MatIndex = matIndex;
 	
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(vin.PosL, 1.0f), world);
     vout.PosW = posW.xyz;
 
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
+    vout.NormalW = mul(vin.NormalL, (float3x3)world);
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
 	
 	// Output vertex attributes for interpolation across triangle.
-	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
-	vout.TexC = mul(texC, gMatTransform).xy;
+	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), texTransform);
+	vout.TexC = mul(texC, matData.MatTransform).xy;
 
     return vout;
 }
 
+VertexOut VS(VertexIn vin)
+{
+#ifdef DISPLACEMENT_MAP
+	// Sample the displacement map using non-transformed [0,1]^2 tex-coords.
+	vin.PosL.y += gDisplacementMap.SampleLevel(gsamLinearWrap, vin.TexC, 0.0f).r;
+
+	// Estimate normal using finite difference.
+	float du = gDisplacementMapTexelSize.x;
+	float dv = gDisplacementMapTexelSize.y;
+	float l = gDisplacementMap.SampleLevel(gsamPointClamp, vin.TexC - float2(du, 0.0f), 0.0f).r;
+	float r = gDisplacementMap.SampleLevel(gsamPointClamp, vin.TexC + float2(du, 0.0f), 0.0f).r;
+	float t = gDisplacementMap.SampleLevel(gsamPointClamp, vin.TexC - float2(0.0f, dv), 0.0f).r;
+	float b = gDisplacementMap.SampleLevel(gsamPointClamp, vin.TexC + float2(0.0f, dv), 0.0f).r;
+	vin.NormalL = normalize(float3(-r + l, 2.0f*gGridSpatialStep, b - t));
+#endif
+
+    return TransformVertex(vin, gWorld, gTexTransform, gMaterialIndex);
+}
+
+#ifdef TERRAIN
+// Vertices of the unit tile from GeometryGenerator::CreateTerrainTile, placed by the
+// tile and lifted to the height map.  gGridSpatialStep is the world distance between
+// height samples, and the map's v runs from +z to -z like CreateGrid's.
+VertexOut VSTerrain(VertexIn vin, uint instanceID : SV_InstanceID)
+{
+	TerrainTile tile = gTerrainTiles[instanceID];
+
+	float3 posW;
+	posW.xz = tile.CenterW + vin.PosL.xz*tile.Size;
+
+	float2 mapSize = gGridSpatialStep / gDisplacementMapTexelSize;
+	float2 uv = float2(posW.x, -posW.z) / mapSize + 0.5f;
+
+	// Skirt vertices have y = -1.
+	posW.y = gHeightMap.SampleLevel(gsamLinearClamp, uv, 0.0f).r + vin.PosL.y*tile.SkirtDepth;
+
+	// Estimate normal using finite difference.
+	float du = gDisplacementMapTexelSize.x;
+	float dv = gDisplacementMapTexelSize.y;
+	float l = gHeightMap.SampleLevel(gsamLinearClamp, uv - float2(du, 0.0f), 0.0f).r;
+	float r = gHeightMap.SampleLevel(gsamLinearClamp, uv + float2(du, 0.0f), 0.0f).r;
+	float t = gHeightMap.SampleLevel(gsamLinearClamp, uv - float2(0.0f, dv), 0.0f).r;
+	float b = gHeightMap.SampleLevel(gsamLinearClamp, uv + float2(0.0f, dv), 0.0f).r;
+
+	// The tile is already in world space; the texture is tiled over the world by
+	// gTexTransform.
+	vin.PosL = posW;
+	vin.NormalL = normalize(float3(l - r, 2.0f*gGridSpatialStep, b - t));
+	vin.TexC = posW.xz;
+
+	return TransformVertex(vin, gWorld, gTexTransform, gMaterialIndex);
+}
+#else
+VertexOut VSInstanced(VertexIn vin, uint instanceID : SV_InstanceID)
+{
+    // The instance buffer is bound at the batch's first instance, so
+    // SV_InstanceID indexes it directly.
+    InstanceData instData = gInstanceData[instanceID];
+
+    return TransformVertex(vin, instData.World, instData.TexTransform, instData.MaterialIndex);
+}
+#endif
+
 float4 PS(VertexOut pin) : SV_Target
 {
-    float4 diffuseAlbedo = gDiffuseMap.Sample(gsamAnisotropicWrap, pin.TexC) * gDiffuseAlbedo;
+	MaterialData matData = gMaterialData[pin.MatIndex];
+
+#ifdef BINDLESS
+    // Instance batches never mix materials, so the index is uniform across a draw.
+    // Wrap it in NonUniformResourceIndex once one draw can mix materials.
+    float4 diffuseAlbedo = gTextureMaps[matData.DiffuseMapIndex].Sample(gsamAnisotropicWrap, pin.TexC) * matData.DiffuseAlbedo;
+#else
+    float4 diffuseAlbedo = gDiffuseMap.Sample(gsamAnisotropicWrap, pin.TexC) * matData.DiffuseAlbedo;
+#endif
 	
 #ifdef ALPHA_TEST
 	// Discard pixel if texture alpha < 0.1.  We do this test as soon 
@@ -134,12 +314,16 @@ float4 PS(VertexOut pin) : SV_Target
     // Light terms.
     float4 ambient = gAmbientLight*diffuseAlbedo;
 
-    const float shininess = 1.0f - gRoughness;
-    Material mat = { diffuseAlbedo, gFresnelR0, shininess };
+    const float shininess = 1.0f - matData.Roughness;
+    Material mat = { diffuseAlbedo, matData.FresnelR0, shininess };
     float3 shadowFactor = 1.0f;
     float4 directLight = ComputeLighting(gLights, mat, pin.PosW,
         pin.NormalW, toEyeW, shadowFactor);
 
+#ifdef CLUSTERED_LIGHTING
+    directLight.rgb += ComputeClusteredLighting(pin.PosH, pin.PosW, mat, pin.NormalW, toEyeW);
+#endif
+
     float4 litColor = ambient + directLight;
 
 #ifdef FOG
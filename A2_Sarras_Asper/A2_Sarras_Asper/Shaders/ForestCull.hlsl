@@ -0,0 +1,90 @@
+//***************************************************************************************
+// ForestCull.hlsl
+//
+// ScatterCullCS(): Places every tree of the forest from a hash of its index, culls
+//     it against the camera frustum and appends the visible ones for an indirect
+//     instanced draw.
+//***************************************************************************************
+
+cbuffer cbForest : register(b0)
+{
+	// World space, facing outward.
+	float4 gFrustumPlanes[6];
+
+	uint  gTreeCount;
+	float gAreaHalfExtent;
+	float gClearingRadius;
+	float gGroundHeight;
+	float gMinTreeSize;
+	float gMaxTreeSize;
+	float2 cbForestPad;
+};
+
+struct TreeInstance
+{
+	float3 PosW;
+	float2 SizeW;
+	uint   Variant;
+};
+
+RWStructuredBuffer<TreeInstance> gVisibleTrees : register(u0);
+
+// D3D12_DRAW_ARGUMENTS; InstanceCount is at byte offset 4.
+RWByteAddressBuffer gDrawArgs : register(u1);
+
+uint Hash(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+// Uniform in [0, 1), advancing state.
+float Random01(inout uint state)
+{
+	state = Hash(state);
+	return (state & 0x00ffffffu) / 16777216.0f;
+}
+
+[numthreads(64, 1, 1)]
+void ScatterCullCS(int3 dispatchThreadID : SV_DispatchThreadID)
+{
+	uint treeIndex = dispatchThreadID.x;
+	if(treeIndex >= gTreeCount)
+		return;
+
+	// The same index always lands in the same spot, so the forest is stable
+	// without being stored anywhere.
+	uint state = treeIndex + 1;
+	float x = lerp(-gAreaHalfExtent, gAreaHalfExtent, Random01(state));
+	float z = lerp(-gAreaHalfExtent, gAreaHalfExtent, Random01(state));
+	float size = lerp(gMinTreeSize, gMaxTreeSize, Random01(state));
+	uint variant = Hash(state) % 3;
+
+	if(x*x + z*z < gClearingRadius*gClearingRadius)
+		return;
+
+	float3 center = float3(x, gGroundHeight + 0.5f*size, z);
+
+	// The quad turns to face the camera, so bound it by its half diagonal.
+	float radius = 0.70710678f*size;
+
+	[unroll]
+	for(int i = 0; i < 6; ++i)
+	{
+		if(dot(float4(center, 1.0f), gFrustumPlanes[i]) > radius)
+			return;
+	}
+
+	uint slot;
+	gDrawArgs.InterlockedAdd(4, 1, slot);
+
+	TreeInstance tree;
+	tree.PosW = center;
+	tree.SizeW = float2(size, size);
+	tree.Variant = variant;
+	gVisibleTrees[slot] = tree;
+}
@@ -0,0 +1,112 @@
+//***************************************************************************************
+// LightCull.hlsl
+//
+// CullLightsCS(): Bounds every cluster of the view by a view space box and lists
+//     the point and spot lights whose spheres of influence touch it.
+//***************************************************************************************
+
+#include "LightingUtil.hlsl"
+
+// Must match ClusteredLights::CullGroupSize.
+#define CULL_GROUP_SIZE 128
+
+cbuffer cbClusters : register(b0)
+{
+	float4x4 gView;
+	float4x4 gInvProj;
+
+	uint  gClusterCountX;
+	uint  gClusterCountY;
+	uint  gClusterCountZ;
+	uint  gMaxLightsPerCluster;
+	float gNearZ;
+	float gFarZ;
+	uint  gLightCount;
+	float cbClustersPad;
+};
+
+// World space lights; only Position and FalloffEnd are read.
+StructuredBuffer<Light> gLights : register(t0);
+
+RWStructuredBuffer<uint> gClusterLightCounts : register(u0);
+
+// gMaxLightsPerCluster entries per cluster.
+RWStructuredBuffer<uint> gClusterLightIndices : register(u1);
+
+// View space spheres of the lights the group is testing, radius in w.
+groupshared float4 gLightSpheres[CULL_GROUP_SIZE];
+
+// Point on the near plane seen through uv, with uv = (0, 0) the top left corner
+// of the screen.
+float3 ScreenToView(float2 uv)
+{
+	float2 ndc = float2(2.0f*uv.x - 1.0f, 1.0f - 2.0f*uv.y);
+	float4 posV = mul(float4(ndc, 0.0f, 1.0f), gInvProj);
+	return posV.xyz / posV.w;
+}
+
+[numthreads(CULL_GROUP_SIZE, 1, 1)]
+void CullLightsCS(int3 dispatchThreadID : SV_DispatchThreadID, int groupIndex : SV_GroupIndex)
+{
+	uint clusterIndex = dispatchThreadID.x;
+
+	// Threads past the last cluster still load lights for the rest of the group.
+	bool isCluster = clusterIndex < gClusterCountX*gClusterCountY*gClusterCountZ;
+
+	uint3 cluster;
+	cluster.x = clusterIndex % gClusterCountX;
+	cluster.y = (clusterIndex / gClusterCountX) % gClusterCountY;
+	cluster.z = clusterIndex / (gClusterCountX*gClusterCountY);
+
+	// Depth range of the cluster's slice, the same slices the pixel shader picks.
+	float depthRatio = gFarZ / gNearZ;
+	float sliceNear = gNearZ*pow(depthRatio, (float)cluster.z / gClusterCountZ);
+	float sliceFar = gNearZ*pow(depthRatio, (float)(cluster.z + 1) / gClusterCountZ);
+
+	// Opposite corners of the tile, scaled to a depth of 1.  The tile's edges run
+	// straight out from the eye, so its corners at both slice depths bound it.
+	float2 clusterCounts = float2(gClusterCountX, gClusterCountY);
+	float3 corner0 = ScreenToView(cluster.xy / clusterCounts);
+	float3 corner1 = ScreenToView((cluster.xy + 1) / clusterCounts);
+	corner0 /= corner0.z;
+	corner1 /= corner1.z;
+
+	float3 boxMin = min(min(corner0*sliceNear, corner0*sliceFar), min(corner1*sliceNear, corner1*sliceFar));
+	float3 boxMax = max(max(corner0*sliceNear, corner0*sliceFar), max(corner1*sliceNear, corner1*sliceFar));
+
+	uint lightCount = 0;
+	uint firstIndex = clusterIndex*gMaxLightsPerCluster;
+
+	// Each pass the group loads one light per thread, and every thread tests its
+	// cluster against all of them.
+	for(uint first = 0; first < gLightCount; first += CULL_GROUP_SIZE)
+	{
+		uint lightIndex = first + groupIndex;
+		if(lightIndex < gLightCount)
+		{
+			Light light = gLights[lightIndex];
+			gLightSpheres[groupIndex] = float4(mul(float4(light.Position, 1.0f), gView).xyz, light.FalloffEnd);
+		}
+		GroupMemoryBarrierWithGroupSync();
+
+		uint batchSize = min(CULL_GROUP_SIZE, gLightCount - first);
+		for(uint i = 0; isCluster && i < batchSize; ++i)
+		{
+			float4 sphere = gLightSpheres[i];
+
+			// Distance from the light to the closest point of the box.
+			float3 d = clamp(sphere.xyz, boxMin, boxMax) - sphere.xyz;
+			if(dot(d, d) <= sphere.w*sphere.w && lightCount < gMaxLightsPerCluster)
+			{
+				gClusterLightIndices[firstIndex + lightCount] = first + i;
+				++lightCount;
+			}
+		}
+
+		// The next pass overwrites the spheres.
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if(isCluster)
+		gClusterLightCounts[clusterIndex] = lightCount;
+}
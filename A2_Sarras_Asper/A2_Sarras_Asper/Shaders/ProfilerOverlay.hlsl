@@ -0,0 +1,26 @@
+//***************************************************************************************
+// ProfilerOverlay.hlsl
+//
+// Draws one solid rectangle of the profiler overlay per draw from root constants.
+//***************************************************************************************
+
+cbuffer cbBar : register(b0)
+{
+	// Left, top, right, bottom in normalized device coordinates.
+	float4 gRect;
+	float4 gColor;
+};
+
+// Triangle strip of four vertices.
+float4 VS(uint vertexID : SV_VertexID) : SV_POSITION
+{
+	float x = (vertexID & 1) ? gRect.z : gRect.x;
+	float y = (vertexID & 2) ? gRect.w : gRect.y;
+
+	return float4(x, y, 0.0f, 1.0f);
+}
+
+float4 PS(float4 posH : SV_POSITION) : SV_Target
+{
+	return gColor;
+}
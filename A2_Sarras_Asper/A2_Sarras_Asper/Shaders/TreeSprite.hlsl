@@ -36,8 +36,36 @@ cbuffer cbPerObject : register(b0)
 {
     float4x4 gWorld;
 	float4x4 gTexTransform;
+	float2 gDisplacementMapTexelSize;
+	float gGridSpatialStep;
+	uint gMaterialIndex;
 };
 
+// Every material of the scene; the sprites are one draw, so cbPerObject picks theirs.
+struct MaterialData
+{
+	float4   DiffuseAlbedo;
+    float3   FresnelR0;
+    float    Roughness;
+	float4x4 MatTransform;
+	uint     DiffuseMapIndex;
+	uint     MatPad0;
+	uint     MatPad1;
+	uint     MatPad2;
+};
+
+StructuredBuffer<MaterialData> gMaterialData : register(t1, space1);
+
+// Trees written by ForestCull.hlsl, one per instance of the indirect draw.
+struct TreeInstance
+{
+	float3 PosW;
+	float2 SizeW;
+	uint   Variant;
+};
+
+StructuredBuffer<TreeInstance> gTreeInstances : register(t0, space1);
+
 // Constant data that varies per material.
 cbuffer cbPass : register(b1)
 {
@@ -69,13 +97,6 @@ cbuffer cbPass : register(b1)
     Light gLights[MaxLights];
 };
 
-cbuffer cbMaterial : register(b2)
-{
-	float4   gDiffuseAlbedo;
-    float3   gFresnelR0;
-    float    gRoughness;
-	float4x4 gMatTransform;
-};
  
 struct VertexIn
 {
@@ -167,11 +188,66 @@ void GS(point VertexOut gin[1], //PrimitiveType InputVertexType InputName[NumEle
 	}
 }
 
-//step6
-float4 PS(GeoOut pin) : SV_Target
+// Quad corner i of the GS strip above, as an offset along (right, up).
+static const float2 gQuadCorners[4] =
 {
-	float3 uvw = float3(pin.TexC, pin.PrimID%3);
-    float4 diffuseAlbedo = gTreeMapArray.Sample(gsamAnisotropicWrap, uvw) * gDiffuseAlbedo;
+	float2( 1.0f, -1.0f),
+	float2( 1.0f,  1.0f),
+	float2(-1.0f, -1.0f),
+	float2(-1.0f,  1.0f)
+};
+
+static const float2 gQuadTexC[4] =
+{
+	float2(0.0f, 1.0f),
+	float2(0.0f, 0.0f),
+	float2(1.0f, 1.0f),
+	float2(1.0f, 0.0f)
+};
+
+struct QuadOut
+{
+	float4 PosH    : SV_POSITION;
+    float3 PosW    : POSITION;
+    float3 NormalW : NORMAL;
+    float2 TexC    : TEXCOORD;
+    nointerpolation uint Slice : SLICE;
+};
+
+// Expands the trees of the GPU forest into quads without a geometry shader.  Each
+// instance is one tree, drawn as six vertices forming the two triangles of the strip.
+QuadOut VSIndirect(uint vertexID : SV_VertexID, uint instanceID : SV_InstanceID)
+{
+	static const uint cornerIndices[6] = { 0, 1, 2, 2, 1, 3 };
+	uint corner = cornerIndices[vertexID];
+
+	TreeInstance tree = gTreeInstances[instanceID];
+
+	float3 up = float3(0.0f, 1.0f, 0.0f);
+	float3 look = gEyePosW - tree.PosW;
+	look.y = 0.0f; // y-axis aligned, so project to xz-plane
+	look = normalize(look);
+	float3 right = cross(up, look);
+
+	float2 offset = gQuadCorners[corner]*0.5f*tree.SizeW;
+	float3 posW = tree.PosW + offset.x*right + offset.y*up;
+
+	QuadOut vout;
+	vout.PosH    = mul(float4(posW, 1.0f), gViewProj);
+	vout.PosW    = posW;
+	vout.NormalW = look;
+	vout.TexC    = gQuadTexC[corner];
+	vout.Slice   = tree.Variant;
+
+	return vout;
+}
+
+float4 ShadeTree(float3 posW, float3 normalW, float2 texC, uint slice)
+{
+	MaterialData matData = gMaterialData[gMaterialIndex];
+
+	float3 uvw = float3(texC, slice);
+    float4 diffuseAlbedo = gTreeMapArray.Sample(gsamAnisotropicWrap, uvw) * matData.DiffuseAlbedo;
 
     //using dynamic indexing
     //float4 diffuseAlbedo = gTreeMapArray[pin.PrimID % 3].Sample(gsamAnisotropicWrap, pin.TexC) * gDiffuseAlbedo;
@@ -185,21 +261,21 @@ float4 PS(GeoOut pin) : SV_Target
 #endif
 
     // Interpolating normal can unnormalize it, so renormalize it.
-    pin.NormalW = normalize(pin.NormalW);
+    normalW = normalize(normalW);
 
     // Vector from point being lit to eye. 
-	float3 toEyeW = gEyePosW - pin.PosW;
+	float3 toEyeW = gEyePosW - posW;
 	float distToEye = length(toEyeW);
 	toEyeW /= distToEye; // normalize
 
     // Light terms.
     float4 ambient = gAmbientLight*diffuseAlbedo;
 
-    const float shininess = 1.0f - gRoughness;
-    Material mat = { diffuseAlbedo, gFresnelR0, shininess };
+    const float shininess = 1.0f - matData.Roughness;
+    Material mat = { diffuseAlbedo, matData.FresnelR0, shininess };
     float3 shadowFactor = 1.0f;
-    float4 directLight = ComputeLighting(gLights, mat, pin.PosW,
-        pin.NormalW, toEyeW, shadowFactor);
+    float4 directLight = ComputeLighting(gLights, mat, posW,
+        normalW, toEyeW, shadowFactor);
 
     float4 litColor = ambient + directLight;
 
@@ -214,4 +290,15 @@ float4 PS(GeoOut pin) : SV_Target
     return litColor;
 }
 
+//step6
+float4 PS(GeoOut pin) : SV_Target
+{
+	return ShadeTree(pin.PosW, pin.NormalW, pin.TexC, pin.PrimID%3);
+}
+
+float4 PSIndirect(QuadOut pin) : SV_Target
+{
+	return ShadeTree(pin.PosW, pin.NormalW, pin.TexC, pin.Slice);
+}
+
 
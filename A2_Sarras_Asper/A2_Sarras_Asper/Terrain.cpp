@@ -0,0 +1,254 @@
+//***************************************************************************************
+// Terrain.cpp
+//***************************************************************************************
+
+#include "Terrain.h"
+#include <cassert>
+#include <cfloat>
+
+using namespace DirectX;
+
+Terrain::Terrain(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+	float size, UINT heightResolution, const std::vector<float>& heights,
+	UINT levelCount, UINT tileResolution, float splitDistance)
+{
+	md3dDevice = device;
+
+	mSize = size;
+	mHeightResolution = heightResolution;
+	mLevelCount = levelCount;
+	mTileResolution = tileResolution;
+	mSplitDistance = splitDistance;
+
+	assert(heights.size() == (size_t)heightResolution*heightResolution);
+	assert(levelCount > 0 && heightResolution % (1 << (levelCount - 1)) == 0);
+
+	BuildHeightRanges(heights);
+	BuildResources(cmdList, heights);
+
+	mTiles.reserve(MaxTileCount());
+}
+
+Terrain::~Terrain()
+{
+}
+
+float Terrain::Size()const
+{
+	return mSize;
+}
+
+UINT Terrain::HeightResolution()const
+{
+	return mHeightResolution;
+}
+
+float Terrain::SpatialStep()const
+{
+	return mSize / mHeightResolution;
+}
+
+BoundingBox Terrain::Bounds()const
+{
+	XMFLOAT2 range = mHeightRanges[0][0];
+
+	BoundingBox bounds;
+	bounds.Center = XMFLOAT3(0.0f, 0.5f*(range.x + range.y), 0.0f);
+	bounds.Extents = XMFLOAT3(0.5f*mSize, 0.5f*(range.y - range.x), 0.5f*mSize);
+	return bounds;
+}
+
+UINT Terrain::MaxTileCount()
+{
+	return 2048;
+}
+
+CD3DX12_GPU_DESCRIPTOR_HANDLE Terrain::HeightMap()const
+{
+	return mHeightMapSrv;
+}
+
+UINT Terrain::DescriptorCount()const
+{
+	return 1;
+}
+
+void Terrain::BuildHeightRanges(const std::vector<float>& heights)
+{
+	mHeightRanges.resize(mLevelCount);
+
+	// Each leaf also takes the samples just outside its edges, which the linear filter
+	// blends into its border vertices.
+	UINT leafCount = 1 << (mLevelCount - 1);
+	UINT samplesPerLeaf = mHeightResolution / leafCount;
+
+	auto& leaves = mHeightRanges[mLevelCount - 1];
+	leaves.resize(leafCount*leafCount);
+	for(UINT z = 0; z < leafCount; ++z)
+	{
+		for(UINT x = 0; x < leafCount; ++x)
+		{
+			UINT firstRow = z*samplesPerLeaf > 0 ? z*samplesPerLeaf - 1 : 0;
+			UINT firstColumn = x*samplesPerLeaf > 0 ? x*samplesPerLeaf - 1 : 0;
+			UINT lastRow = std::min<UINT>((z + 1)*samplesPerLeaf, mHeightResolution - 1);
+			UINT lastColumn = std::min<UINT>((x + 1)*samplesPerLeaf, mHeightResolution - 1);
+
+			XMFLOAT2 range(FLT_MAX, -FLT_MAX);
+			for(UINT i = firstRow; i <= lastRow; ++i)
+			{
+				for(UINT j = firstColumn; j <= lastColumn; ++j)
+				{
+					float h = heights[i*mHeightResolution + j];
+					range.x = std::min<float>(range.x, h);
+					range.y = std::max<float>(range.y, h);
+				}
+			}
+
+			leaves[z*leafCount + x] = range;
+		}
+	}
+
+	// Every node spans its four children.
+	for(int level = (int)mLevelCount - 2; level >= 0; --level)
+	{
+		UINT nodeCount = 1 << level;
+		auto& nodes = mHeightRanges[level];
+		const auto& children = mHeightRanges[level + 1];
+		nodes.resize(nodeCount*nodeCount);
+
+		for(UINT z = 0; z < nodeCount; ++z)
+		{
+			for(UINT x = 0; x < nodeCount; ++x)
+			{
+				XMFLOAT2 range(FLT_MAX, -FLT_MAX);
+				for(UINT k = 0; k < 4; ++k)
+				{
+					const XMFLOAT2& child = children[(2*z + k / 2)*2*nodeCount + 2*x + k % 2];
+					range.x = std::min<float>(range.x, child.x);
+					range.y = std::max<float>(range.y, child.y);
+				}
+
+				nodes[z*nodeCount + x] = range;
+			}
+		}
+	}
+}
+
+void Terrain::BuildResources(ID3D12GraphicsCommandList* cmdList, const std::vector<float>& heights)
+{
+	D3D12_RESOURCE_DESC texDesc;
+	ZeroMemory(&texDesc, sizeof(D3D12_RESOURCE_DESC));
+	texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	texDesc.Alignment = 0;
+	texDesc.Width = mHeightResolution;
+	texDesc.Height = mHeightResolution;
+	texDesc.DepthOrArraySize = 1;
+	texDesc.MipLevels = 1;
+	texDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	texDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&mHeightMap)));
+
+	const UINT64 uploadBufferSize = GetRequiredIntermediateSize(mHeightMap.Get(), 0, 1);
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(mHeightMapUploadBuffer.GetAddressOf())));
+
+	D3D12_SUBRESOURCE_DATA subResourceData = {};
+	subResourceData.pData = heights.data();
+	subResourceData.RowPitch = mHeightResolution*sizeof(float);
+	subResourceData.SlicePitch = subResourceData.RowPitch * mHeightResolution;
+
+	// Only the vertex shader reads the heights.
+	UpdateSubresources(cmdList, mHeightMap.Get(), mHeightMapUploadBuffer.Get(), 0, 0, 1, &subResourceData);
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mHeightMap.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+}
+
+void Terrain::BuildDescriptors(
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDescriptor,
+	CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuDescriptor,
+	UINT descriptorSize)
+{
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.Texture2D.MipLevels = 1;
+
+	md3dDevice->CreateShaderResourceView(mHeightMap.Get(), &srvDesc, hCpuDescriptor);
+
+	mHeightMapSrv = hGpuDescriptor;
+}
+
+void Terrain::Select(const XMFLOAT3& eyePosW, const BoundingFrustum& frustumW, bool cull)
+{
+	mTiles.clear();
+	SelectNode(0, 0, 0, eyePosW, frustumW, cull);
+}
+
+const std::vector<Terrain::Tile>& Terrain::Tiles()const
+{
+	return mTiles;
+}
+
+void Terrain::DisposeUploaders()
+{
+	mHeightMapUploadBuffer = nullptr;
+}
+
+void Terrain::SelectNode(UINT level, UINT x, UINT z, const XMFLOAT3& eyePosW,
+	const BoundingFrustum& frustumW, bool cull)
+{
+	UINT nodeCount = 1 << level;
+	float nodeSize = mSize / nodeCount;
+	XMFLOAT2 range = mHeightRanges[level][z*nodeCount + x];
+
+	BoundingBox bounds;
+	bounds.Center = XMFLOAT3(
+		-0.5f*mSize + (x + 0.5f)*nodeSize,
+		0.5f*(range.x + range.y),
+		0.5f*mSize - (z + 0.5f)*nodeSize);
+	bounds.Extents = XMFLOAT3(0.5f*nodeSize, 0.5f*(range.y - range.x), 0.5f*nodeSize);
+
+	if(cull && frustumW.Contains(bounds) == DirectX::DISJOINT)
+		return;
+
+	// Distance from the eye to the nearest point of the node.
+	XMVECTOR offset = XMVectorAbs(XMLoadFloat3(&eyePosW) - XMLoadFloat3(&bounds.Center));
+	offset = XMVectorMax(offset - XMLoadFloat3(&bounds.Extents), XMVectorZero());
+	float distance = XMVectorGetX(XMVector3Length(offset));
+
+	if(level + 1 < mLevelCount && distance < mSplitDistance*nodeSize)
+	{
+		for(UINT k = 0; k < 4; ++k)
+			SelectNode(level + 1, 2*x + k % 2, 2*z + k / 2, eyePosW, frustumW, cull);
+		return;
+	}
+
+	if(mTiles.size() == MaxTileCount())
+		return;
+
+	// Neighbours a level apart differ by at most the height range along the shared
+	// edge, plus a vertex spacing for the T-junctions.
+	Tile tile;
+	tile.CenterW = XMFLOAT2(bounds.Center.x, bounds.Center.z);
+	tile.Size = nodeSize;
+	tile.SkirtDepth = range.y - range.x + nodeSize / (mTileResolution - 1);
+	mTiles.push_back(tile);
+}
@@ -0,0 +1,99 @@
+//***************************************************************************************
+// Terrain.h
+//
+// A square heightfield terrain drawn as a quadtree of tiles.  Every tile is the same
+// small grid mesh scaled to its node's size, and the vertex shader reads the heights
+// from a height texture, so no mesh is built per tile or for the whole map.  Each frame
+// Select walks the quadtree from the root, culls nodes against the frustum and splits
+// the ones closer to the eye than their LOD distance, so tiles near the camera are
+// small and dense and far ones large and coarse.  Tiles hide the cracks between levels
+// with skirts pulled down by the tile's SkirtDepth.
+//***************************************************************************************
+
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include "../../Common/d3dUtil.h"
+
+class Terrain
+{
+public:
+	// One tile to draw, as read by the vertex shader.
+	struct Tile
+	{
+		DirectX::XMFLOAT2 CenterW;
+		float Size;
+		float SkirtDepth;
+	};
+
+	// The map covers [-size/2, size/2]^2 around the origin.  heights holds
+	// heightResolution^2 samples row by row, rows running from +z to -z and each row
+	// from -x to +x.  The quadtree has levelCount levels, so leaf tiles are
+	// size / 2^(levelCount - 1) across and the resolution must divide into them.
+	// A node is split while the eye is closer to it than splitDistance times its size.
+	Terrain(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+		float size, UINT heightResolution, const std::vector<float>& heights,
+		UINT levelCount, UINT tileResolution, float splitDistance);
+	Terrain(const Terrain& rhs) = delete;
+	Terrain& operator=(const Terrain& rhs) = delete;
+	~Terrain();
+
+	float Size()const;
+	UINT HeightResolution()const;
+	float SpatialStep()const;
+
+	// World space box around the whole terrain.
+	DirectX::BoundingBox Bounds()const;
+
+	// Most tiles Select returns; nodes past it are left undrawn.
+	static UINT MaxTileCount();
+
+	// SRV of the height texture, sampled by the vertex shader.
+	CD3DX12_GPU_DESCRIPTOR_HANDLE HeightMap()const;
+
+	// Number of consecutive SRV heap descriptors BuildDescriptors fills.
+	UINT DescriptorCount()const;
+
+	void BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDescriptor,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuDescriptor,
+		UINT descriptorSize);
+
+	// Picks this frame's tiles for an eye at eyePosW.  Nodes outside frustumW are
+	// skipped when cull is set.
+	void Select(const DirectX::XMFLOAT3& eyePosW, const DirectX::BoundingFrustum& frustumW, bool cull);
+
+	// Tiles picked by the last Select.
+	const std::vector<Tile>& Tiles()const;
+
+	// Call once the upload recorded by the constructor has executed.
+	void DisposeUploaders();
+
+private:
+	void BuildResources(ID3D12GraphicsCommandList* cmdList, const std::vector<float>& heights);
+	void BuildHeightRanges(const std::vector<float>& heights);
+	void SelectNode(UINT level, UINT x, UINT z, const DirectX::XMFLOAT3& eyePosW,
+		const DirectX::BoundingFrustum& frustumW, bool cull);
+
+private:
+	float mSize = 0.0f;
+	UINT mHeightResolution = 0;
+	UINT mLevelCount = 0;
+	UINT mTileResolution = 0;
+	float mSplitDistance = 0.0f;
+
+	// Lowest and highest height under every node, level by level from the root.
+	// Level l holds 2^l x 2^l nodes, row by row like the height samples.
+	std::vector<std::vector<DirectX::XMFLOAT2>> mHeightRanges;
+
+	std::vector<Tile> mTiles;
+
+	ID3D12Device* md3dDevice = nullptr;
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mHeightMapSrv;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mHeightMap = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mHeightMapUploadBuffer = nullptr;
+};
+
+#endif // TERRAIN_H
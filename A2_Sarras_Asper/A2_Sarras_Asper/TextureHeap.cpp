@@ -0,0 +1,323 @@
+//***************************************************************************************
+// TextureHeap.cpp
+//***************************************************************************************
+
+#include "TextureHeap.h"
+
+using Microsoft::WRL::ComPtr;
+
+TextureHeap::TextureHeap(ID3D12Device* device, IDXGIAdapter3* adapter, UINT64 heapByteSize)
+{
+	md3dDevice = device;
+	mAdapter = adapter;
+	mHeapByteSize = heapByteSize;
+
+	QueryMemoryInfo();
+}
+
+TextureHeap::~TextureHeap()
+{
+}
+
+HRESULT TextureHeap::CreateTexture(
+	const D3D12_RESOURCE_DESC& desc,
+	D3D12_RESOURCE_STATES initialState,
+	ComPtr<ID3D12Resource>& texture)
+{
+	D3D12_RESOURCE_ALLOCATION_INFO allocInfo = md3dDevice->GetResourceAllocationInfo(0, 1, &desc);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	size_t heapIndex = mHeaps.size();
+	UINT64 offset = 0;
+	for(size_t i = 0; i < mHeaps.size(); ++i)
+	{
+		if(mHeaps[i].Resident && FindSpace(mHeaps[i], allocInfo, offset))
+		{
+			heapIndex = i;
+			break;
+		}
+	}
+
+	if(heapIndex == mHeaps.size())
+	{
+		Heap heap;
+		HRESULT hr = CreateHeap(std::max<UINT64>(mHeapByteSize, allocInfo.SizeInBytes), heap);
+
+		// Out of video memory: make room by evicting idle heaps and try once more.
+		if(hr == E_OUTOFMEMORY)
+		{
+			while(EvictLeastRecentlyUsed() > 0)
+				;
+			hr = CreateHeap(std::max<UINT64>(mHeapByteSize, allocInfo.SizeInBytes), heap);
+		}
+
+		if(FAILED(hr))
+			return hr;
+
+		mHeaps.push_back(heap);
+	}
+
+	Heap& heap = mHeaps[heapIndex];
+
+	HRESULT hr = md3dDevice->CreatePlacedResource(heap.Resource.Get(), offset,
+		&desc, initialState, nullptr, IID_PPV_ARGS(texture.GetAddressOf()));
+	if(FAILED(hr))
+		return hr;
+
+	Reserve(heap, offset, allocInfo.SizeInBytes);
+	heap.LastUsedFrame = mCurrentFrame;
+	heap.PendingUploads++;
+
+	Placement placement;
+	placement.HeapIndex = heapIndex;
+	placement.Offset = offset;
+	placement.ByteSize = allocInfo.SizeInBytes;
+	mTextureHeaps[texture.Get()] = placement;
+
+	return S_OK;
+}
+
+void TextureHeap::Release(ID3D12Resource* texture)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto it = mTextureHeaps.find(texture);
+	if(it == mTextureHeaps.end())
+		return;
+
+	Free(mHeaps[it->second.HeapIndex], it->second.Offset, it->second.ByteSize);
+	mTextureHeaps.erase(it);
+}
+
+void TextureHeap::UploadComplete(ID3D12Resource* texture)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto it = mTextureHeaps.find(texture);
+	if(it == mTextureHeaps.end())
+		return;
+
+	Heap& heap = mHeaps[it->second.HeapIndex];
+	assert(heap.PendingUploads > 0);
+	heap.PendingUploads--;
+	heap.LastUsedFrame = std::max<UINT64>(heap.LastUsedFrame, mCurrentFrame);
+}
+
+void TextureHeap::MarkUsed(ID3D12Resource* texture, UINT64 frame)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto it = mTextureHeaps.find(texture);
+	if(it != mTextureHeaps.end())
+		mHeaps[it->second.HeapIndex].LastUsedFrame = frame;
+}
+
+void TextureHeap::UpdateResidency(UINT64 frame, UINT64 completedFrame)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	mCurrentFrame = frame;
+	mCompletedFrame = completedFrame;
+
+	// Bring back everything this frame reads before its command lists execute.
+	std::vector<ID3D12Pageable*> wanted;
+	for(auto& heap : mHeaps)
+	{
+		if(!heap.Resident && heap.LastUsedFrame == frame)
+			wanted.push_back(heap.Resource.Get());
+	}
+
+	if(!wanted.empty())
+	{
+		HRESULT hr = md3dDevice->MakeResident((UINT)wanted.size(), wanted.data());
+		if(hr == E_OUTOFMEMORY)
+		{
+			while(EvictLeastRecentlyUsed() > 0)
+				;
+			hr = md3dDevice->MakeResident((UINT)wanted.size(), wanted.data());
+		}
+		ThrowIfFailed(hr);
+
+		for(auto& heap : mHeaps)
+		{
+			if(heap.LastUsedFrame == frame)
+				heap.Resident = true;
+		}
+	}
+
+	QueryMemoryInfo();
+
+	// The budget changes with what other applications are doing, so recheck every
+	// frame.  Usage is only refreshed by the OS later, so estimate it meanwhile.
+	UINT64 usage = mMemoryInfo.CurrentUsage;
+	while(usage > mMemoryInfo.Budget)
+	{
+		UINT64 evictedBytes = EvictLeastRecentlyUsed();
+		if(evictedBytes == 0)
+			break;
+
+		usage -= std::min<UINT64>(usage, evictedBytes);
+	}
+}
+
+UINT64 TextureHeap::Budget()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mMemoryInfo.Budget;
+}
+
+UINT64 TextureHeap::CurrentUsage()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mMemoryInfo.CurrentUsage;
+}
+
+UINT TextureHeap::HeapCount()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return (UINT)mHeaps.size();
+}
+
+UINT TextureHeap::EvictedHeapCount()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	UINT count = 0;
+	for(auto& heap : mHeaps)
+		count += heap.Resident ? 0 : 1;
+
+	return count;
+}
+
+HRESULT TextureHeap::CreateHeap(UINT64 byteSize, Heap& heap)
+{
+	// Resource heap tier 1 hardware cannot mix resource categories in one heap.
+	CD3DX12_HEAP_DESC heapDesc(byteSize, D3D12_HEAP_TYPE_DEFAULT,
+		D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT,
+		D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES);
+
+	HRESULT hr = md3dDevice->CreateHeap(&heapDesc, IID_PPV_ARGS(heap.Resource.GetAddressOf()));
+	if(FAILED(hr))
+		return hr;
+
+	heap.ByteSize = byteSize;
+	heap.Offset = 0;
+	heap.FreeRanges.clear();
+	heap.LastUsedFrame = mCurrentFrame;
+	heap.Resident = true;
+	heap.PendingUploads = 0;
+
+	return S_OK;
+}
+
+bool TextureHeap::FindSpace(const Heap& heap, const D3D12_RESOURCE_ALLOCATION_INFO& allocInfo, UINT64& offset)
+{
+	auto align = [&allocInfo](UINT64 value)
+	{
+		return (value + allocInfo.Alignment - 1) & ~(allocInfo.Alignment - 1);
+	};
+
+	// First fit among the released ranges, then the bump space.
+	for(auto& range : heap.FreeRanges)
+	{
+		UINT64 alignedOffset = align(range.first);
+		if(alignedOffset + allocInfo.SizeInBytes <= range.first + range.second)
+		{
+			offset = alignedOffset;
+			return true;
+		}
+	}
+
+	UINT64 alignedOffset = align(heap.Offset);
+	if(alignedOffset + allocInfo.SizeInBytes <= heap.ByteSize)
+	{
+		offset = alignedOffset;
+		return true;
+	}
+
+	return false;
+}
+
+void TextureHeap::Reserve(Heap& heap, UINT64 offset, UINT64 byteSize)
+{
+	if(offset >= heap.Offset)
+	{
+		// The alignment gap stays usable for smaller textures.
+		if(offset > heap.Offset)
+			Free(heap, heap.Offset, offset - heap.Offset);
+		heap.Offset = offset + byteSize;
+		return;
+	}
+
+	// Split the free range the allocation lies in around it.
+	for(size_t i = 0; i < heap.FreeRanges.size(); ++i)
+	{
+		UINT64 rangeBegin = heap.FreeRanges[i].first;
+		UINT64 rangeEnd = rangeBegin + heap.FreeRanges[i].second;
+		if(offset < rangeBegin || offset + byteSize > rangeEnd)
+			continue;
+
+		heap.FreeRanges.erase(heap.FreeRanges.begin() + i);
+		if(offset + byteSize < rangeEnd)
+			heap.FreeRanges.insert(heap.FreeRanges.begin() + i, { offset + byteSize, rangeEnd - offset - byteSize });
+		if(rangeBegin < offset)
+			heap.FreeRanges.insert(heap.FreeRanges.begin() + i, { rangeBegin, offset - rangeBegin });
+		return;
+	}
+
+	assert(false);
+}
+
+void TextureHeap::Free(Heap& heap, UINT64 offset, UINT64 byteSize)
+{
+	auto next = std::lower_bound(heap.FreeRanges.begin(), heap.FreeRanges.end(), std::make_pair(offset, UINT64(0)));
+	next = heap.FreeRanges.insert(next, { offset, byteSize });
+
+	// Merge with the neighbours, so the ranges never fragment the heap needlessly.
+	if(next + 1 != heap.FreeRanges.end() && next->first + next->second == (next + 1)->first)
+	{
+		next->second += (next + 1)->second;
+		heap.FreeRanges.erase(next + 1);
+	}
+	if(next != heap.FreeRanges.begin() && (next - 1)->first + (next - 1)->second == next->first)
+	{
+		(next - 1)->second += next->second;
+		next = heap.FreeRanges.erase(next) - 1;
+	}
+
+	// A range reaching the bump offset goes back to the bump space.
+	if(next->first + next->second == heap.Offset)
+	{
+		heap.Offset = next->first;
+		heap.FreeRanges.erase(next);
+	}
+}
+
+void TextureHeap::QueryMemoryInfo()
+{
+	ThrowIfFailed(mAdapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &mMemoryInfo));
+}
+
+UINT64 TextureHeap::EvictLeastRecentlyUsed()
+{
+	// Only heaps the GPU is done with and the copy queue is not writing qualify.
+	Heap* victim = nullptr;
+	for(auto& heap : mHeaps)
+	{
+		if(!heap.Resident || heap.PendingUploads > 0 || heap.LastUsedFrame > mCompletedFrame)
+			continue;
+
+		if(victim == nullptr || heap.LastUsedFrame < victim->LastUsedFrame)
+			victim = &heap;
+	}
+
+	if(victim == nullptr)
+		return 0;
+
+	ID3D12Pageable* pageable = victim->Resource.Get();
+	ThrowIfFailed(md3dDevice->Evict(1, &pageable));
+	victim->Resident = false;
+
+	return victim->ByteSize;
+}
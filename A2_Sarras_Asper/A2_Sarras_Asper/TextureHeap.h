@@ -0,0 +1,114 @@
+//***************************************************************************************
+// TextureHeap.h
+//
+// Places textures in a few large default heaps instead of one committed resource each,
+// and keeps those heaps within the DXGI local video memory budget.  Residency is
+// managed per heap: the client marks the textures each frame reads, and while usage
+// is over budget the heaps that have gone unused the longest are evicted.  An evicted
+// heap is made resident again before the next frame that reads from it.  Textures
+// replaced while the scene runs, such as hot reloaded ones, hand their space back
+// through Release so later textures can be placed in it.
+//***************************************************************************************
+
+#ifndef TEXTUREHEAP_H
+#define TEXTUREHEAP_H
+
+#include "../../Common/d3dUtil.h"
+#include <mutex>
+
+class TextureHeap
+{
+public:
+	TextureHeap(ID3D12Device* device, IDXGIAdapter3* adapter, UINT64 heapByteSize);
+	TextureHeap(const TextureHeap& rhs) = delete;
+	TextureHeap& operator=(const TextureHeap& rhs) = delete;
+	~TextureHeap();
+
+	// May be called from any thread.  Places the texture in the first resident heap with
+	// room, creating a new heap when none has any.  A texture larger than heapByteSize
+	// gets a heap of its own.  If video memory runs out, idle heaps are evicted and the
+	// allocation is retried once before the failure is returned.
+	HRESULT CreateTexture(
+		const D3D12_RESOURCE_DESC& desc,
+		D3D12_RESOURCE_STATES initialState,
+		Microsoft::WRL::ComPtr<ID3D12Resource>& texture);
+
+	// Returns the space of texture to its heap.  The GPU must be done with texture,
+	// and it must not be used again.  Textures that were not placed by this heap are
+	// ignored.
+	void Release(ID3D12Resource* texture);
+
+	// The copy queue has finished writing texture, so its heap may be evicted again.
+	void UploadComplete(ID3D12Resource* texture);
+
+	// Records that the frame numbered frame reads texture.  Textures that were not
+	// placed by this heap are ignored.
+	void MarkUsed(ID3D12Resource* texture, UINT64 frame);
+
+	// Call once per frame before the frame's command lists are executed.  Makes the
+	// heaps marked for frame resident, then evicts heaps last used by a frame no later
+	// than completedFrame until usage fits the budget.
+	void UpdateResidency(UINT64 frame, UINT64 completedFrame);
+
+	UINT64 Budget()const;
+	UINT64 CurrentUsage()const;
+	UINT HeapCount()const;
+	UINT EvictedHeapCount()const;
+
+private:
+	struct Heap
+	{
+		Microsoft::WRL::ComPtr<ID3D12Heap> Resource;
+		UINT64 ByteSize = 0;
+
+		// Bump offset of the next placed texture.  Space below it that was released,
+		// or skipped to align a texture, is kept in FreeRanges as (offset, size) pairs,
+		// sorted by offset and never adjacent, and is tried first.
+		UINT64 Offset = 0;
+		std::vector<std::pair<UINT64, UINT64>> FreeRanges;
+
+		UINT64 LastUsedFrame = 0;
+		bool Resident = true;
+
+		// Textures in this heap the copy queue may still be writing.
+		UINT PendingUploads = 0;
+	};
+
+	// Where a texture was placed.
+	struct Placement
+	{
+		size_t HeapIndex = 0;
+		UINT64 Offset = 0;
+		UINT64 ByteSize = 0;
+	};
+
+	HRESULT CreateHeap(UINT64 byteSize, Heap& heap);
+	// Finds room for an allocation in heap, returning false if there is none.
+	static bool FindSpace(const Heap& heap, const D3D12_RESOURCE_ALLOCATION_INFO& allocInfo, UINT64& offset);
+	// Takes [offset, offset + byteSize) out of the free ranges or the bump space.
+	static void Reserve(Heap& heap, UINT64 offset, UINT64 byteSize);
+	// Returns [offset, offset + byteSize) to the free ranges.
+	static void Free(Heap& heap, UINT64 offset, UINT64 byteSize);
+	void QueryMemoryInfo();
+	// Returns the size of the heap it evicted, or 0 if no heap could be evicted.
+	UINT64 EvictLeastRecentlyUsed();
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+	Microsoft::WRL::ComPtr<IDXGIAdapter3> mAdapter;
+
+	UINT64 mHeapByteSize = 0;
+
+	// Guards everything below.
+	mutable std::mutex mMutex;
+
+	std::vector<Heap> mHeaps;
+	std::unordered_map<ID3D12Resource*, Placement> mTextureHeaps;
+
+	UINT64 mCurrentFrame = 0;
+	UINT64 mCompletedFrame = 0;
+
+	DXGI_QUERY_VIDEO_MEMORY_INFO mMemoryInfo = {};
+};
+
+#endif // TEXTUREHEAP_H
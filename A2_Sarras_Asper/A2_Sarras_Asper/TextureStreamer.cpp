@@ -0,0 +1,232 @@
+//***************************************************************************************
+// TextureStreamer.cpp
+//***************************************************************************************
+
+#include "TextureStreamer.h"
+
+using Microsoft::WRL::ComPtr;
+
+TextureStreamer::TextureStreamer(ID3D12Device* device, TextureHeap* textureHeap)
+{
+	md3dDevice = device;
+	mTextureHeap = textureHeap;
+
+	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	ThrowIfFailed(md3dDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&mCopyQueue)));
+
+	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mFence)));
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	// Workers may still be recording into lists that are about to go away.
+	mLoadTasks.wait();
+
+	// Likewise the copy queue may still be reading the upload heaps.
+	if(mFence->GetCompletedValue() < mCurrentFence)
+	{
+		HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
+		ThrowIfFailed(mFence->SetEventOnCompletion(mCurrentFence, eventHandle));
+		WaitForSingleObject(eventHandle, INFINITE);
+		CloseHandle(eventHandle);
+	}
+}
+
+void TextureStreamer::Request(const std::string& name, const std::wstring& filename)
+{
+	Queue(name, filename, false);
+}
+
+void TextureStreamer::Reload(const std::string& name, const std::wstring& filename)
+{
+	Queue(name, filename, true);
+}
+
+void TextureStreamer::Queue(const std::string& name, const std::wstring& filename, bool reload)
+{
+	++mPendingCount;
+
+	mLoadTasks.run([this, name, filename, reload]()
+	{
+		auto load = std::make_unique<Load>();
+		load->Tex = std::make_unique<Texture>();
+		load->Tex->Name = name;
+		load->Tex->Filename = filename;
+		load->Reload = reload;
+
+		RecordLoad(*load);
+
+		std::lock_guard<std::mutex> lock(mLoadedMutex);
+		mLoaded.push_back(std::move(load));
+	});
+}
+
+void TextureStreamer::RecordLoad(Load& load)
+{
+	load.Result = md3dDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+		IID_PPV_ARGS(load.CmdListAlloc.GetAddressOf()));
+	if(FAILED(load.Result))
+		return;
+
+	load.Result = md3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY,
+		load.CmdListAlloc.Get(), nullptr, IID_PPV_ARGS(load.CmdList.GetAddressOf()));
+	if(FAILED(load.Result))
+		return;
+
+	// Reads and parses the file here on the worker, then records the copies.
+	load.Result = DirectX::CreateDDSTextureFromFile12(md3dDevice,
+		load.CmdList.Get(), load.Tex->Filename.c_str(),
+		load.Tex->Resource, load.Tex->UploadHeap, 0, nullptr, this);
+
+	HRESULT hr = load.CmdList->Close();
+	if(SUCCEEDED(load.Result))
+		load.Result = hr;
+}
+
+void TextureStreamer::Poll(std::vector<std::unique_ptr<Texture>>& resident)
+{
+	std::vector<std::unique_ptr<Load>> loaded;
+	{
+		std::lock_guard<std::mutex> lock(mLoadedMutex);
+		loaded.swap(mLoaded);
+	}
+
+	if(!loaded.empty())
+	{
+		std::vector<ID3D12CommandList*> cmdLists;
+		cmdLists.reserve(loaded.size());
+		for(auto& load : loaded)
+		{
+			// Running out of video memory is not fatal; the placeholder stays bound.
+			if(load->Result == E_OUTOFMEMORY)
+			{
+				OutputDebugString((L"TextureStreamer: out of video memory for " + load->Tex->Filename + L"\n").c_str());
+				continue;
+			}
+
+			if(FAILED(load->Result) && load->Reload)
+			{
+				OutputDebugString((L"TextureStreamer: could not reload " + load->Tex->Filename + L"\n").c_str());
+				continue;
+			}
+
+			if(FAILED(load->Result))
+				throw DxException(load->Result, L"CreateDDSTextureFromFile12 " + load->Tex->Filename, AnsiToWString(__FILE__), __LINE__);
+
+			cmdLists.push_back(load->CmdList.Get());
+		}
+
+		if(!cmdLists.empty())
+		{
+			mCopyQueue->ExecuteCommandLists((UINT)cmdLists.size(), cmdLists.data());
+			ThrowIfFailed(mCopyQueue->Signal(mFence.Get(), ++mCurrentFence));
+		}
+
+		for(auto& load : loaded)
+		{
+			if(FAILED(load->Result))
+			{
+				RecycleUploadBuffer(load->Tex->UploadHeap);
+				--mPendingCount;
+				continue;
+			}
+
+			load->Fence = mCurrentFence;
+			mInFlight.push_back(std::move(load));
+		}
+	}
+
+	// The client only sees a texture once its copy is done, so the graphics queue
+	// never has to wait on the copy fence.
+	const UINT64 completedFence = mFence->GetCompletedValue();
+
+	size_t completedCount = 0;
+	while(completedCount < mInFlight.size() && mInFlight[completedCount]->Fence <= completedFence)
+	{
+		auto& load = mInFlight[completedCount];
+		if(mTextureHeap != nullptr)
+			mTextureHeap->UploadComplete(load->Tex->Resource.Get());
+
+		RecycleUploadBuffer(load->Tex->UploadHeap);
+		resident.push_back(std::move(load->Tex));
+		++completedCount;
+	}
+
+	mInFlight.erase(mInFlight.begin(), mInFlight.begin() + completedCount);
+	mPendingCount -= (UINT)completedCount;
+}
+
+UINT TextureStreamer::PendingCount()const
+{
+	return mPendingCount;
+}
+
+void TextureStreamer::RecycleUploadBuffer(ComPtr<ID3D12Resource>& buffer)
+{
+	if(buffer == nullptr)
+		return;
+
+	std::lock_guard<std::mutex> lock(mUploadPoolMutex);
+
+	UINT64 byteSize = buffer->GetDesc().Width;
+	if(mFreeUploadBytes + byteSize <= MaxPooledUploadBytes)
+	{
+		mFreeUploadBuffers.push_back(buffer);
+		mFreeUploadBytes += byteSize;
+	}
+
+	buffer = nullptr;
+}
+
+HRESULT TextureStreamer::CreateTexture(const D3D12_RESOURCE_DESC& desc,
+	D3D12_RESOURCE_STATES initialState, ComPtr<ID3D12Resource>& texture)
+{
+	if(mTextureHeap != nullptr)
+		return mTextureHeap->CreateTexture(desc, initialState, texture);
+
+	return md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&desc,
+		initialState,
+		nullptr,
+		IID_PPV_ARGS(texture.GetAddressOf()));
+}
+
+HRESULT TextureStreamer::CreateUploadBuffer(UINT64 byteSize, ComPtr<ID3D12Resource>& buffer)
+{
+	{
+		std::lock_guard<std::mutex> lock(mUploadPoolMutex);
+
+		// Take the smallest free buffer that is large enough.
+		auto best = mFreeUploadBuffers.end();
+		for(auto it = mFreeUploadBuffers.begin(); it != mFreeUploadBuffers.end(); ++it)
+		{
+			UINT64 width = (*it)->GetDesc().Width;
+			if(width >= byteSize && (best == mFreeUploadBuffers.end() || width < (*best)->GetDesc().Width))
+				best = it;
+		}
+
+		if(best != mFreeUploadBuffers.end())
+		{
+			buffer = *best;
+			mFreeUploadBytes -= buffer->GetDesc().Width;
+			mFreeUploadBuffers.erase(best);
+			return S_OK;
+		}
+	}
+
+	// Round new buffers up so they fit more of the later requests.
+	const UINT64 granularity = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	UINT64 allocSize = (byteSize + granularity - 1) & ~(granularity - 1);
+
+	return md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(allocSize),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(buffer.GetAddressOf()));
+}
@@ -0,0 +1,100 @@
+//***************************************************************************************
+// TextureStreamer.h
+//
+// Loads DDS textures on worker threads and uploads them through a dedicated copy
+// queue with its own fence, so texture loading neither blocks startup nor competes
+// with the graphics queue.  The client polls once per frame to collect the textures
+// the GPU has finished copying, and binds a placeholder until then.  Textures are
+// placed in a TextureHeap, and upload buffers are recycled once their copies finish.
+//***************************************************************************************
+
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include "../../Common/d3dUtil.h"
+#include "TextureHeap.h"
+#include <ppl.h>
+#include <mutex>
+
+class TextureStreamer : private DirectX::IDDSResourceAllocator12
+{
+public:
+	TextureStreamer(ID3D12Device* device, TextureHeap* textureHeap);
+	TextureStreamer(const TextureStreamer& rhs) = delete;
+	TextureStreamer& operator=(const TextureStreamer& rhs) = delete;
+	~TextureStreamer();
+
+	// Queues a DDS file to be parsed and recorded on a worker thread.  Returns
+	// immediately.
+	void Request(const std::string& name, const std::wstring& filename);
+
+	// Same as Request, for a file that changed on disk.  A file that fails to load is
+	// reported and dropped instead of thrown, since the editor may not be done with it.
+	void Reload(const std::string& name, const std::wstring& filename);
+
+	// Call once per frame from the main thread.  Submits every load the workers have
+	// finished as one batch on the copy queue, and appends to resident the textures
+	// whose copies have completed.  Resident textures are left in the COMMON state,
+	// which the graphics queue promotes on first read.  A texture that did not fit in
+	// video memory is dropped, so its material keeps the placeholder.  Throws if a file
+	// failed to load for any other reason.
+	void Poll(std::vector<std::unique_ptr<Texture>>& resident);
+
+	// Requested textures that have not been handed out by Poll yet.
+	UINT PendingCount()const;
+
+private:
+	struct Load
+	{
+		std::unique_ptr<Texture> Tex;
+
+		// Each load records into its own list so the workers never share one.
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
+		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CmdList;
+
+		HRESULT Result = S_OK;
+		bool Reload = false;
+
+		// Copy queue fence value that marks the upload as complete.
+		UINT64 Fence = 0;
+	};
+
+	void Queue(const std::string& name, const std::wstring& filename, bool reload);
+	void RecordLoad(Load& load);
+	void RecycleUploadBuffer(Microsoft::WRL::ComPtr<ID3D12Resource>& buffer);
+
+	// IDDSResourceAllocator12, called by the loader on the worker threads.
+	virtual HRESULT CreateTexture(const D3D12_RESOURCE_DESC& desc,
+		D3D12_RESOURCE_STATES initialState,
+		Microsoft::WRL::ComPtr<ID3D12Resource>& texture)override;
+	virtual HRESULT CreateUploadBuffer(UINT64 byteSize,
+		Microsoft::WRL::ComPtr<ID3D12Resource>& buffer)override;
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+	TextureHeap* mTextureHeap = nullptr;
+
+	Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCopyQueue;
+	Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+	UINT64 mCurrentFence = 0;
+
+	concurrency::task_group mLoadTasks;
+
+	// Recorded by a worker but not submitted yet.  Guarded by mLoadedMutex.
+	std::mutex mLoadedMutex;
+	std::vector<std::unique_ptr<Load>> mLoaded;
+
+	// Submitted to the copy queue, in fence order.  Main thread only.
+	std::vector<std::unique_ptr<Load>> mInFlight;
+
+	UINT mPendingCount = 0;
+
+	// Upload buffers whose copies have completed, kept for later loads to reuse.
+	std::mutex mUploadPoolMutex;
+	std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> mFreeUploadBuffers;
+	UINT64 mFreeUploadBytes = 0;
+
+	static const UINT64 MaxPooledUploadBytes = 64 << 20;
+};
+
+#endif // TEXTURESTREAMER_H
@@ -0,0 +1,134 @@
+//***************************************************************************************
+// TransformHierarchy.cpp
+//***************************************************************************************
+
+#include "TransformHierarchy.h"
+#include <ppl.h>
+
+using namespace DirectX;
+
+// Levels smaller than this are computed on the calling thread.
+const size_t gParallelLevelSize = 256;
+
+TransformHierarchy::TransformHierarchy()
+{
+}
+
+TransformHierarchy::~TransformHierarchy()
+{
+}
+
+UINT TransformHierarchy::AddNode(UINT parent, const XMFLOAT4X4& local)
+{
+	assert(parent == None || parent < NodeCount());
+
+	UINT node = NodeCount();
+	UINT depth = parent == None ? 0 : mDepths[parent] + 1;
+
+	mParents.push_back(parent);
+	mDepths.push_back(depth);
+	mLocals.push_back(local);
+	mWorlds.push_back(MathHelper::Identity4x4());
+	mDirty.push_back(0);
+
+	if(depth == mLevels.size())
+		mLevels.emplace_back();
+	mLevels[depth].push_back(node);
+
+	MarkDirty(node);
+	return node;
+}
+
+UINT TransformHierarchy::NodeCount()const
+{
+	return (UINT)mParents.size();
+}
+
+UINT TransformHierarchy::Parent(UINT node)const
+{
+	return mParents[node];
+}
+
+const XMFLOAT4X4& TransformHierarchy::Local(UINT node)const
+{
+	return mLocals[node];
+}
+
+void TransformHierarchy::SetLocal(UINT node, const XMFLOAT4X4& local)
+{
+	mLocals[node] = local;
+	MarkDirty(node);
+}
+
+const XMFLOAT4X4& TransformHierarchy::World(UINT node)const
+{
+	return mWorlds[node];
+}
+
+const std::vector<UINT>& TransformHierarchy::Changed()const
+{
+	return mChanged;
+}
+
+void TransformHierarchy::MarkDirty(UINT node)
+{
+	mDirty[node] = 1;
+	mFirstDirtyLevel = std::min<UINT>(mFirstDirtyLevel, mDepths[node]);
+}
+
+void TransformHierarchy::Update()
+{
+	mChanged.clear();
+
+	UINT levelCount = (UINT)mLevels.size();
+	if(mFirstDirtyLevel >= levelCount)
+		return;
+
+	// A node is recomputed when it or its parent is dirty, and then counts as dirty for
+	// its own children.  Parents are a level up and already final, so the nodes of a
+	// level only read what the previous level wrote.
+	for(UINT level = mFirstDirtyLevel; level < levelCount; ++level)
+	{
+		const auto& nodes = mLevels[level];
+
+		auto updateNode = [&](size_t i)
+		{
+			UINT node = nodes[i];
+			UINT parent = mParents[node];
+
+			if(parent != None && mDirty[parent])
+				mDirty[node] = 1;
+
+			if(!mDirty[node])
+				return;
+
+			XMMATRIX world = XMLoadFloat4x4(&mLocals[node]);
+			if(parent != None)
+				world = world * XMLoadFloat4x4(&mWorlds[parent]);
+			XMStoreFloat4x4(&mWorlds[node], world);
+		};
+
+		if(nodes.size() < gParallelLevelSize)
+		{
+			for(size_t i = 0; i < nodes.size(); ++i)
+				updateNode(i);
+		}
+		else
+			concurrency::parallel_for(size_t(0), nodes.size(), updateNode);
+	}
+
+	// Only levels at or below the first dirty one can have been touched.
+	for(UINT level = mFirstDirtyLevel; level < levelCount; ++level)
+	{
+		for(UINT node : mLevels[level])
+		{
+			if(mDirty[node])
+			{
+				mChanged.push_back(node);
+				mDirty[node] = 0;
+			}
+		}
+	}
+
+	mFirstDirtyLevel = UINT_MAX;
+}
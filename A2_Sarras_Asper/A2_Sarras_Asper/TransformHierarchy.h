@@ -0,0 +1,66 @@
+//***************************************************************************************
+// TransformHierarchy.h
+//
+// Parent/child transforms kept in flat arrays.  Every node has a local matrix relative
+// to its parent and a world matrix, which Update recomputes only for nodes whose local
+// matrix, or an ancestor's, changed since the last Update.  The nodes are grouped by
+// depth, so each level can be computed in parallel once the one above it is done, and
+// the nodes Update touched are listed for the caller to copy out.
+//***************************************************************************************
+
+#ifndef TRANSFORMHIERARCHY_H
+#define TRANSFORMHIERARCHY_H
+
+#include "../../Common/d3dUtil.h"
+
+class TransformHierarchy
+{
+public:
+	// Parent of the root nodes.
+	static const UINT None = (UINT)-1;
+
+	TransformHierarchy();
+	TransformHierarchy(const TransformHierarchy& rhs) = delete;
+	TransformHierarchy& operator=(const TransformHierarchy& rhs) = delete;
+	~TransformHierarchy();
+
+	// Adds a node under parent, or a root for None, and returns its index.  The new
+	// node's world matrix is computed by the next Update.
+	UINT AddNode(UINT parent, const DirectX::XMFLOAT4X4& local);
+
+	UINT NodeCount()const;
+	UINT Parent(UINT node)const;
+
+	const DirectX::XMFLOAT4X4& Local(UINT node)const;
+	void SetLocal(UINT node, const DirectX::XMFLOAT4X4& local);
+
+	// As of the last Update.
+	const DirectX::XMFLOAT4X4& World(UINT node)const;
+
+	void Update();
+
+	// Nodes whose world matrix the last Update recomputed, in no particular order.
+	const std::vector<UINT>& Changed()const;
+
+private:
+	void MarkDirty(UINT node);
+
+private:
+	std::vector<UINT> mParents;
+	std::vector<UINT> mDepths;
+	std::vector<DirectX::XMFLOAT4X4> mLocals;
+	std::vector<DirectX::XMFLOAT4X4> mWorlds;
+
+	// Bytes rather than vector<bool>, so nodes of a level can be flagged in parallel.
+	std::vector<std::uint8_t> mDirty;
+
+	// Nodes of each depth, roots first.
+	std::vector<std::vector<UINT>> mLevels;
+
+	// Shallowest level with a dirty node, or past the end when nothing is dirty.
+	UINT mFirstDirtyLevel = UINT_MAX;
+
+	std::vector<UINT> mChanged;
+};
+
+#endif // TRANSFORMHIERARCHY_H
@@ -7,6 +7,13 @@
 #include <algorithm>
 #include <vector>
 #include <cassert>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#else
+#include <xmmintrin.h>
+#endif
 
 using namespace DirectX;
 
@@ -27,32 +34,36 @@ Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
     mK2 = (4.0f - 8.0f*e) / d;
     mK3 = (2.0f*e) / d;
 
-    mPrevSolution.resize(m*n);
-    mCurrSolution.resize(m*n);
-    mNormals.resize(m*n);
-    mTangentX.resize(m*n);
+    mPrevHeight.assign(m*n, 0.0f);
+    mCurrHeight.assign(m*n, 0.0f);
+
+	for(Output& out : mOutput)
+	{
+		out.Height.assign(m*n, 0.0f);
+		out.NormalX.assign(m*n, 0.0f);
+		out.NormalY.assign(m*n, 1.0f);
+		out.NormalZ.assign(m*n, 0.0f);
+		out.TangentXX.assign(m*n, 1.0f);
+		out.TangentXY.assign(m*n, 0.0f);
+	}
 
     // Generate grid vertices in system memory.
 
     float halfWidth = (n - 1)*dx*0.5f;
     float halfDepth = (m - 1)*dx*0.5f;
-    for(int i = 0; i < m; ++i)
-    {
-        float z = halfDepth - i*dx;
-        for(int j = 0; j < n; ++j)
-        {
-            float x = -halfWidth + j*dx;
 
-            mPrevSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mCurrSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mNormals[i*n + j] = XMFLOAT3(0.0f, 1.0f, 0.0f);
-            mTangentX[i*n + j] = XMFLOAT3(1.0f, 0.0f, 0.0f);
-        }
-    }
+	mX.resize(n);
+	for(int j = 0; j < n; ++j)
+		mX[j] = -halfWidth + j*dx;
+
+	mZ.resize(m);
+	for(int i = 0; i < m; ++i)
+		mZ[i] = halfDepth - i*dx;
 }
 
 Waves::~Waves()
 {
+	Wait();
 }
 
 int Waves::RowCount()const
@@ -87,86 +98,260 @@ float Waves::Depth()const
 
 void Waves::Update(float dt)
 {
-	static float t = 0;
+	// Publish anything a previous UpdateAsync left behind first.
+	Wait();
 
+	if(Simulate(dt))
+		mFront = 1 - mFront;
+}
+
+void Waves::UpdateAsync(float dt)
+{
+	Wait();
+
+	mSimTasks.run([this, dt]()
+	{
+		mBackWritten = Simulate(dt);
+	});
+}
+
+void Waves::Wait()
+{
+	mSimTasks.wait();
+
+	if(mBackWritten)
+	{
+		mFront = 1 - mFront;
+		mBackWritten = false;
+	}
+}
+
+bool Waves::Simulate(float dt)
+{
 	// Accumulate time.
-	t += dt;
+	mAccumTime += dt;
 
-	// Only update the simulation at the specified time step.
-	if( t >= mTimeStep )
+	int steps = 0;
+	while(mAccumTime >= mTimeStep && steps < MaxSubsteps)
 	{
 		// Only update interior points; we use zero boundary conditions.
 		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows-1; ++i)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
-			{
-				// After this update we will be discarding the old previous
-				// buffer, so overwrite that buffer with the new update.
-				// Note how we can do this inplace (read/write to same element) 
-				// because we won't need prev_ij again and the assignment happens last.
-
-				// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
-				// Moreover, our +z axis goes "down"; this is just to 
-				// keep consistent with our row indices going down.
-
-				mPrevSolution[i*mNumCols+j].y = 
-					mK1*mPrevSolution[i*mNumCols+j].y +
-					mK2*mCurrSolution[i*mNumCols+j].y +
-					mK3*(mCurrSolution[(i+1)*mNumCols+j].y + 
-					     mCurrSolution[(i-1)*mNumCols+j].y + 
-					     mCurrSolution[i*mNumCols+j+1].y + 
-						 mCurrSolution[i*mNumCols+j-1].y);
-			}
+			UpdateHeightRow(i);
 		});
 
 		// We just overwrote the previous buffer with the new data, so
 		// this data needs to become the current solution and the old
 		// current solution becomes the new previous solution.
-		std::swap(mPrevSolution, mCurrSolution);
+		std::swap(mPrevHeight, mCurrHeight);
 
-		t = 0.0f; // reset time
+		mAccumTime -= mTimeStep;
+		++steps;
+	}
 
-		//
-		// Compute normals using finite difference scheme.
-		//
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows - 1; ++i)
-		{
-			for(int j = 1; j < mNumCols-1; ++j)
-			{
-				float l = mCurrSolution[i*mNumCols+j-1].y;
-				float r = mCurrSolution[i*mNumCols+j+1].y;
-				float t = mCurrSolution[(i-1)*mNumCols+j].y;
-				float b = mCurrSolution[(i+1)*mNumCols+j].y;
-				mNormals[i*mNumCols+j].x = -r+l;
-				mNormals[i*mNumCols+j].y = 2.0f*mSpatialStep;
-				mNormals[i*mNumCols+j].z = b-t;
-
-				XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i*mNumCols+j]));
-				XMStoreFloat3(&mNormals[i*mNumCols+j], n);
-
-				mTangentX[i*mNumCols+j] = XMFLOAT3(2.0f*mSpatialStep, r-l, 0.0f);
-				XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i*mNumCols+j]));
-				XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
-			}
-		});
+	// Too far behind to catch up; drop the backlog rather than spiral.
+	if(mAccumTime >= mTimeStep)
+		mAccumTime = fmodf(mAccumTime, mTimeStep);
+
+	if(steps == 0)
+		return false;
+
+	//
+	// Compute normals using finite difference scheme, into the copy nobody is reading.
+	//
+	Output& out = mOutput[1 - mFront];
+	concurrency::parallel_for(1, mNumRows - 1, [this, &out](int i)
+	{
+		UpdateOutputRow(i, out);
+	});
+
+	return true;
+}
+
+void Waves::UpdateHeightRow(int i)
+{
+	// After this update we will be discarding the old previous
+	// buffer, so overwrite that buffer with the new update.
+	// Note how we can do this inplace (read/write to same element) 
+	// because we won't need prev_ij again and the assignment happens last.
+
+	// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
+	// Moreover, our +z axis goes "down"; this is just to 
+	// keep consistent with our row indices going down.
+
+	float* prev = &mPrevHeight[i*mNumCols];
+	const float* curr = &mCurrHeight[i*mNumCols];
+	const float* up = curr - mNumCols;
+	const float* down = curr + mNumCols;
+
+	int j = 1;
+	const int end = mNumCols - 1;
+
+#if defined(__AVX__)
+	const __m256 k1x8 = _mm256_set1_ps(mK1);
+	const __m256 k2x8 = _mm256_set1_ps(mK2);
+	const __m256 k3x8 = _mm256_set1_ps(mK3);
+	for(; j + 8 <= end; j += 8)
+	{
+		__m256 sum = _mm256_add_ps(
+			_mm256_add_ps(_mm256_loadu_ps(down + j), _mm256_loadu_ps(up + j)),
+			_mm256_add_ps(_mm256_loadu_ps(curr + j + 1), _mm256_loadu_ps(curr + j - 1)));
+
+		__m256 h = _mm256_add_ps(
+			_mm256_add_ps(_mm256_mul_ps(k1x8, _mm256_loadu_ps(prev + j)), _mm256_mul_ps(k2x8, _mm256_loadu_ps(curr + j))),
+			_mm256_mul_ps(k3x8, sum));
+
+		_mm256_storeu_ps(prev + j, h);
+	}
+#endif
+
+	const __m128 k1x4 = _mm_set1_ps(mK1);
+	const __m128 k2x4 = _mm_set1_ps(mK2);
+	const __m128 k3x4 = _mm_set1_ps(mK3);
+	for(; j + 4 <= end; j += 4)
+	{
+		__m128 sum = _mm_add_ps(
+			_mm_add_ps(_mm_loadu_ps(down + j), _mm_loadu_ps(up + j)),
+			_mm_add_ps(_mm_loadu_ps(curr + j + 1), _mm_loadu_ps(curr + j - 1)));
+
+		__m128 h = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(k1x4, _mm_loadu_ps(prev + j)), _mm_mul_ps(k2x4, _mm_loadu_ps(curr + j))),
+			_mm_mul_ps(k3x4, sum));
+
+		_mm_storeu_ps(prev + j, h);
+	}
+
+	// Remainder of the row.
+	for(; j < end; ++j)
+	{
+		prev[j] =
+			mK1*prev[j] +
+			mK2*curr[j] +
+			mK3*(down[j] + up[j] + curr[j+1] + curr[j-1]);
 	}
 }
 
+void Waves::UpdateOutputRow(int i, Output& out)
+{
+	const float* curr = &mCurrHeight[i*mNumCols];
+	const float* up = curr - mNumCols;
+	const float* down = curr + mNumCols;
+
+	// Boundary rows are always at rest, so only interior rows need their heights copied.
+	std::copy(curr, curr + mNumCols, &out.Height[i*mNumCols]);
+
+	float* nx = &out.NormalX[i*mNumCols];
+	float* ny = &out.NormalY[i*mNumCols];
+	float* nz = &out.NormalZ[i*mNumCols];
+	float* tx = &out.TangentXX[i*mNumCols];
+	float* ty = &out.TangentXY[i*mNumCols];
+
+	// The normal is normalize(l-r, 2dx, b-t) and the tangent normalize(2dx, r-l, 0).
+	const float twoDx = 2.0f*mSpatialStep;
+
+	int j = 1;
+	const int end = mNumCols - 1;
+
+#if defined(__AVX__)
+	const __m256 twoDxX8 = _mm256_set1_ps(twoDx);
+	const __m256 twoDxSqX8 = _mm256_set1_ps(twoDx*twoDx);
+	const __m256 oneX8 = _mm256_set1_ps(1.0f);
+	for(; j + 8 <= end; j += 8)
+	{
+		__m256 l = _mm256_loadu_ps(curr + j - 1);
+		__m256 r = _mm256_loadu_ps(curr + j + 1);
+		__m256 dX = _mm256_sub_ps(l, r);
+		__m256 dZ = _mm256_sub_ps(_mm256_loadu_ps(down + j), _mm256_loadu_ps(up + j));
+
+		__m256 dXSq = _mm256_mul_ps(dX, dX);
+		__m256 nLen = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(dXSq, twoDxSqX8), _mm256_mul_ps(dZ, dZ)));
+		__m256 nInv = _mm256_div_ps(oneX8, nLen);
+		_mm256_storeu_ps(nx + j, _mm256_mul_ps(dX, nInv));
+		_mm256_storeu_ps(ny + j, _mm256_mul_ps(twoDxX8, nInv));
+		_mm256_storeu_ps(nz + j, _mm256_mul_ps(dZ, nInv));
+
+		__m256 tInv = _mm256_div_ps(oneX8, _mm256_sqrt_ps(_mm256_add_ps(twoDxSqX8, dXSq)));
+		_mm256_storeu_ps(tx + j, _mm256_mul_ps(twoDxX8, tInv));
+		_mm256_storeu_ps(ty + j, _mm256_mul_ps(_mm256_sub_ps(r, l), tInv));
+	}
+#endif
+
+	const __m128 twoDxX4 = _mm_set1_ps(twoDx);
+	const __m128 twoDxSqX4 = _mm_set1_ps(twoDx*twoDx);
+	const __m128 oneX4 = _mm_set1_ps(1.0f);
+	for(; j + 4 <= end; j += 4)
+	{
+		__m128 l = _mm_loadu_ps(curr + j - 1);
+		__m128 r = _mm_loadu_ps(curr + j + 1);
+		__m128 dX = _mm_sub_ps(l, r);
+		__m128 dZ = _mm_sub_ps(_mm_loadu_ps(down + j), _mm_loadu_ps(up + j));
+
+		__m128 dXSq = _mm_mul_ps(dX, dX);
+		__m128 nLen = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(dXSq, twoDxSqX4), _mm_mul_ps(dZ, dZ)));
+		__m128 nInv = _mm_div_ps(oneX4, nLen);
+		_mm_storeu_ps(nx + j, _mm_mul_ps(dX, nInv));
+		_mm_storeu_ps(ny + j, _mm_mul_ps(twoDxX4, nInv));
+		_mm_storeu_ps(nz + j, _mm_mul_ps(dZ, nInv));
+
+		__m128 tInv = _mm_div_ps(oneX4, _mm_sqrt_ps(_mm_add_ps(twoDxSqX4, dXSq)));
+		_mm_storeu_ps(tx + j, _mm_mul_ps(twoDxX4, tInv));
+		_mm_storeu_ps(ty + j, _mm_mul_ps(_mm_sub_ps(r, l), tInv));
+	}
+
+	// Remainder of the row.
+	for(; j < end; ++j)
+	{
+		float l = curr[j-1];
+		float r = curr[j+1];
+		float t = up[j];
+		float b = down[j];
+
+		float nInv = 1.0f / std::sqrt((l-r)*(l-r) + twoDx*twoDx + (b-t)*(b-t));
+		nx[j] = (l-r)*nInv;
+		ny[j] = twoDx*nInv;
+		nz[j] = (b-t)*nInv;
+
+		float tInv = 1.0f / std::sqrt(twoDx*twoDx + (r-l)*(r-l));
+		tx[j] = twoDx*tInv;
+		ty[j] = (r-l)*tInv;
+	}
+}
+
+void Waves::WriteVertices(void* dst, size_t vertexByteStride)const
+{
+	const Output& out = mOutput[mFront];
+	concurrency::parallel_for(0, mNumRows, [this, &out, dst, vertexByteStride](int i)
+	{
+		char* v = static_cast<char*>(dst) + (size_t)i*mNumCols*vertexByteStride;
+		for(int j = 0; j < mNumCols; ++j)
+		{
+			int k = i*mNumCols + j;
+
+			XMFLOAT3* posNormal = reinterpret_cast<XMFLOAT3*>(v);
+			posNormal[0] = XMFLOAT3(mX[j], out.Height[k], mZ[i]);
+			posNormal[1] = XMFLOAT3(out.NormalX[k], out.NormalY[k], out.NormalZ[k]);
+
+			v += vertexByteStride;
+		}
+	});
+}
+
 void Waves::Disturb(int i, int j, float magnitude)
 {
 	// Don't disturb boundaries.
 	assert(i > 1 && i < mNumRows-2);
 	assert(j > 1 && j < mNumCols-2);
 
+	// The solver state must not change under a background update.
+	Wait();
+
 	float halfMag = 0.5f*magnitude;
 
 	// Disturb the ijth vertex height and its neighbors.
-	mCurrSolution[i*mNumCols+j].y     += magnitude;
-	mCurrSolution[i*mNumCols+j+1].y   += halfMag;
-	mCurrSolution[i*mNumCols+j-1].y   += halfMag;
-	mCurrSolution[(i+1)*mNumCols+j].y += halfMag;
-	mCurrSolution[(i-1)*mNumCols+j].y += halfMag;
+	mCurrHeight[i*mNumCols+j]     += magnitude;
+	mCurrHeight[i*mNumCols+j+1]   += halfMag;
+	mCurrHeight[i*mNumCols+j-1]   += halfMag;
+	mCurrHeight[(i+1)*mNumCols+j] += halfMag;
+	mCurrHeight[(i-1)*mNumCols+j] += halfMag;
 }
 	
@@ -10,6 +10,7 @@
 #define WAVES_H
 
 #include <vector>
+#include <ppl.h>
 #include <DirectXMath.h>
 
 class Waves
@@ -28,17 +29,46 @@ public:
 	float Depth()const;
 
 	// Returns the solution at the ith grid point.
-    const DirectX::XMFLOAT3& Position(int i)const { return mCurrSolution[i]; }
+    DirectX::XMFLOAT3 Position(int i)const
+	{
+		const Output& out = mOutput[mFront];
+		return DirectX::XMFLOAT3(mX[i % mNumCols], out.Height[i], mZ[i / mNumCols]);
+	}
 
 	// Returns the solution normal at the ith grid point.
-    const DirectX::XMFLOAT3& Normal(int i)const { return mNormals[i]; }
+    DirectX::XMFLOAT3 Normal(int i)const
+	{
+		const Output& out = mOutput[mFront];
+		return DirectX::XMFLOAT3(out.NormalX[i], out.NormalY[i], out.NormalZ[i]);
+	}
 
 	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
-    const DirectX::XMFLOAT3& TangentX(int i)const { return mTangentX[i]; }
+    DirectX::XMFLOAT3 TangentX(int i)const
+	{
+		const Output& out = mOutput[mFront];
+		return DirectX::XMFLOAT3(out.TangentXX[i], out.TangentXY[i], 0.0f);
+	}
 
+	// Advances the simulation by dt in fixed steps of the simulation time step.
+	// Time left over is carried to the next call; at most MaxSubsteps steps are
+	// taken per call and any further backlog is dropped.
 	void Update(float dt);
+
+	// Same as Update, but the steps run on a background thread.  The call first
+	// waits for the work started by the previous call and publishes its result,
+	// so the accessors always see the solution one call behind.
+	void UpdateAsync(float dt);
+
+	// Blocks until background work started by UpdateAsync has finished.
+	void Wait();
+
 	void Disturb(int i, int j, float magnitude);
 
+	// Writes the position and normal of every grid point to dst, one vertex per
+	// vertexByteStride bytes, with the position at offset 0 and the normal right
+	// after it.  Rows are written in parallel, so dst can be mapped upload memory.
+	void WriteVertices(void* dst, size_t vertexByteStride)const;
+
 private:
     int mNumRows = 0;
     int mNumCols = 0;
@@ -54,10 +84,48 @@ private:
     float mTimeStep = 0.0f;
     float mSpatialStep = 0.0f;
 
-    std::vector<DirectX::XMFLOAT3> mPrevSolution;
-    std::vector<DirectX::XMFLOAT3> mCurrSolution;
-    std::vector<DirectX::XMFLOAT3> mNormals;
-    std::vector<DirectX::XMFLOAT3> mTangentX;
+    // Time accumulated toward the next step.
+    float mAccumTime = 0.0f;
+
+	static const int MaxSubsteps = 4;
+
+private:
+	// The solution the accessors read from.  Double buffered so a background
+	// update can write one copy while the other is being read.
+	struct Output
+	{
+		std::vector<float> Height;
+		std::vector<float> NormalX;
+		std::vector<float> NormalY;
+		std::vector<float> NormalZ;
+
+		// The x-axis tangent has no z component.
+		std::vector<float> TangentXX;
+		std::vector<float> TangentXY;
+	};
+
+	// Runs the steps due for dt and, if any ran, fills the back output.
+	// Returns true if the back output was written.
+	bool Simulate(float dt);
+
+	void UpdateHeightRow(int i);
+	void UpdateOutputRow(int i, Output& out);
+
+private:
+	// The solver only ever changes the height of a grid point, so the solution is
+	// stored as separate planes (structure of arrays).  x only depends on the column
+	// and z only on the row, so they are stored once per column/row.
+    std::vector<float> mPrevHeight;
+    std::vector<float> mCurrHeight;
+	std::vector<float> mX;
+	std::vector<float> mZ;
+
+	Output mOutput[2];
+	int mFront = 0;
+
+	// Background work started by UpdateAsync, and whether it wrote the back output.
+	concurrency::task_group mSimTasks;
+	bool mBackWritten = false;
 };
 
 #endif // WAVES_H
\ No newline at end of file
@@ -55,6 +55,23 @@ namespace DirectX
         DDS_ALPHA_MODE_CUSTOM        = 4,
     };
 
+	// Optional hook for CreateDDSTextureFromFile12 that decides where the texture and
+	// its upload buffer come from, e.g. placed in a larger heap or reused from a pool.
+	// It may be called from several loader threads at once.
+	class IDDSResourceAllocator12
+	{
+	public:
+		virtual ~IDDSResourceAllocator12() = default;
+
+		virtual HRESULT CreateTexture(_In_ const D3D12_RESOURCE_DESC& desc,
+		                              _In_ D3D12_RESOURCE_STATES initialState,
+		                              _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& texture) = 0;
+
+		// The buffer may be larger than byteSize and must be CPU writable.
+		virtual HRESULT CreateUploadBuffer(_In_ UINT64 byteSize,
+		                                   _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& buffer) = 0;
+	};
+
     // Standard version
     HRESULT CreateDDSTextureFromMemory( _In_ ID3D11Device* d3dDevice,
                                         _In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
@@ -89,7 +106,8 @@ namespace DirectX
 		                               _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& texture,
 		                               _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& textureUploadHeap,
 		                               _In_ size_t maxsize = 0,
-		                               _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
+		                               _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr,
+		                               _In_opt_ IDDSResourceAllocator12* allocator = nullptr
 		                               );
 
     // Standard version with optional auto-gen mipmap support
@@ -6,8 +6,8 @@
 #include "GameTimer.h"
 
 GameTimer::GameTimer()
-: mSecondsPerCount(0.0), mDeltaTime(-1.0), mBaseTime(0), 
-  mPausedTime(0), mPrevTime(0), mCurrTime(0), mStopped(false)
+: mSecondsPerCount(0.0), mDeltaTime(-1.0), mFixedDeltaTime(0.0), mFixedTotalTime(0.0),
+  mBaseTime(0), mPausedTime(0), mPrevTime(0), mCurrTime(0), mStopped(false)
 {
 	__int64 countsPerSec;
 	QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
@@ -18,6 +18,11 @@ GameTimer::GameTimer()
 // time when the clock is stopped.
 float GameTimer::TotalTime()const
 {
+	if( mFixedDeltaTime > 0.0 )
+	{
+		return (float)mFixedTotalTime;
+	}
+
 	// If we are stopped, do not count the time that has passed since we stopped.
 	// Moreover, if we previously already had a pause, the distance 
 	// mStopTime - mBaseTime includes paused time, which we do not want to count.
@@ -62,6 +67,8 @@ void GameTimer::Reset()
 	mPrevTime = currTime;
 	mStopTime = 0;
 	mStopped  = false;
+
+	mFixedTotalTime = 0.0;
 }
 
 void GameTimer::Start()
@@ -98,8 +105,21 @@ void GameTimer::Stop()
 	}
 }
 
+void GameTimer::SetFixedDeltaTime(double seconds)
+{
+	mFixedDeltaTime = seconds;
+}
+
 void GameTimer::Tick()
 {
+	// Fixed steps are counted rather than measured, so every run sees the same times.
+	if( mFixedDeltaTime > 0.0 )
+	{
+		mDeltaTime = mFixedDeltaTime;
+		mFixedTotalTime += mFixedDeltaTime;
+		return;
+	}
+
 	if( mStopped )
 	{
 		mDeltaTime = 0.0;
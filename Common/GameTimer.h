@@ -18,10 +18,17 @@ public:
 	void Stop();  // Call when paused.
 	void Tick();  // Call every frame.
 
+	// Advance exactly this many seconds per Tick, ignoring the wall clock and Stop.
+	// Set to 0 to follow the wall clock again.
+	void SetFixedDeltaTime(double seconds);
+
 private:
 	double mSecondsPerCount;
 	double mDeltaTime;
 
+	double mFixedDeltaTime;
+	double mFixedTotalTime;
+
 	__int64 mBaseTime;
 	__int64 mPausedTime;
 	__int64 mStopTime;
@@ -7,6 +7,33 @@
 
 using namespace DirectX;
 
+namespace
+{
+	// Modelled post-transform cache size; a little larger than most hardware's, which
+	// costs little on smaller caches.
+	const int gVertexCacheSize = 32;
+
+	// Forsyth's vertex score: vertices in the cache score by how recently they were
+	// used, and vertices with few triangles left get a boost so none are stranded.
+	float VertexCacheScore(int cachePosition, std::uint32_t remainingTriangles)
+	{
+		if(remainingTriangles == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if(cachePosition >= 0)
+		{
+			// The last triangle's vertices score the same however they are ordered.
+			if(cachePosition < 3)
+				score = 0.75f;
+			else
+				score = powf(1.0f - (cachePosition - 3) / (float)(gVertexCacheSize - 3), 1.5f);
+		}
+
+		return score + 2.0f*powf((float)remainingTriangles, -0.5f);
+	}
+}
+
 GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
 {
     MeshData meshData;
@@ -886,6 +913,52 @@ void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadi
 	}
 }
 
+std::vector<GeometryGenerator::MeshData> GeometryGenerator::CreateSphereLods(float radius, uint32 sliceCount, uint32 stackCount, uint32 lodCount)
+{
+	std::vector<MeshData> lods;
+	for(uint32 i = 0; i < lodCount; ++i)
+	{
+		lods.push_back(CreateSphere(radius, sliceCount, stackCount));
+
+		// A sphere needs at least 3 slices around and 2 stacks from pole to pole.
+		sliceCount = std::max<uint32>(sliceCount / 2, 3);
+		stackCount = std::max<uint32>(stackCount / 2, 2);
+	}
+
+	return lods;
+}
+
+std::vector<GeometryGenerator::MeshData> GeometryGenerator::CreateGeosphereLods(float radius, uint32 numSubdivisions, uint32 lodCount)
+{
+	std::vector<MeshData> lods;
+	for(uint32 i = 0; i < lodCount; ++i)
+	{
+		lods.push_back(CreateGeosphere(radius, numSubdivisions));
+
+		// Each subdivision quadruples the triangles, so one less is a quarter of them.
+		if(numSubdivisions > 0)
+			--numSubdivisions;
+	}
+
+	return lods;
+}
+
+std::vector<GeometryGenerator::MeshData> GeometryGenerator::CreateCylinderLods(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 lodCount)
+{
+	std::vector<MeshData> lods;
+	for(uint32 i = 0; i < lodCount; ++i)
+	{
+		lods.push_back(CreateCylinder(bottomRadius, topRadius, height, sliceCount, stackCount));
+
+		// The sides are straight, so stacks only matter for per-vertex effects and
+		// fall off faster than the slices that shape the silhouette.
+		sliceCount = std::max<uint32>(sliceCount / 2, 3);
+		stackCount = std::max<uint32>(stackCount / 4, 1);
+	}
+
+	return lods;
+}
+
 GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n)
 {
     MeshData meshData;
@@ -951,6 +1024,55 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
     return meshData;
 }
 
+GeometryGenerator::MeshData GeometryGenerator::CreateTerrainTile(uint32 n)
+{
+	MeshData meshData = CreateGrid(1.0f, 1.0f, n, n);
+
+	//
+	// Walk each edge with the outside of the tile to the viewer's front, so a, b, a'
+	// and a', b, b' wind clockwise like the grid's own triangles.  Vertex i*n+j is at
+	// x = j/(n-1) - 0.5 and z = 0.5 - i/(n-1).
+	//
+
+	std::vector<uint32> edges[4];
+	for(uint32 k = 0; k < n; ++k)
+	{
+		edges[0].push_back((n - 1)*n + k);         // -z edge, toward +x
+		edges[1].push_back(n - 1 - k);             // +z edge, toward -x
+		edges[2].push_back((n - 1 - k)*n + n - 1); // +x edge, toward +z
+		edges[3].push_back(k*n);                   // -x edge, toward -z
+	}
+
+	for(auto& edge : edges)
+	{
+		uint32 firstSkirtVertex = (uint32)meshData.Vertices.size();
+		for(uint32 v : edge)
+		{
+			Vertex skirt = meshData.Vertices[v];
+			skirt.Position.y = -1.0f;
+			meshData.Vertices.push_back(skirt);
+		}
+
+		for(uint32 k = 0; k + 1 < n; ++k)
+		{
+			uint32 a = edge[k];
+			uint32 b = edge[k + 1];
+			uint32 skirtA = firstSkirtVertex + k;
+			uint32 skirtB = firstSkirtVertex + k + 1;
+
+			meshData.Indices32.push_back(a);
+			meshData.Indices32.push_back(b);
+			meshData.Indices32.push_back(skirtA);
+
+			meshData.Indices32.push_back(skirtA);
+			meshData.Indices32.push_back(b);
+			meshData.Indices32.push_back(skirtB);
+		}
+	}
+
+	return meshData;
+}
+
 GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, float w, float h, float depth)
 {
     MeshData meshData;
@@ -993,3 +1115,145 @@ GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, floa
 
     return meshData;
 }
+
+void GeometryGenerator::OptimizeVertexCache(MeshData& meshData)
+{
+	const std::vector<uint32>& indices = meshData.Indices32;
+	uint32 vertexCount = (uint32)meshData.Vertices.size();
+	uint32 triangleCount = (uint32)indices.size() / 3;
+
+	//
+	// The triangles left to emit around each vertex, packed into one list: vertex v
+	// owns adjacency[adjacencyOffset[v]] onward, and its first remaining[v] are left.
+	//
+
+	std::vector<uint32> remaining(vertexCount, 0);
+	for(uint32 i = 0; i < 3*triangleCount; ++i)
+		++remaining[indices[i]];
+
+	std::vector<uint32> adjacencyOffset(vertexCount + 1, 0);
+	for(uint32 v = 0; v < vertexCount; ++v)
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+
+	std::vector<uint32> adjacency(3*triangleCount);
+	std::vector<uint32> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+	for(uint32 i = 0; i < 3*triangleCount; ++i)
+		adjacency[fill[indices[i]]++] = i / 3;
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for(uint32 v = 0; v < vertexCount; ++v)
+		vertexScore[v] = VertexCacheScore(-1, remaining[v]);
+
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32> cache;
+	std::vector<uint32> newCache;
+	cache.reserve(gVertexCacheSize + 3);
+	newCache.reserve(gVertexCacheSize + 3);
+
+	std::vector<uint32> optimized;
+	optimized.reserve(3*triangleCount);
+
+	uint32 nextInOrder = 0;
+	int best = -1;
+	for(uint32 n = 0; n < triangleCount; ++n)
+	{
+		// Nothing in the cache has triangles left; carry on in input order.
+		if(best < 0)
+		{
+			while(emitted[nextInOrder])
+				++nextInOrder;
+			best = (int)nextInOrder;
+		}
+
+		emitted[best] = true;
+
+		// The triangle's vertices go to the front of the cache.
+		newCache.clear();
+		for(uint32 k = 0; k < 3; ++k)
+		{
+			uint32 v = indices[3*best + k];
+			optimized.push_back(v);
+
+			uint32* first = &adjacency[adjacencyOffset[v]];
+			uint32* last = first + remaining[v];
+			std::swap(*std::find(first, last, (uint32)best), *(last - 1));
+			--remaining[v];
+
+			if(std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+				newCache.push_back(v);
+		}
+
+		for(uint32 v : cache)
+		{
+			if(std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+				newCache.push_back(v);
+		}
+
+		// Rescore everything that moved, including what fell out of the cache, then
+		// pick the best triangle touching it.
+		for(size_t i = 0; i < newCache.size(); ++i)
+		{
+			uint32 v = newCache[i];
+			cachePosition[v] = i < (size_t)gVertexCacheSize ? (int)i : -1;
+			vertexScore[v] = VertexCacheScore(cachePosition[v], remaining[v]);
+		}
+
+		best = -1;
+		float bestScore = -1.0f;
+		for(uint32 v : newCache)
+		{
+			for(uint32 j = adjacencyOffset[v]; j < adjacencyOffset[v] + remaining[v]; ++j)
+			{
+				uint32 t = adjacency[j];
+				float score =
+					vertexScore[indices[3*t + 0]] +
+					vertexScore[indices[3*t + 1]] +
+					vertexScore[indices[3*t + 2]];
+
+				if(score > bestScore)
+				{
+					bestScore = score;
+					best = (int)t;
+				}
+			}
+		}
+
+		if(newCache.size() > (size_t)gVertexCacheSize)
+			newCache.resize(gVertexCacheSize);
+		std::swap(cache, newCache);
+	}
+
+	meshData.Indices32 = std::move(optimized);
+	meshData.mIndices16.clear();
+}
+
+void GeometryGenerator::OptimizeVertexFetch(MeshData& meshData)
+{
+	const uint32 unused = 0xffffffff;
+	std::vector<uint32> remap(meshData.Vertices.size(), unused);
+
+	std::vector<Vertex> vertices;
+	vertices.reserve(meshData.Vertices.size());
+
+	for(uint32& index : meshData.Indices32)
+	{
+		if(remap[index] == unused)
+		{
+			remap[index] = (uint32)vertices.size();
+			vertices.push_back(meshData.Vertices[index]);
+		}
+
+		index = remap[index];
+	}
+
+	meshData.Vertices = std::move(vertices);
+	meshData.mIndices16.clear();
+}
+
+void GeometryGenerator::Optimize(MeshData& meshData)
+{
+	// Renumbering vertices keeps the triangle order, so the cache order survives.
+	OptimizeVertexCache(meshData);
+	OptimizeVertexFetch(meshData);
+}
@@ -71,6 +71,9 @@ public:
         }
 
 	private:
+		// Optimize* reorders Indices32 and has to drop the stale copy.
+		friend class GeometryGenerator;
+
 		std::vector<uint16> mIndices16;
 	};
 
@@ -108,17 +111,53 @@ public:
 	///</summary>
     MeshData CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount);
 
+	///<summary>
+	/// Level of detail chains of the shapes above, finest first.  Each level halves the
+	/// tessellation of the previous one (slices and stacks, or one subdivision less),
+	/// stopping at the coarsest tessellation that still has the shape's topology.  The
+	/// cylinder's straight sides keep their silhouette with fewer stacks, so its stacks
+	/// are divided by 4 per level instead while its slices halve.
+	///</summary>
+	std::vector<MeshData> CreateSphereLods(float radius, uint32 sliceCount, uint32 stackCount, uint32 lodCount);
+	std::vector<MeshData> CreateGeosphereLods(float radius, uint32 numSubdivisions, uint32 lodCount);
+	std::vector<MeshData> CreateCylinderLods(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 lodCount);
+
 	///<summary>
 	/// Creates an mxn grid in the xz-plane with m rows and n columns, centered
 	/// at the origin with the specified width and depth.
 	///</summary>
     MeshData CreateGrid(float width, float depth, uint32 m, uint32 n);
 
+	///<summary>
+	/// Creates a unit nxn grid in the xz-plane, centered at the origin, for terrain
+	/// tiles that take their heights from a texture.  Each edge is repeated at y = -1
+	/// as a skirt facing out of the tile, to be pulled down over the cracks between
+	/// tiles of different resolution.
+	///</summary>
+	MeshData CreateTerrainTile(uint32 n);
+
 	///<summary>
 	/// Creates a quad aligned with the screen.  This is useful for postprocessing and screen effects.
 	///</summary>
     MeshData CreateQuad(float x, float y, float w, float h, float depth);
 	void Subdivide(MeshData& meshData);
+
+	///<summary>
+	/// Reorders the triangles for hits in the post-transform vertex cache, following
+	/// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".  The mesh looks the same.
+	///</summary>
+	void OptimizeVertexCache(MeshData& meshData);
+
+	///<summary>
+	/// Renumbers the vertices in the order the triangles first use them, so vertex
+	/// fetches walk the vertex buffer forward.  Vertices no triangle uses are dropped.
+	///</summary>
+	void OptimizeVertexFetch(MeshData& meshData);
+
+	///<summary>
+	/// Both of the above, in the order that makes the second keep the first's gains.
+	///</summary>
+	void Optimize(MeshData& meshData);
 private:
 	
     Vertex MidPoint(const Vertex& v0, const Vertex& v1);
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "d3dUtil.h"
+#include <atomic>
+
+// One large, persistently mapped upload heap that hands out transient
+// sub-allocations by bumping an offset.  Nothing is freed individually; the owner
+// calls Reset() once the GPU is done with everything allocated since the last
+// Reset (for a per-frame allocator, once the frame's fence has been reached).
+// Allocate may be called from several recording threads at once.
+class LinearUploadAllocator
+{
+public:
+    struct Allocation
+    {
+        void* CPU = nullptr;
+        D3D12_GPU_VIRTUAL_ADDRESS GPU = 0;
+    };
+
+    LinearUploadAllocator(ID3D12Device* device, UINT64 byteSize) :
+        mByteSize(byteSize)
+    {
+        ThrowIfFailed(device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+            D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+            D3D12_RESOURCE_STATE_GENERIC_READ,
+            nullptr,
+            IID_PPV_ARGS(&mUploadBuffer)));
+
+        ThrowIfFailed(mUploadBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
+
+        mGpuBase = mUploadBuffer->GetGPUVirtualAddress();
+    }
+
+    LinearUploadAllocator(const LinearUploadAllocator& rhs) = delete;
+    LinearUploadAllocator& operator=(const LinearUploadAllocator& rhs) = delete;
+    ~LinearUploadAllocator()
+    {
+        if(mUploadBuffer != nullptr)
+            mUploadBuffer->Unmap(0, nullptr);
+
+        mMappedData = nullptr;
+    }
+
+    ID3D12Resource* Resource()const
+    {
+        return mUploadBuffer.Get();
+    }
+
+    // alignment must be a power of two.  The default suits constant buffer views.
+    Allocation Allocate(UINT64 byteSize, UINT64 alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT)
+    {
+        // Only the padding this allocation actually needs is skipped.  Another thread
+        // may bump the offset in between, in which case the alignment is redone.
+        UINT64 current = mOffset.load();
+        UINT64 offset = 0;
+        UINT64 next = 0;
+        do
+        {
+            offset = (current + alignment - 1) & ~(alignment - 1);
+            next = offset + byteSize;
+            if(next > mByteSize)
+                throw DxException(E_OUTOFMEMORY, L"LinearUploadAllocator::Allocate", AnsiToWString(__FILE__), __LINE__);
+        }
+        while(!mOffset.compare_exchange_weak(current, next));
+
+        Allocation a;
+        a.CPU = mMappedData + offset;
+        a.GPU = mGpuBase + offset;
+        return a;
+    }
+
+    // Copies data into a new 256-byte aligned block and returns its address for
+    // SetGraphicsRootConstantBufferView.
+    template<typename T>
+    D3D12_GPU_VIRTUAL_ADDRESS AllocateConstants(const T& data)
+    {
+        Allocation a = Allocate(d3dUtil::CalcConstantBufferByteSize(sizeof(T)));
+        memcpy(a.CPU, &data, sizeof(T));
+        return a.GPU;
+    }
+
+    // Only call once the GPU has finished reading every allocation made so far.
+    void Reset()
+    {
+        mOffset = 0;
+    }
+
+    UINT64 UsedBytes()const
+    {
+        return mOffset;
+    }
+
+    UINT64 ByteSize()const
+    {
+        return mByteSize;
+    }
+
+private:
+    Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
+    BYTE* mMappedData = nullptr;
+    D3D12_GPU_VIRTUAL_ADDRESS mGpuBase = 0;
+
+    UINT64 mByteSize = 0;
+    std::atomic<UINT64> mOffset{ 0 };
+};
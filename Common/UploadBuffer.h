@@ -55,6 +55,16 @@ public:
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
     }
 
+    // Typed pointer to the mapped memory, for writing many elements in place
+    // instead of one CopyData per element.  Constant buffer elements are padded
+    // to 256 bytes, so this is only valid for tightly packed buffers.  The memory
+    // is write-combined: write it sequentially and never read it back.
+    T* MappedData()
+    {
+        assert(!mIsConstantBuffer);
+        return reinterpret_cast<T*>(mMappedData);
+    }
+
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
@@ -35,6 +35,11 @@ D3DApp::~D3DApp()
 {
 	if(md3dDevice != nullptr)
 		FlushCommandQueue();
+
+	if(mFrameLatencyWaitableObject != nullptr)
+		CloseHandle(mFrameLatencyWaitableObject);
+	if(mFenceEvent != nullptr)
+		CloseHandle(mFenceEvent);
 }
 
 HINSTANCE D3DApp::AppInst()const
@@ -90,6 +95,7 @@ int D3DApp::Run()
 
 			if( !mAppPaused )
 			{
+				WaitForNextFrame();
 				CalculateFrameStats();
 				Update(mTimer);	
                 Draw(mTimer);
@@ -121,7 +127,7 @@ bool D3DApp::Initialize()
 void D3DApp::CreateRtvAndDsvDescriptorHeaps()
 {
     D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc;
-    rtvHeapDesc.NumDescriptors = SwapChainBufferCount;
+    rtvHeapDesc.NumDescriptors = mSwapChainBufferCount;
     rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
     rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
 	rtvHeapDesc.NodeMask = 0;
@@ -141,7 +147,7 @@ void D3DApp::CreateRtvAndDsvDescriptorHeaps()
 void D3DApp::OnResize()
 {
 	assert(md3dDevice);
-	assert(mSwapChain);
+	assert(mSwapChain || mOffscreen);
     assert(mDirectCmdListAlloc);
 
 	//! Flush before changing any resources.
@@ -150,23 +156,45 @@ void D3DApp::OnResize()
     ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
 
 	//! Release the previous resources we will be recreating.
-	for (int i = 0; i < SwapChainBufferCount; ++i)
+	for (int i = 0; i < mSwapChainBufferCount; ++i)
 		mSwapChainBuffer[i].Reset();
     mDepthStencilBuffer.Reset();
 	
 	//! Resize the swap chain.
-    ThrowIfFailed(mSwapChain->ResizeBuffers(
-		SwapChainBufferCount, 
-		mClientWidth, mClientHeight, 
-		mBackBufferFormat, 
-		DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH));
+	if(!mOffscreen)
+	{
+		ThrowIfFailed(mSwapChain->ResizeBuffers(
+			mSwapChainBufferCount, 
+			mClientWidth, mClientHeight, 
+			mBackBufferFormat, 
+			mSwapChainFlags));
+	}
 
 	mCurrBackBuffer = 0;
  
 	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHeapHandle(mRtvHeap->GetCPUDescriptorHandleForHeapStart());
-	for (UINT i = 0; i < SwapChainBufferCount; i++)
+	for (int i = 0; i < mSwapChainBufferCount; i++)
 	{
-		ThrowIfFailed(mSwapChain->GetBuffer(i, IID_PPV_ARGS(&mSwapChainBuffer[i])));
+		if(mOffscreen)
+		{
+			//! Stand-ins for the swap chain buffers, starting in the state presenting leaves them in.
+			CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Tex2D(
+				mBackBufferFormat, mClientWidth, mClientHeight, 1, 1,
+				m4xMsaaState ? 4 : 1, m4xMsaaState ? (m4xMsaaQuality - 1) : 0,
+				D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+
+			ThrowIfFailed(md3dDevice->CreateCommittedResource(
+				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+				D3D12_HEAP_FLAG_NONE,
+				&bufferDesc,
+				D3D12_RESOURCE_STATE_PRESENT,
+				nullptr,
+				IID_PPV_ARGS(&mSwapChainBuffer[i])));
+		}
+		else
+		{
+			ThrowIfFailed(mSwapChain->GetBuffer(i, IID_PPV_ARGS(&mSwapChainBuffer[i])));
+		}
 		md3dDevice->CreateRenderTargetView(mSwapChainBuffer[i].Get(), nullptr, rtvHeapHandle);
 		rtvHeapHandle.Offset(1, mRtvDescriptorSize);
 	}
@@ -405,8 +433,11 @@ bool D3DApp::InitMainWindow()
 		return false;
 	}
 
-	ShowWindow(mhMainWnd, SW_SHOW);
-	UpdateWindow(mhMainWnd);
+	if(!mOffscreen)
+	{
+		ShowWindow(mhMainWnd, SW_SHOW);
+		UpdateWindow(mhMainWnd);
+	}
 
 	return true;
 }
@@ -465,6 +496,23 @@ bool D3DApp::InitDirect3D()
 	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE,
 		IID_PPV_ARGS(&mFence)));
 
+	mFenceEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+	if(mFenceEvent == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
+	//! Tearing lets a windowed swap chain present without waiting for vsync, as
+	//! variable refresh rate displays need.
+	ComPtr<IDXGIFactory5> factory5;
+	BOOL allowTearing = FALSE;
+	if(SUCCEEDED(mdxgiFactory.As(&factory5)) &&
+		SUCCEEDED(factory5->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING, &allowTearing, sizeof(allowTearing))))
+	{
+		mTearingSupported = allowTearing == TRUE;
+	}
+
+	mSwapChainBufferCount = std::min<int>(std::max<int>(mSwapChainBufferCount, 2), MaxSwapChainBufferCount);
+	mMaxFrameLatency = std::max<UINT>(mMaxFrameLatency, 1);
+
 	mRtvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 	mDsvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
 	mCbvSrvUavDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
@@ -528,28 +576,49 @@ void D3DApp::CreateSwapChain()
     //! Release the previous swapchain we will be recreating.
     mSwapChain.Reset();
 
-    DXGI_SWAP_CHAIN_DESC sd;
-    sd.BufferDesc.Width = mClientWidth;
-    sd.BufferDesc.Height = mClientHeight;
-    sd.BufferDesc.RefreshRate.Numerator = 60;
-    sd.BufferDesc.RefreshRate.Denominator = 1;
-    sd.BufferDesc.Format = mBackBufferFormat;
-    sd.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
-    sd.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
+	if(mFrameLatencyWaitableObject != nullptr)
+	{
+		CloseHandle(mFrameLatencyWaitableObject);
+		mFrameLatencyWaitableObject = nullptr;
+	}
+
+	//! Offscreen rendering creates its buffers in OnResize instead.
+	if(mOffscreen)
+		return;
+
+	//! The waitable object signals whenever fewer than mMaxFrameLatency frames are
+	//! queued, which WaitForNextFrame waits on instead of blocking inside Present.
+	mSwapChainFlags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH | DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+	if(mTearingSupported)
+		mSwapChainFlags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+
+    DXGI_SWAP_CHAIN_DESC1 sd = {};
+    sd.Width = mClientWidth;
+    sd.Height = mClientHeight;
+    sd.Format = mBackBufferFormat;
+    sd.Stereo = false;
     sd.SampleDesc.Count = m4xMsaaState ? 4 : 1;
     sd.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
     sd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-    sd.BufferCount = SwapChainBufferCount;
-    sd.OutputWindow = mhMainWnd;
-    sd.Windowed = true;
+    sd.BufferCount = mSwapChainBufferCount;
+    sd.Scaling = DXGI_SCALING_STRETCH;
 	sd.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-    sd.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
+    sd.AlphaMode = DXGI_ALPHA_MODE_UNSPECIFIED;
+    sd.Flags = mSwapChainFlags;
 
 	// Note: Swap chain uses queue to perform flush.
-    ThrowIfFailed(mdxgiFactory->CreateSwapChain(
+    ComPtr<IDXGISwapChain1> swapChain;
+    ThrowIfFailed(mdxgiFactory->CreateSwapChainForHwnd(
 		mCommandQueue.Get(),
+		mhMainWnd,
 		&sd, 
-		mSwapChain.GetAddressOf()));
+		nullptr,
+		nullptr,
+		swapChain.GetAddressOf()));
+    ThrowIfFailed(swapChain.As(&mSwapChain));
+
+	ThrowIfFailed(mSwapChain->SetMaximumFrameLatency(mMaxFrameLatency));
+	mFrameLatencyWaitableObject = mSwapChain->GetFrameLatencyWaitableObject();
 }
 
 void D3DApp::FlushCommandQueue()
@@ -563,17 +632,45 @@ void D3DApp::FlushCommandQueue()
     ThrowIfFailed(mCommandQueue->Signal(mFence.Get(), mCurrentFence));
 
 	//! Wait until the GPU has completed commands up to this fence point.
-    if(mFence->GetCompletedValue() < mCurrentFence)
+	WaitForFence(mCurrentFence);
+}
+
+void D3DApp::WaitForFence(UINT64 value)
+{
+    if(mFence->GetCompletedValue() < value)
 	{
-		HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
+        //! Fire event when GPU hits the fence value.  The event resets itself once
+        //! the wait below returns, so it is ready for the next wait.
+        ThrowIfFailed(mFence->SetEventOnCompletion(value, mFenceEvent));
+
+		WaitForSingleObject(mFenceEvent, INFINITE);
+	}
+}
+
+void D3DApp::WaitForNextFrame()
+{
+	//! Offscreen rendering has no display to wait for.
+	if(mFrameLatencyWaitableObject == nullptr)
+		return;
+
+	//! Bounded, so a lost display never hangs the app.
+	WaitForSingleObjectEx(mFrameLatencyWaitableObject, 1000, true);
+}
 
-        //! Fire event when GPU hits current fence.  
-        ThrowIfFailed(mFence->SetEventOnCompletion(mCurrentFence, eventHandle));
+void D3DApp::PresentBackBuffer()
+{
+	if(!mOffscreen)
+	{
+		//! Tearing is not allowed in exclusive fullscreen.
+		BOOL fullscreen = FALSE;
+		mSwapChain->GetFullscreenState(&fullscreen, nullptr);
 
-        //! Wait until the GPU hits current fence event is fired.
-		WaitForSingleObject(eventHandle, INFINITE);
-        CloseHandle(eventHandle);
+		UINT syncInterval = mVsyncEnabled ? 1 : 0;
+		UINT presentFlags = (!mVsyncEnabled && mTearingSupported && !fullscreen) ? DXGI_PRESENT_ALLOW_TEARING : 0;
+		ThrowIfFailed(mSwapChain->Present(syncInterval, presentFlags));
 	}
+
+	mCurrBackBuffer = (mCurrBackBuffer + 1) % mSwapChainBufferCount;
 }
 
 
@@ -618,7 +715,8 @@ void D3DApp::CalculateFrameStats()
 
         wstring windowText = mMainWndCaption +
             L"    fps: " + fpsStr +
-            L"   mspf: " + mspfStr;
+            L"   mspf: " + mspfStr +
+            mFrameStatsText;
 
         SetWindowText(mhMainWnd, windowText.c_str());
 		
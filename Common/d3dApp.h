@@ -60,6 +60,17 @@ protected:
 
 	void FlushCommandQueue();
 
+	// Blocks on the persistent fence event until mFence reaches value.
+	void WaitForFence(UINT64 value);
+
+	// Blocks until the swap chain can queue another frame, so each frame starts, and
+	// reads its input, as late as the display allows.  Run calls it before Update.
+	void WaitForNextFrame();
+
+	// Presents the current back buffer and moves on to the next one.  Tearing is
+	// allowed when vsync is off and the display supports it.
+	void PresentBackBuffer();
+
 	ID3D12Resource* CurrentBackBuffer()const;
 	D3D12_CPU_DESCRIPTOR_HANDLE CurrentBackBufferView()const;
 	D3D12_CPU_DESCRIPTOR_HANDLE DepthStencilView()const;
@@ -82,6 +93,10 @@ protected:
 	bool      mResizing = false;   // are the resize bars being dragged?
     bool      mFullscreenState = false;// fullscreen enabled
 
+	// Set true before Initialize to render into plain textures instead of a swap chain.
+	// The window is created but never shown, and nothing is presented.
+	bool      mOffscreen = false;
+
 	// Set true to use 4X MSAA.  The default is false.
     bool      m4xMsaaState = false;    // 4X MSAA enabled
     UINT      m4xMsaaQuality = 0;      // quality level of 4X MSAA
@@ -90,19 +105,33 @@ protected:
 	GameTimer mTimer;
 	
     Microsoft::WRL::ComPtr<IDXGIFactory4> mdxgiFactory;
-    Microsoft::WRL::ComPtr<IDXGISwapChain> mSwapChain;
+    Microsoft::WRL::ComPtr<IDXGISwapChain3> mSwapChain;
     Microsoft::WRL::ComPtr<ID3D12Device> md3dDevice;
 
     Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
     UINT64 mCurrentFence = 0;
+
+	// Created once and reused by every wait on mFence.
+	HANDLE mFenceEvent = nullptr;
 	
     Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCommandQueue;
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mDirectCmdListAlloc;
     Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mCommandList;
 
-	static const int SwapChainBufferCount = 2;
+	// Set before Initialize.  mMaxFrameLatency is how many frames may be queued for the
+	// display before WaitForNextFrame blocks; fewer means less input latency.
+	static const int MaxSwapChainBufferCount = 4;
+	int mSwapChainBufferCount = 3;
+	UINT mMaxFrameLatency = 2;
+	bool mVsyncEnabled = false;
+
+	// Flags the swap chain was created with, which ResizeBuffers must repeat.
+	UINT mSwapChainFlags = 0;
+	bool mTearingSupported = false;
+	HANDLE mFrameLatencyWaitableObject = nullptr;
+
 	int mCurrBackBuffer = 0;
-    Microsoft::WRL::ComPtr<ID3D12Resource> mSwapChainBuffer[SwapChainBufferCount];
+    Microsoft::WRL::ComPtr<ID3D12Resource> mSwapChainBuffer[MaxSwapChainBufferCount];
     Microsoft::WRL::ComPtr<ID3D12Resource> mDepthStencilBuffer;
 
     Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mRtvHeap;
@@ -117,6 +146,9 @@ protected:
 
 	// Derived class should set these in derived constructor to customize starting values.
 	std::wstring mMainWndCaption = L"d3d App";
+
+	// Extra statistics the derived class wants shown after fps/mspf in the caption.
+	std::wstring mFrameStatsText;
 	D3D_DRIVER_TYPE md3dDriverType = D3D_DRIVER_TYPE_HARDWARE;
     DXGI_FORMAT mBackBufferFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
     DXGI_FORMAT mDepthStencilFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
@@ -35,6 +35,28 @@ ComPtr<ID3DBlob> d3dUtil::LoadBinary(const std::wstring& filename)
     return blob;
 }
 
+DXGI_FORMAT d3dUtil::CreateIndexBlob(
+    const std::vector<std::uint32_t>& indices,
+    Microsoft::WRL::ComPtr<ID3DBlob>& blob)
+{
+    std::uint32_t maxIndex = 0;
+    for(std::uint32_t index : indices)
+        maxIndex = std::max<std::uint32_t>(maxIndex, index);
+
+    if(maxIndex > 0xffff)
+    {
+        ThrowIfFailed(D3DCreateBlob(indices.size()*sizeof(std::uint32_t), blob.ReleaseAndGetAddressOf()));
+        CopyMemory(blob->GetBufferPointer(), indices.data(), indices.size()*sizeof(std::uint32_t));
+        return DXGI_FORMAT_R32_UINT;
+    }
+
+    ThrowIfFailed(D3DCreateBlob(indices.size()*sizeof(std::uint16_t), blob.ReleaseAndGetAddressOf()));
+    std::uint16_t* indices16 = reinterpret_cast<std::uint16_t*>(blob->GetBufferPointer());
+    for(size_t i = 0; i < indices.size(); ++i)
+        indices16[i] = static_cast<std::uint16_t>(indices[i]);
+    return DXGI_FORMAT_R16_UINT;
+}
+
 Microsoft::WRL::ComPtr<ID3D12Resource> d3dUtil::CreateDefaultBuffer(
     ID3D12Device* device,
     ID3D12GraphicsCommandList* cmdList,
@@ -4,7 +4,7 @@
 
 #include <windows.h>
 #include <wrl.h>
-#include <dxgi1_4.h>
+#include <dxgi1_5.h>
 #include <d3d12.h>
 #include <D3Dcompiler.h>
 #include <DirectXMath.h>
@@ -25,7 +25,8 @@
 #include "DDSTextureLoader.h"
 #include "MathHelper.h"
 
-extern const int gNumFrameResources;
+// Set once at startup, before any frame resource or render item is created.
+extern int gNumFrameResources;
 
 inline void d3dSetDebugName(IDXGIObject* obj, const char* name)
 {
@@ -110,6 +111,12 @@ public:
 
 	static Microsoft::WRL::ComPtr<ID3DBlob> LoadBinary(const std::wstring& filename);
 
+	// Packs indices into a blob in the narrowest format that holds them, R16_UINT
+	// when every index is below 0x10000 and R32_UINT otherwise, and returns the format.
+	static DXGI_FORMAT CreateIndexBlob(
+		const std::vector<std::uint32_t>& indices,
+		Microsoft::WRL::ComPtr<ID3DBlob>& blob);
+
 	static Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(
 		ID3D12Device* device,
 		ID3D12GraphicsCommandList* cmdList,
@@ -165,16 +172,19 @@ struct MeshGeometry
 	Microsoft::WRL::ComPtr<ID3DBlob> VertexBufferCPU = nullptr;
 	Microsoft::WRL::ComPtr<ID3DBlob> IndexBufferCPU = nullptr;
 	Microsoft::WRL::ComPtr<ID3DBlob> ColorBufferCPU = nullptr;
+	Microsoft::WRL::ComPtr<ID3DBlob> TexCBufferCPU = nullptr;
 
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> VertexBufferGPU = nullptr;
 	Microsoft::WRL::ComPtr<ID3D12Resource> IndexBufferGPU = nullptr;
 	Microsoft::WRL::ComPtr<ID3D12Resource> ColorBufferGPU = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> TexCBufferGPU = nullptr;
 
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> VertexBufferUploader = nullptr;
 	Microsoft::WRL::ComPtr<ID3D12Resource> IndexBufferUploader = nullptr;
 	Microsoft::WRL::ComPtr<ID3D12Resource> ColorBufferUploader = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> TexCBufferUploader = nullptr;
 
 
 
@@ -185,6 +195,8 @@ struct MeshGeometry
 	UINT IndexBufferByteSize = 0;
 	UINT ColorByteStride = 0;
 	UINT ColorBufferByteSize = 0;
+	UINT TexCByteStride = 0;
+	UINT TexCBufferByteSize = 0;
 
 
 	// A MeshGeometry may store multiple geometries in one vertex/index buffer.
@@ -226,6 +238,19 @@ struct MeshGeometry
 		return cbv;
 	}
 
+	// Separate stream for tex-coords that stay fixed while the position/normal
+	// stream is rewritten every frame.
+	D3D12_VERTEX_BUFFER_VIEW TexCBufferView()const
+
+	{
+		D3D12_VERTEX_BUFFER_VIEW tbv;
+		tbv.BufferLocation = TexCBufferGPU->GetGPUVirtualAddress();
+		tbv.StrideInBytes = TexCByteStride;
+		tbv.SizeInBytes = TexCBufferByteSize;
+
+		return tbv;
+	}
+
 
 	// We can free this memory after we finish upload to the GPU.
 	void DisposeUploaders()
@@ -233,6 +258,7 @@ struct MeshGeometry
 		VertexBufferUploader = nullptr;
 		IndexBufferUploader = nullptr;
 		ColorBufferUploader = nullptr;
+		TexCBufferUploader = nullptr;
 	}
 };
 